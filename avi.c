@@ -0,0 +1,316 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#define _FILE_OFFSET_BITS 64
+#include <stdlib.h>
+#include <string.h>
+#include "avi.h"
+
+#ifdef _WIN32
+#define fseeko _fseeki64
+#define ftello _ftelli64
+#endif
+
+#define AVI_MAX_RIFF_SIZE (1024*1024*1024LL)
+#define AVI_MASTER_INDEX_SIZE 256  // ix00 chunks, so up to 256GB
+
+#define AVIF_HASINDEX       0x10
+#define AVIF_ISINTERLEAVED  0x100
+#define AVIF_TRUSTCKTYPE    0x800
+#define AVIIF_KEYFRAME      0x10
+#define AVI_INDEX_OF_INDEXES 0
+#define AVI_INDEX_OF_CHUNKS  1
+
+typedef struct
+{
+    int64_t pos;    // of the chunk header, from the movi list
+    uint32_t size;
+} avi_entry_t;
+
+struct avi_t
+{
+    FILE *fh;
+    int riff_id;
+    int64_t riff, movi;             // starts of the current RIFF and movi lists
+    int64_t avih_frames, avih_buffer, strh_length, strh_buffer, indx, dmlh_frames; // patched at the end
+    uint32_t frames, first_riff_frames;
+    uint32_t max_size;
+    avi_entry_t *entry;             // of the current RIFF
+    int entries, max_entries;
+    struct { int64_t pos; uint32_t size, duration; } ix[AVI_MASTER_INDEX_SIZE];
+    int ixs;
+};
+
+static void put_le16(FILE *fh, unsigned v)
+{
+    fputc(v & 0xff, fh);
+    fputc(v >> 8 & 0xff, fh);
+}
+
+static void put_le32(FILE *fh, uint32_t v)
+{
+    put_le16(fh, v & 0xffff);
+    put_le16(fh, v >> 16);
+}
+
+static void put_le64(FILE *fh, uint64_t v)
+{
+    put_le32(fh, (uint32_t)v);
+    put_le32(fh, (uint32_t)(v >> 32));
+}
+
+static void put_tag(FILE *fh, const char *tag)
+{
+    fwrite(tag, 1, 4, fh);
+}
+
+static void put_zeros(FILE *fh, int n)
+{
+    while(n--)
+        fputc(0, fh);
+}
+
+/* returns where the chunk's data starts, its size being filled in by end_tag */
+static int64_t start_tag(FILE *fh, const char *tag)
+{
+    put_tag(fh, tag);
+    put_le32(fh, 0);
+    return ftello(fh);
+}
+
+static void end_tag(FILE *fh, int64_t start)
+{
+    int64_t pos = ftello(fh);
+    if(pos & 1)
+        fputc(0, fh);
+    fseeko(fh, start - 4, SEEK_SET);
+    put_le32(fh, (uint32_t)(pos - start));
+    fseeko(fh, (pos + 1) & ~1, SEEK_SET);
+}
+
+static void patch_le32(FILE *fh, int64_t pos, uint32_t v)
+{
+    int64_t cur = ftello(fh);
+    fseeko(fh, pos, SEEK_SET);
+    put_le32(fh, v);
+    fseeko(fh, cur, SEEK_SET);
+}
+
+avi_t *avi_create(FILE *fh, const avi_info_t *info)
+{
+    avi_t *h = calloc(1, sizeof(avi_t));
+    if(!h)
+        return NULL;
+    h->fh = fh;
+    h->riff_id = 1;
+    h->riff = start_tag(fh, "RIFF");
+    put_tag(fh, "AVI ");
+    int64_t hdrl = start_tag(fh, "LIST");
+    put_tag(fh, "hdrl");
+
+    int64_t avih = start_tag(fh, "avih");
+    put_le32(fh, (uint32_t)(1000000ULL * info->fps_den / info->fps_num));
+    put_le32(fh, 0);                // max bytes per second
+    put_le32(fh, 0);                // padding granularity
+    put_le32(fh, AVIF_TRUSTCKTYPE | AVIF_HASINDEX | AVIF_ISINTERLEAVED);
+    h->avih_frames = ftello(fh);
+    put_le32(fh, 0);
+    put_le32(fh, 0);                // initial frames
+    put_le32(fh, 1);                // streams
+    h->avih_buffer = ftello(fh);
+    put_le32(fh, 0);
+    put_le32(fh, info->width);
+    put_le32(fh, info->height);
+    put_zeros(fh, 16);
+    end_tag(fh, avih);
+
+    int64_t strl = start_tag(fh, "LIST");
+    put_tag(fh, "strl");
+    int64_t strh = start_tag(fh, "strh");
+    put_tag(fh, "vids");
+    put_tag(fh, info->fourcc);
+    put_le32(fh, 0);                // flags
+    put_le16(fh, 0);                // priority
+    put_le16(fh, 0);                // language
+    put_le32(fh, 0);                // initial frames
+    put_le32(fh, info->fps_den);
+    put_le32(fh, info->fps_num);
+    put_le32(fh, 0);                // start
+    h->strh_length = ftello(fh);
+    put_le32(fh, 0);
+    h->strh_buffer = ftello(fh);
+    put_le32(fh, 0);
+    put_le32(fh, 0xFFFFFFFF);       // quality
+    put_le32(fh, 0);                // sample size
+    put_le16(fh, 0);
+    put_le16(fh, 0);
+    put_le16(fh, info->width);
+    put_le16(fh, info->height);
+    end_tag(fh, strh);
+
+    int64_t strf = start_tag(fh, "strf");
+    put_le32(fh, 40 + info->extradata_size);
+    put_le32(fh, info->width);
+    put_le32(fh, info->height);
+    put_le16(fh, 1);                // planes
+    put_le16(fh, info->bit_count);
+    put_tag(fh, info->fourcc);
+    put_le32(fh, (uint32_t)((uint64_t)info->width * info->height * info->bit_count / 8));
+    put_zeros(fh, 16);
+    fwrite(info->extradata, 1, info->extradata_size, fh);
+    end_tag(fh, strf);
+
+    /* room for the OpenDML super index, which only becomes one if the file outgrows the first RIFF */
+    h->indx = start_tag(fh, "JUNK");
+    put_zeros(fh, 24 + AVI_MASTER_INDEX_SIZE * 16);
+    end_tag(fh, h->indx);
+    end_tag(fh, strl);
+
+    int64_t odml = start_tag(fh, "LIST");
+    put_tag(fh, "odml");
+    int64_t dmlh = start_tag(fh, "dmlh");
+    h->dmlh_frames = ftello(fh);
+    put_zeros(fh, 248);
+    end_tag(fh, dmlh);
+    end_tag(fh, odml);
+    end_tag(fh, hdrl);
+
+    h->movi = start_tag(fh, "LIST");
+    put_tag(fh, "movi");
+    if(ferror(fh)) {
+        free(h);
+        return NULL;
+    }
+    return h;
+}
+
+/* the OpenDML standard index of the current RIFF's frames, listed in the super index */
+static int write_ix(avi_t *h)
+{
+    FILE *fh = h->fh;
+    if(h->ixs == AVI_MASTER_INDEX_SIZE)
+        return -1;
+    int64_t pos = ftello(fh);
+    int64_t ix = start_tag(fh, "ix00");
+    put_le16(fh, 2);                // longs per entry
+    fputc(0, fh);                   // sub type
+    fputc(AVI_INDEX_OF_CHUNKS, fh);
+    put_le32(fh, h->entries);
+    put_tag(fh, "00dc");
+    put_le64(fh, h->movi);          // base of the offsets
+    put_le32(fh, 0);
+    for(int i = 0; i < h->entries; i++) {
+        put_le32(fh, (uint32_t)(h->entry[i].pos + 8)); // to the data, keyframe flag (bit 31) clear
+        put_le32(fh, h->entry[i].size);
+    }
+    end_tag(fh, ix);
+    h->ix[h->ixs].pos = pos;
+    h->ix[h->ixs].size = (uint32_t)(ftello(fh) - pos);
+    h->ix[h->ixs].duration = h->entries;
+    h->ixs++;
+
+    int64_t cur = ftello(fh);
+    fseeko(fh, h->indx - 8, SEEK_SET);
+    put_tag(fh, "indx");
+    fseeko(fh, h->indx, SEEK_SET);
+    put_le16(fh, 4);                // longs per entry
+    fputc(0, fh);
+    fputc(AVI_INDEX_OF_INDEXES, fh);
+    put_le32(fh, h->ixs);
+    put_tag(fh, "00dc");
+    put_zeros(fh, 12);
+    for(int i = 0; i < h->ixs; i++) {
+        put_le64(fh, h->ix[i].pos);
+        put_le32(fh, h->ix[i].size);
+        put_le32(fh, h->ix[i].duration);
+    }
+    fseeko(fh, cur, SEEK_SET);
+    return 0;
+}
+
+/* the AVI 1.0 index of the first RIFF, offsets from the movi list */
+static void write_idx1(avi_t *h)
+{
+    FILE *fh = h->fh;
+    int64_t idx1 = start_tag(fh, "idx1");
+    for(int i = 0; i < h->entries; i++) {
+        put_tag(fh, "00dc");
+        put_le32(fh, AVIIF_KEYFRAME);
+        put_le32(fh, (uint32_t)h->entry[i].pos);
+        put_le32(fh, h->entry[i].size);
+    }
+    end_tag(fh, idx1);
+}
+
+/* ends the current RIFF, the first one with its idx1, and the OpenDML ones (or all of them once
+   there is more than one) with an ix00 */
+static int end_riff(avi_t *h, int last)
+{
+    if((h->riff_id > 1 || !last) && write_ix(h) < 0)
+        return -1;
+    end_tag(h->fh, h->movi);
+    if(h->riff_id == 1) {
+        write_idx1(h);
+        h->first_riff_frames = h->frames;
+    }
+    end_tag(h->fh, h->riff);
+    h->entries = 0;
+    return 0;
+}
+
+int avi_write_frame(avi_t *h, const uint8_t *data, size_t size)
+{
+    FILE *fh = h->fh;
+    int64_t pos = ftello(fh);
+    if(pos - h->riff > AVI_MAX_RIFF_SIZE) {
+        if(end_riff(h, 0) < 0)
+            return -1;
+        h->riff_id++;
+        h->riff = start_tag(fh, "RIFF");
+        put_tag(fh, "AVIX");
+        h->movi = start_tag(fh, "LIST");
+        put_tag(fh, "movi");
+        pos = ftello(fh);
+    }
+    if(h->entries == h->max_entries) {
+        int n = h->max_entries ? h->max_entries * 2 : 1024;
+        avi_entry_t *entry = realloc(h->entry, n * sizeof(avi_entry_t));
+        if(!entry)
+            return -1;
+        h->entry = entry;
+        h->max_entries = n;
+    }
+    h->entry[h->entries].pos = pos - h->movi;
+    h->entry[h->entries].size = (uint32_t)size;
+    h->entries++;
+    put_tag(fh, "00dc");
+    put_le32(fh, (uint32_t)size);
+    if(fwrite(data, 1, size, fh) != size)
+        return -1;
+    if(size & 1)
+        fputc(0, fh);
+    h->frames++;
+    if(size > h->max_size)
+        h->max_size = (uint32_t)size;
+    return ferror(fh) ? -1 : 0;
+}
+
+int avi_close(avi_t *h)
+{
+    FILE *fh = h->fh;
+    int ret = end_riff(h, 1);
+    patch_le32(fh, h->avih_frames, h->first_riff_frames);
+    patch_le32(fh, h->avih_buffer, h->max_size);
+    patch_le32(fh, h->strh_length, h->frames);
+    patch_le32(fh, h->strh_buffer, h->max_size);
+    patch_le32(fh, h->dmlh_frames, h->frames);
+    if(ferror(fh))
+        ret = -1;
+    free(h->entry);
+    free(h);
+    return ret;
+}
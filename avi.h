@@ -0,0 +1,36 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#ifndef AVS2YUV_AVI_H
+#define AVS2YUV_AVI_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* single video stream AVI writer. Files stay plain AVI with an idx1 index up to 1GB,
+   beyond that they go on in OpenDML AVIX RIFFs with ix00 and indx indexes.
+   The file must be seekable, as sizes and indexes are filled in as it goes */
+typedef struct avi_t avi_t;
+
+typedef struct
+{
+    int width, height;
+    unsigned fps_num, fps_den;
+    const char *fourcc;
+    int bit_count;
+    const uint8_t *extradata;
+    int extradata_size;
+} avi_info_t;
+
+/* writes the headers */
+avi_t *avi_create(FILE *fh, const avi_info_t *info);
+/* all frames are keyframes */
+int avi_write_frame(avi_t *h, const uint8_t *data, size_t size);
+/* writes the indexes, completes the headers and frees h */
+int avi_close(avi_t *h);
+
+#endif
@@ -11,7 +11,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <signal.h>
 #include "avs_internal.c"
+#include "common.h"
+#include "threads.h"
+#include "chroma.h"
+#include "output.h"
+#include "bench.h"
+#include "trace.h"
+#include "perf.h"
+#include "stats.h"
+#include "hash.h"
+#include "compare.h"
+#include "cpu.h"
+#include "pixel.h"
+#include "convert.h"
+#include "scale.h"
 
 #ifndef INT_MAX
 #define INT_MAX 0x7fffffff
@@ -25,30 +40,7 @@
 #include <strings.h>
 #endif
 
-#ifdef _WIN32
-#include <io.h>       /* _setmode() */
-#include <fcntl.h>    /* _O_BINARY */
-#define fileno _fileno
-#define dup _dup
-#define fdopen _fdopen
-#define popen _popen
-#define pclose _pclose
-#else
-#include <unistd.h>
-#endif
-
-#ifdef _WIN32
-#define HAVE_HFYU 1
-#endif
-
-#define MY_VERSION "Avs2YUV 0.24bm6"
-#define MAX_FH 10
-#define AVS_BUFSIZE (128*1024)
-#define CSP_AUTO (-1)
-#define CSP_I400 1
-#define CSP_I420 2
-#define CSP_I422 3
-#define CSP_I444 4
+#define MY_VERSION "Avs2YUV 0.24bm7"
 
 static int csp_to_int(const char *arg)
 {
@@ -65,6 +57,88 @@ static int csp_to_int(const char *arg)
     return 0;
 }
 
+/* whether the chroma subsampling of csp fits the frame size of what */
+static int csp_fits_size(const char *what, int csp, int width, int height, int interlaced)
+{
+    if(csp == CSP_I400)
+        return 1;
+    if(csp < CSP_I444 && (width&1)) {
+        fprintf(stderr, "error: %s width not divisible by 2 (%dx%d)\n", what, width, height);
+        return 0;
+    }
+    if(csp == CSP_I420 && interlaced && (height&3)) {
+        fprintf(stderr, "error: %s height not divisible by 4 (%dx%d)\n", what, width, height);
+        return 0;
+    }
+    if((csp == CSP_I420 || interlaced) && (height&1)) {
+        fprintf(stderr, "error: %s height not divisible by 2 (%dx%d)\n", what, width, height);
+        return 0;
+    }
+    return 1;
+}
+
+/* the outputs taking a frame, written in parallel on the worker threads */
+typedef struct
+{
+    int count;
+    output_t *out[MAX_FH];
+    picture_t pic[MAX_FH]; // views of the converted pictures, cropped
+    int ret[MAX_FH];
+    int64_t ns[MAX_FH];    // time taken, for -bench
+    int frame;
+} frame_writes_t;
+
+static void write_output(void *arg, int job)
+{
+    frame_writes_t *w = arg;
+    int64_t start = clock_ns();
+    w->ret[job] = output_write_frame(w->out[job], &w->pic[job]);
+    w->ns[job] = clock_ns() - start;
+    trace_span("write", w->out[job]->filename, w->frame, start);
+}
+
+/* outfiles identical to an earlier one, copied from it once it is complete */
+typedef struct
+{
+    int count;
+    output_t *out[MAX_FH];
+    const char *src[MAX_FH];
+    int ret[MAX_FH];
+} file_copies_t;
+
+static void copy_output(void *arg, int job)
+{
+    file_copies_t *c = arg;
+    int64_t start = trace_start();
+    c->ret[job] = output_copy(c->out[job], c->src[job]);
+    trace_span("copy", c->out[job]->filename, -1, start);
+}
+
+/* a frame of the clip and of the -compare reference, rendered in parallel */
+typedef struct
+{
+    avs_hnd_t *h[2];
+    AVS_VideoFrame *f[2];
+    int frame;
+} frame_fetch_t;
+
+static void fetch_frame(void *arg, int job)
+{
+    frame_fetch_t *fetch = arg;
+    int64_t start = trace_start();
+    fetch->f[job] = fetch->h[job]->func.avs_get_frame(fetch->h[job]->clip, fetch->frame);
+    trace_span("get_frame", job ? "reference" : NULL, fetch->frame, start);
+}
+
+/* ends a step of the startup begun at start (clock_ns), on the timeline and in the
+   -bench report */
+static void startup_step(bench_t *timings, const char *name, const char *detail, int64_t start)
+{
+    trace_span(name, detail, -1, start);
+    if(timings)
+        bench_phase(timings, name, detail, start);
+}
+
 #define AVS_IS_YV24( vi ) (avs_h.func.avs_is_yv24 ? avs_h.func.avs_is_yv24( vi ) : avs_is_yv24( vi ))
 #define AVS_IS_YV16( vi ) (avs_h.func.avs_is_yv16 ? avs_h.func.avs_is_yv16( vi ) : avs_is_yv16( vi ))
 #define AVS_IS_YV12( vi ) (avs_h.func.avs_is_yv12 ? avs_h.func.avs_is_yv12( vi ) : avs_is_yv12( vi ))
@@ -78,37 +152,152 @@ static int csp_to_int(const char *arg)
 #define AVS_IS_444( vi ) (avs_h.func.avs_is_444 ? avs_h.func.avs_is_444( vi ) : AVS_IS_YV24( vi ))
 #define AVS_IS_Y( vi ) (avs_h.func.avs_is_y ? avs_h.func.avs_is_y( vi ) : AVS_IS_Y8( vi ))
 
+#define AVS_FUNCTION_EXISTS( name ) (avs_h.func.avs_function_exists ? avs_h.func.avs_function_exists( avs_h.env, name ) : 1)
+
 #define AVS_COMPONENT_SIZE( vi ) (avs_h.func.avs_component_size ? avs_h.func.avs_component_size( vi ) : 1)
 #define AVS_BITS_PER_COMPONENT( vi ) (avs_h.func.avs_bits_per_component ? avs_h.func.avs_bits_per_component( vi ) : 8)
+#define AVS_IS_YUVA( vi ) (avs_h.func.avs_is_yuva ? avs_h.func.avs_is_yuva( vi ) : 0)
+
+/* the levels of cpu.h among AviSynth's CPU flags, each only along with those below it */
+static int avs_cpu_levels(int flags)
+{
+    static const int avs[CPU_LEVELS] = {
+        AVS_CPU_SSE2, AVS_CPUF_SSSE3, AVS_CPUF_SSE4_2, AVS_CPUF_AVX2,
+        AVS_CPUF_AVX512F | AVS_CPUF_AVX512BW | AVS_CPUF_AVX512VL
+    };
+    int cpu = 0;
+    for(int i = 0; i < CPU_LEVELS && (flags & avs[i]) == avs[i]; i++)
+        cpu |= 1 << i;
+    return cpu;
+}
 
 int main(int argc, const char* argv[])
 {
     const char* infile = NULL;
     const char* hfyufile = NULL;
     const char* outfile[MAX_FH] = {NULL};
-    int         y4m_headers[MAX_FH] = {0};
-    FILE* out_fh[10] = {NULL};
+    char       *out_name[MAX_FH] = {NULL}; // names made for ladder rungs and tiles
+    int         out_pipe[MAX_FH] = {0};    // outfile is an encoder's command line
+    int         out_copy[MAX_FH] = {0};    // 1 + the outfile this one is copied from, 0 = none
+    output_opt_t out_opt[MAX_FH];
+    int         out_stage[MAX_FH] = {0};
+    output_t    out[MAX_FH] = {{0}};
     int out_fhs = 0;
     int verbose = 0;
+    int bench = 0;
+    int perf_counters = 0;
+    const char *trace_file = NULL;
+    const char *stats_file = NULL;
+    const char *hash_file = NULL;
+    const char *golden_file = NULL;
+    const char *compare_file = NULL;
+    const char *compare_log = NULL;
+    int stats_interval = 1000;
+    int cpu_limit = -1; // -cpu, -1 = all the CPU has
+    int selftest = 0;
+    int resume = 0;
+    int checkpoint = -1; // seconds, -1 = 60 with -resume, otherwise none
     int usage = 0;
     int seek = 0;
     int end = 0;
     int slave = 0;
-    int rawyuv = 0;
+    output_opt_t opt; // applies to the outfiles that follow
+    int alpha_only = 0;
+    int pipe_out = 0;
+    int ladder[MAX_FH]; // heights the next outfile is written at
+    int ladder_rungs = 0;
+    int tiles_x = 0, tiles_y = 0; // grid the next outfile is split into
+    int split_planes = 0; // the next outfile is written as a raw file per plane
+    int need_alpha = 0;
     int no_mt = 0;
     int interlaced = 0;
     int tff = 0;
     int csp = CSP_I420;
+    int chroma_filter = CHROMA_FILTER_BICUBIC;
+    int chroma_loc = -1;
+    int scale_filter = SCALE_FILTER_SPLINE36;
+    int threads = 0;
     int input_depth = 8;
     unsigned fps_num = 0;
     unsigned fps_den = 0;
     unsigned par_width = 0;
     unsigned par_height = 0;
 
+    output_opt_default(&opt);
     for(int i = 1; i < argc; i++) {
         if(argv[i][0] == '-' && argv[i][1] != 0) {
             if(!strcmp(argv[i], "-v"))
                 verbose = 1;
+            else if(!strcmp(argv[i], "-bench"))
+                bench = 1;
+            else if(!strcmp(argv[i], "-perf"))
+                perf_counters = 1;
+            else if(!strcmp(argv[i], "-cpu")) {
+                if(i > argc-2) {
+                    fprintf(stderr, "-cpu needs an argument\n");
+                    return 2;
+                }
+                cpu_limit = cpu_from_name(argv[++i]);
+                if(cpu_limit < 0) {
+                    fprintf(stderr, "-cpu \"%s\" is invalid\n", argv[i]);
+                    return 2;
+                }
+            }
+            else if(!strcmp(argv[i], "-selftest"))
+                selftest = 1;
+            else if(!strcmp(argv[i], "-trace")) {
+                if(i > argc-2) {
+                    fprintf(stderr, "-trace needs an argument\n");
+                    return 2;
+                }
+                trace_file = argv[++i];
+            }
+            else if(!strcmp(argv[i], "-stats")) {
+                if(i > argc-2) {
+                    fprintf(stderr, "-stats needs an argument\n");
+                    return 2;
+                }
+                stats_file = argv[++i];
+            }
+            else if(!strcmp(argv[i], "-stats-interval")) {
+                if(i > argc-2) {
+                    fprintf(stderr, "-stats-interval needs an argument\n");
+                    return 2;
+                }
+                stats_interval = atoi(argv[++i]);
+                if(stats_interval <= 0) {
+                    fprintf(stderr, "-stats-interval \"%s\" is invalid\n", argv[i]);
+                    return 2;
+                }
+            }
+            else if(!strcmp(argv[i], "-hash")) {
+                if(i > argc-2) {
+                    fprintf(stderr, "-hash needs an argument\n");
+                    return 2;
+                }
+                hash_file = argv[++i];
+            }
+            else if(!strcmp(argv[i], "-hash-compare")) {
+                if(i > argc-2) {
+                    fprintf(stderr, "-hash-compare needs an argument\n");
+                    return 2;
+                }
+                golden_file = argv[++i];
+            }
+            else if(!strcmp(argv[i], "-compare")) {
+                if(i > argc-2) {
+                    fprintf(stderr, "-compare needs an argument\n");
+                    return 2;
+                }
+                compare_file = argv[++i];
+            }
+            else if(!strcmp(argv[i], "-compare-log")) {
+                if(i > argc-2) {
+                    fprintf(stderr, "-compare-log needs an argument\n");
+                    return 2;
+                }
+                compare_log = argv[++i];
+            }
             else if(!strcmp(argv[i], "-h"))
                 usage = 1;
             else if(!strcmp(argv[i], "-o")) {
@@ -131,18 +320,199 @@ int main(int argc, const char* argv[])
                     return 2;
                 }
                 end = atoi(argv[++i]);
-#if HAVE_HFYU
             } else if(!strcmp(argv[i], "-hfyu")) {
                 if(i > argc-2) {
                     fprintf(stderr, "-hfyu needs an argument\n");
                     return 2;
                 }
                 hfyufile = argv[++i];
-#endif
+            } else if(!strcmp(argv[i], "-pipe")) {
+                if(i > argc-2) {
+                    fprintf(stderr, "-pipe needs an argument\n");
+                    return 2;
+                }
+                i++;
+                pipe_out = 1;
+                goto add_outfile;
+            } else if(!strcmp(argv[i], "-pipe-buffer")) {
+                if(i > argc-2) {
+                    fprintf(stderr, "-pipe-buffer needs an argument\n");
+                    return 2;
+                }
+                opt.pipe_buffer = atoi(argv[++i]);
+                if(opt.pipe_buffer < 0) {
+                    fprintf(stderr, "-pipe-buffer \"%s\" is invalid\n", argv[i]);
+                    return 2;
+                }
+            } else if(!strcmp(argv[i], "-queue")) {
+                if(i > argc-2) {
+                    fprintf(stderr, "-queue needs an argument\n");
+                    return 2;
+                }
+                opt.queue = atoi(argv[++i]);
+                if(opt.queue < 0) {
+                    fprintf(stderr, "-queue \"%s\" is invalid\n", argv[i]);
+                    return 2;
+                }
+            } else if(!strcmp(argv[i], "-spill")) {
+                if(i > argc-2) {
+                    fprintf(stderr, "-spill needs an argument\n");
+                    return 2;
+                }
+                i++;
+                opt.spill = strcmp(argv[i], "none") ? argv[i] : NULL;
             } else if(!strcmp(argv[i], "-raw")) {
-                rawyuv = 1;
+                opt.format = OUTPUT_RAW;
+                opt.format_depth = 0;
+            } else if(!strcmp(argv[i], "-align")) {
+                if(i > argc-2) {
+                    fprintf(stderr, "-align needs an argument\n");
+                    return 2;
+                }
+                opt.align = atoi(argv[++i]);
+                if(opt.align < 0 || opt.align > OUTPUT_MAX_ALIGN || (opt.align & (opt.align-1))) {
+                    fprintf(stderr, "-align \"%s\" is not a power of 2 up to %d\n", argv[i], OUTPUT_MAX_ALIGN);
+                    return 2;
+                }
+            } else if(!strcmp(argv[i], "-alpha")) {
+                opt.alpha = OUTPUT_ALPHA_PLANE;
+            } else if(!strcmp(argv[i], "-alpha-o")) {
+                if(i > argc-2) {
+                    fprintf(stderr, "-alpha-o needs an argument\n");
+                    return 2;
+                }
+                i++;
+                alpha_only = 1;
+                goto add_outfile;
+            } else if(!strcmp(argv[i], "-format")) {
+                if(i > argc-2) {
+                    fprintf(stderr, "-format needs an argument\n");
+                    return 2;
+                }
+                if(output_format_from_name(argv[++i], &opt.format, &opt.format_depth) < 0) {
+                    fprintf(stderr, "-format \"%s\" is unknown\n", argv[i]);
+                    return 2;
+                }
+            } else if(!strcmp(argv[i], "-ocsp")) {
+                if(i > argc-2) {
+                    fprintf(stderr, "-ocsp needs an argument\n");
+                    return 2;
+                }
+                opt.csp = csp_to_int(argv[++i]);
+                if(!opt.csp) {
+                    fprintf(stderr, "-ocsp \"%s\" is unknown\n", argv[i]);
+                    return 2;
+                }
+            } else if(!strcmp(argv[i], "-odepth")) {
+                if(i > argc-2) {
+                    fprintf(stderr, "-odepth needs an argument\n");
+                    return 2;
+                }
+                opt.depth = atoi(argv[++i]);
+                if(opt.depth && (opt.depth < 8 || opt.depth > 16)) {
+                    fprintf(stderr, "-odepth \"%s\" is not supported\n", argv[i]);
+                    return 2;
+                }
+            } else if(!strcmp(argv[i], "-step")) {
+                if(i > argc-2) {
+                    fprintf(stderr, "-step needs an argument\n");
+                    return 2;
+                }
+                opt.step = atoi(argv[++i]);
+                if(opt.step < 1) {
+                    fprintf(stderr, "-step \"%s\" is not supported\n", argv[i]);
+                    return 2;
+                }
+            } else if(!strcmp(argv[i], "-range")) {
+                if(i > argc-2) {
+                    fprintf(stderr, "-range needs an argument\n");
+                    return 2;
+                }
+                if(output_range_from_string(argv[++i], &opt.first, &opt.last) < 0) {
+                    fprintf(stderr, "-range \"%s\" is not a first-last frame range\n", argv[i]);
+                    return 2;
+                }
+            } else if(!strcmp(argv[i], "-crop")) {
+                if(i > argc-2) {
+                    fprintf(stderr, "-crop needs an argument\n");
+                    return 2;
+                }
+                if(output_crop_from_string(argv[++i], &opt.crop_width, &opt.crop_height, &opt.crop_x, &opt.crop_y) < 0) {
+                    fprintf(stderr, "-crop \"%s\" is not a width:height:x:y rectangle\n", argv[i]);
+                    return 2;
+                }
+            } else if(!strcmp(argv[i], "-fields")) {
+                if(i > argc-2) {
+                    fprintf(stderr, "-fields needs an argument\n");
+                    return 2;
+                }
+                opt.fields = output_fields_from_name(argv[++i]);
+                if(opt.fields < 0) {
+                    fprintf(stderr, "-fields \"%s\" is unknown\n", argv[i]);
+                    return 2;
+                }
+            } else if(!strcmp(argv[i], "-ladder")) {
+                if(i > argc-2) {
+                    fprintf(stderr, "-ladder needs an argument\n");
+                    return 2;
+                }
+                const char *str = argv[++i];
+                char *str_end;
+                ladder_rungs = 0;
+                do {
+                    int rung = strtol(str, &str_end, 10);
+                    if(str_end == str || rung < 2 || ladder_rungs == MAX_FH) {
+                        ladder_rungs = 0;
+                        break;
+                    }
+                    /* tallest first, so that each rung is scaled from the one above it */
+                    int r = ladder_rungs++;
+                    for(; r > 0 && ladder[r-1] < rung; r--)
+                        ladder[r] = ladder[r-1];
+                    ladder[r] = rung;
+                    str = str_end + 1;
+                } while(*str_end == '/');
+                if(!ladder_rungs || *str_end) {
+                    fprintf(stderr, "-ladder \"%s\" is not a list of heights like 1080/720/540\n", argv[i]);
+                    return 2;
+                }
+            } else if(!strcmp(argv[i], "-tiles")) {
+                if(i > argc-2) {
+                    fprintf(stderr, "-tiles needs an argument\n");
+                    return 2;
+                }
+                char c;
+                if(sscanf(argv[++i], "%dx%d%c", &tiles_x, &tiles_y, &c) != 2 ||
+                   tiles_x < 1 || tiles_y < 1 || tiles_x * tiles_y > MAX_FH) {
+                    fprintf(stderr, "-tiles \"%s\" is not a columns x rows grid like 4x2\n", argv[i]);
+                    return 2;
+                }
+            } else if(!strcmp(argv[i], "-planes")) {
+                split_planes = 1;
+            } else if(!strcmp(argv[i], "-scale-filter")) {
+                if(i > argc-2) {
+                    fprintf(stderr, "-scale-filter needs an argument\n");
+                    return 2;
+                }
+                scale_filter = scale_filter_from_name(argv[++i]);
+                if(scale_filter < 0) {
+                    fprintf(stderr, "-scale-filter \"%s\" is unknown\n", argv[i]);
+                    return 2;
+                }
             } else if(!strcmp(argv[i], "-slave")) {
                 slave = 1;
+            } else if(!strcmp(argv[i], "-resume")) {
+                resume = 1;
+            } else if(!strcmp(argv[i], "-checkpoint")) {
+                if(i > argc-2) {
+                    fprintf(stderr, "-checkpoint needs an argument\n");
+                    return 2;
+                }
+                checkpoint = atoi(argv[++i]);
+                if(checkpoint < 0) {
+                    fprintf(stderr, "-checkpoint \"%s\" is invalid\n", argv[i]);
+                    return 2;
+                }
             } else if(!strcmp(argv[i], "-no-mt")) {
                 no_mt = 1;
             } else if(!strcmp(argv[i], "-csp")) {
@@ -155,6 +525,36 @@ int main(int argc, const char* argv[])
                     fprintf(stderr, "-csp \"%s\" is unknown\n", argv[i]);
                     return 2;
                 }
+            } else if(!strcmp(argv[i], "-chroma-filter")) {
+                if(i > argc-2) {
+                    fprintf(stderr, "-chroma-filter needs an argument\n");
+                    return 2;
+                }
+                chroma_filter = chroma_filter_from_name(argv[++i]);
+                if(chroma_filter < 0) {
+                    fprintf(stderr, "-chroma-filter \"%s\" is unknown\n", argv[i]);
+                    return 2;
+                }
+            } else if(!strcmp(argv[i], "-chroma-loc")) {
+                if(i > argc-2) {
+                    fprintf(stderr, "-chroma-loc needs an argument\n");
+                    return 2;
+                }
+                chroma_loc = chroma_loc_from_name(argv[++i]);
+                if(chroma_loc < 0) {
+                    fprintf(stderr, "-chroma-loc \"%s\" is unknown\n", argv[i]);
+                    return 2;
+                }
+            } else if(!strcmp(argv[i], "-threads")) {
+                if(i > argc-2) {
+                    fprintf(stderr, "-threads needs an argument\n");
+                    return 2;
+                }
+                threads = atoi(argv[++i]);
+                if(threads < 1) {
+                    fprintf(stderr, "-threads \"%s\" is not supported\n", argv[i]);
+                    return 2;
+                }
             } else if(!strcmp(argv[i], "-depth")) {
                 if(i > argc-2) {
                     fprintf(stderr, "-depth needs an argument\n");
@@ -211,50 +611,226 @@ int main(int argc, const char* argv[])
                 fprintf(stderr, "infile \"%s\" doesn't look like an avisynth script\n", infile);
         } else {
 add_outfile:
-            if(out_fhs > MAX_FH-1) {
-                fprintf(stderr, "too many output files\n");
+            if(!!ladder_rungs + !!tiles_x + split_planes > 1) {
+                fprintf(stderr, "only one of -ladder, -tiles and -planes can be used for an outfile\n");
                 return 2;
             }
-            outfile[out_fhs] = argv[i];
-            y4m_headers[out_fhs] = !rawyuv;
-            out_fhs++;
+            int files = ladder_rungs ? ladder_rungs : tiles_x ? tiles_x * tiles_y : 1;
+            if(split_planes)
+                files = opt.alpha != OUTPUT_ALPHA_NONE ? 4 : 3;
+            for(int r = 0; r < files; r++) {
+                if(out_fhs > MAX_FH-1) {
+                    fprintf(stderr, "too many output files\n");
+                    return 2;
+                }
+                outfile[out_fhs] = argv[i];
+                out_opt[out_fhs] = opt;
+                if(ladder_rungs || tiles_x) {
+                    /* one file per rung or tile, %d being replaced by its height or number */
+                    const char *pos = strstr(argv[i], "%d");
+                    if(!pos) {
+                        fprintf(stderr, "%s needs %%d in the outfile name: %s\n",
+                                ladder_rungs ? "-ladder" : "-tiles", argv[i]);
+                        return 2;
+                    }
+                    out_name[out_fhs] = malloc(strlen(argv[i]) + 16);
+                    if(!out_name[out_fhs]) {
+                        fprintf(stderr, "error: malloc failed\n");
+                        return 2;
+                    }
+                    sprintf(out_name[out_fhs], "%.*s%d%s", (int)(pos - argv[i]), argv[i],
+                            ladder_rungs ? ladder[r] : r, pos + 2);
+                    outfile[out_fhs] = out_name[out_fhs];
+                }
+                if(split_planes) {
+                    /* %c being replaced by y/u/v/a; each plane goes out on its own writer thread
+                       in a single write */
+                    const char *pos = strstr(argv[i], "%c");
+                    if(!pos) {
+                        fprintf(stderr, "-planes needs %%c in the outfile name: %s\n", argv[i]);
+                        return 2;
+                    }
+                    out_name[out_fhs] = malloc(strlen(argv[i]) + 1);
+                    if(!out_name[out_fhs]) {
+                        fprintf(stderr, "error: malloc failed\n");
+                        return 2;
+                    }
+                    sprintf(out_name[out_fhs], "%.*s%c%s", (int)(pos - argv[i]), argv[i], "yuva"[r], pos + 2);
+                    outfile[out_fhs] = out_name[out_fhs];
+                    out_opt[out_fhs].format = OUTPUT_RAW;
+                    out_opt[out_fhs].format_depth = 0;
+                    if(r < 3) {
+                        out_opt[out_fhs].plane = r + 1;
+                        out_opt[out_fhs].alpha = OUTPUT_ALPHA_NONE;
+                    } else
+                        out_opt[out_fhs].alpha = OUTPUT_ALPHA_ONLY;
+                    if(!out_opt[out_fhs].queue)
+                        out_opt[out_fhs].queue = 2;
+                }
+                if(ladder_rungs)
+                    out_opt[out_fhs].height = ladder[r];
+                if(tiles_x) {
+                    out_opt[out_fhs].tiles_x = tiles_x;
+                    out_opt[out_fhs].tiles_y = tiles_y;
+                    out_opt[out_fhs].tile_x = r % tiles_x;
+                    out_opt[out_fhs].tile_y = r / tiles_x;
+                }
+                if(alpha_only)
+                    out_opt[out_fhs].alpha = OUTPUT_ALPHA_ONLY;
+                out_pipe[out_fhs] = pipe_out;
+                need_alpha |= out_opt[out_fhs].alpha != OUTPUT_ALPHA_NONE;
+                out_fhs++;
+            }
+            alpha_only = 0;
+            pipe_out = 0;
+            ladder_rungs = 0;
+            tiles_x = tiles_y = 0;
+            split_planes = 0;
         }
     }
 
-    if(usage || !infile || (!out_fhs && !hfyufile && !verbose)) {
+    if(selftest && !usage) {
+        int cpu = cpu_detect();
+        if(cpu_limit >= 0)
+            cpu &= cpu_limit;
+        return pixel_selftest(stderr, cpu) < 0;
+    }
+
+    if(usage || !infile || (!out_fhs && !hfyufile && !verbose && !bench && !perf_counters && !stats_file &&
+                            !hash_file && !golden_file && !compare_file)) {
         fprintf(stderr, MY_VERSION "\n"
-#if HAVE_HFYU
         "Usage: avs2yuv [options] in.avs [-o out.y4m] [-o out2.y4m] [-hfyu out.avi]\n"
-#else
-        "Usage: avs2yuv [options] in.avs [-o out.y4m] [-o out2.y4m]\n"
-#endif
         "-v\tprint the frame number after processing each frame\n"
+        "-hash\twrite the CRC32C of each plane of each frame of the clip to a manifest\n"
+        "\t(\"-\" for stdout), pitch padding left out\n"
+        "-hash-compare\tcompare the CRCs of each frame to a manifest written by -hash\n"
+        "\tand report the first frame and plane which differs\n"
+        "-compare\tmeasure the PSNR and SSIM of each plane of the clip against the clip of\n"
+        "\tanother script, of the same size and colorspace, rendered alongside it\n"
+        "-compare-log\twrite the PSNR and SSIM of each frame to file (\"-\" for stdout)\n"
+        "-stats\tkeep progress in file as JSON, rewritten every -stats-interval ms\n"
+        "\t(default 1000): frames done, fps, ETA, RSS, each outfile's bytes and queue\n"
+        "-trace\twrite a timeline of loading, rendering, conversion and writes per thread\n"
+        "\tto file, in Chrome trace-event JSON (chrome://tracing, ui.perfetto.dev)\n"
+        "-bench\ttime the startup steps, rendering, conversion and each outfile's writes,\n"
+        "\tthen print the time to each outfile's first frame, throughput, p50/p95/p99\n"
+        "\tlatencies and what the run waited on the most\n"
+        "\t(-format null outfiles are converted but not written)\n"
+        "-perf\tcount cycles, instructions, LLC misses, context switches and page faults\n"
+        "\tof rendering, conversion and writes on all threads, in total and by frame\n"
+        "\tranges (Linux perf_event_open)\n"
+        "-cpu\tlimit the SIMD kernels to c/sse2/ssse3/sse4.2/avx2/avx512\n"
+        "\t(default: the best the CPU and AviSynth+'s SetMaxCPU allow)\n"
+        "-selftest\tcheck the SIMD kernels of each level the CPU has against C and exit\n"
         "-seek\tseek to the given frame number\n"
         "-frames\tstop after processing this many frames\n"
         "-slave\tread a list of frame numbers from stdin (one per line)\n"
+        "-resume\tkeep the whole frames the outfiles already have, as far as their checkpoints\n"
+        "\tvouch for them, cut off the rest and go on from the first frame missing; y4m, raw,\n"
+        "\tsemi-planar and packed files only, written with the same options, those without\n"
+        "\ta header only with their checkpoint\n"
+        "-checkpoint\tsync the outfiles to disk every n seconds and record the frames they hold\n"
+        "\tin out.ckpt for -resume (default 60 with -resume, otherwise 0 = none)\n"
         "-no-mt\tdisable detection of AviSynth MT which adds Distributor()\n"
         "-raw\toutput raw I400/I420/I422/I444 instead of yuv4mpeg\n"
+        "-align\tpad the rows of the following raw outfiles to a multiple of n bytes, 0 = none;\n"
+        "\tstrides and offsets go to out.raw.layout, the padding being zeros\n"
+        "-alpha\talso write the alpha plane of YUVA input after V to the following outfiles\n"
+        "-alpha-o\twrite only the alpha plane to file\n"
+        "-pipe\tfeed an outfile to an encoder started with the given command line, without\n"
+        "\ta shell unless it uses redirections, pipes or variables; its exit status is checked\n"
+        "-pipe-buffer\tpipe buffer of the following -pipe outfiles, in frames (Linux)\n"
+        "-queue\twrite the following outfiles on their own threads, with up to n frames\n"
+        "\twaiting in memory (default 0: written by the frame loop)\n"
+        "-spill\tlet the queue of the following outfiles overflow to a temp file in the\n"
+        "\tgiven directory rather than wait for a slow consumer, or \"none\" (not on Windows)\n"
+        "-format\toutput format of the following outfiles: y4m/raw/nv12/p010/p012/p016\n"
+        "\t/v210/uyvy/y210/ffvhuff/null (nv12 is semi-planar, MSB-aligned when above 8 bits;\n"
+        "\tv210/uyvy/y210 are packed 4:2:2; ffvhuff is lossless AVI; null writes nothing)\n"
+        "-ocsp\tcolorspace of the following outfiles, chroma decimated from the clip's (default -csp)\n"
+        "-odepth\tbit depth of the following outfiles (default: the clip's)\n"
+        "-step\twrite every n-th frame to the following outfiles\n"
+        "-range\twrite frames first-last to the following outfiles (either may be omitted)\n"
+        "-crop\tcrop the following outfiles to width:height:x:y, 0 width/height meaning\n"
+        "\tup to the edge (default 0:0:0:0)\n"
+        "-fields\twrite the following outfiles as separated fields: both (one after the other,\n"
+        "\tin the clip's field order), top, bottom or none (default)\n"
+        "-ladder\twrite the next outfile at each of the heights h1/h2/..., scaled keeping\n"
+        "\tthe aspect ratio; %%d in its name is replaced by the height\n"
         "-csp\tconvert to I400/I420/I422/I444 or AUTO colorspace (default I420)\n"
+        "-chroma-filter\tkernel for chroma downsampling: point/box/bilinear/bicubic,\n"
+        "\tor avs to leave it to AviSynth's ConvertTo (default bicubic)\n"
+        "-chroma-loc\tchroma siting of downsampled output: mpeg2/center (default mpeg2)\n"
+        "-tiles\tsplit the next outfile into a grid of columns x rows tiles, each written to\n"
+        "\tits own file; %%d in its name is replaced by the tile number, row by row\n"
+        "-planes\twrite the next outfile as raw planes, a file each with %%c in its name\n"
+        "\treplaced by y/u/v (and a with -alpha), each written on its own thread\n"
+        "-scale-filter\tkernel for -ladder scaling: bilinear/bicubic/spline36/lanczos\n"
+        "\t(default spline36)\n"
+        "-threads\tnumber of worker threads (default: number of CPUs)\n"
         "-depth\tspecify input bit depth (default 8)\n"
         "-fps\toverwrite input framerate\n"
         "-par\tspecify pixel aspect ratio\n"
         "The outfile may be \"-\", meaning stdout.\n"
         "Output format is yuv4mpeg, as used by MPlayer, FFmpeg, Libav, x264, mjpegtools.\n"
-#if HAVE_HFYU
-        "Huffyuv output requires ffmpeg, and probably doesn't work in Wine.\n"
-#endif
+        "-hfyu writes the clip as lossless FFVHuff (HuffYUV) AVI, 8-bit 4:2:0 or 4:2:2.\n"
         );
         return 2;
     }
 
     int retval = 1;
     avs_hnd_t avs_h = {0};
+    threadpool_t *pool = NULL;
+    convert_t *convert = NULL;
+    bench_t *timings = NULL;
+    stats_t *stats = NULL;
+    hash_t *hash = NULL;
+    AVS_VideoFrame **hash_held = NULL; // frames of the batch being hashed
+    int hash_held_count = 0;
+    avs_hnd_t ref_h = {0}; // the -compare reference
+    compare_t *compare = NULL;
+    if(trace_file && trace_open(trace_file) < 0)
+        goto fail;
+    /* a file listed twice is written once, a copy of it would be truncated under the render */
+    for(int i = 0; i < out_fhs; i++) {
+        if(out_pipe[i] || !strcmp(outfile[i], "-") || out_opt[i].format == OUTPUT_NULL)
+            continue;
+        for(int j = 0; j < i; j++) {
+            if(out_pipe[j] || out_opt[j].format == OUTPUT_NULL || !output_same_file(outfile[i], outfile[j]))
+                continue;
+            if(!output_same_stream(&out_opt[i], &out_opt[j])) {
+                fprintf(stderr, "error: \"%s\" is listed twice with different settings\n", outfile[i]);
+                goto fail;
+            }
+            fprintf(stderr, "\"%s\" is the same file as \"%s\", it is written once\n", outfile[i], outfile[j]);
+            free(out_name[i]);
+            out_fhs--;
+            memmove(&outfile[i], &outfile[i+1], (out_fhs - i) * sizeof(*outfile));
+            memmove(&out_name[i], &out_name[i+1], (out_fhs - i) * sizeof(*out_name));
+            memmove(&out_pipe[i], &out_pipe[i+1], (out_fhs - i) * sizeof(*out_pipe));
+            memmove(&out_opt[i], &out_opt[i+1], (out_fhs - i) * sizeof(*out_opt));
+            out_name[out_fhs] = NULL;
+            i--;
+            break;
+        }
+    }
+    if(bench) {
+        timings = bench_create(out_fhs);
+        if(!timings) {
+            fprintf(stderr, "error: malloc failed\n");
+            goto fail;
+        }
+    }
+    int64_t ts = clock_ns();
     if(internal_avs_load_library(&avs_h) < 0) {
         fprintf(stderr, "error: failed to load avisynth.dll\n");
         goto fail;
     }
+    startup_step(timings, "load library", NULL, ts);
 
+    ts = clock_ns();
     avs_h.env = avs_h.func.avs_create_script_environment(AVS_INTERFACE_25);
+    startup_step(timings, "create script environment", NULL, ts);
     if(avs_h.func.avs_get_error) {
         const char *error = avs_h.func.avs_get_error(avs_h.env);
         if(error) {
@@ -264,12 +840,17 @@ add_outfile:
     }
 
     AVS_Value arg = avs_new_value_string(infile);
+    ts = clock_ns();
     AVS_Value res = avs_h.func.avs_invoke(avs_h.env, "Import", arg, NULL);
+    startup_step(timings, "Import", infile, ts);
     if(avs_is_error(res)) {
         fprintf(stderr, "error: %s\n", avs_as_error(res));
         goto fail;
     }
-    if(!no_mt) {
+    /* only AviSynth 2.6 MT has GetMTMode; asking anything else for it costs a failed
+       function lookup */
+    ts = clock_ns();
+    if(!no_mt && AVS_FUNCTION_EXISTS("GetMTMode")) {
         /* check if the user is using a multi-threaded script and apply distributor if necessary.
            adapted from avisynth's vfw interface */
         AVS_Value mt_test = avs_h.func.avs_invoke(avs_h.env, "GetMTMode", avs_new_value_bool(0), NULL);
@@ -280,7 +861,21 @@ add_outfile:
             avs_h.func.avs_release_value(res);
             res = temp;
         }
+        startup_step(timings, "MT detection", NULL, ts);
+    }
+    /* the kernels for what both the CPU and AviSynth+, which may have been limited by the
+       script's SetMaxCPU, support; AviSynth 2.6 doesn't know of AVX2 and later */
+    int cpu = cpu_detect();
+    if(AVS_IS_AVISYNTHPLUS && avs_h.func.avs_get_cpu_flags)
+        cpu &= avs_cpu_levels(avs_h.func.avs_get_cpu_flags(avs_h.env));
+    if(cpu_limit >= 0) {
+        if(cpu_limit & ~cpu)
+            fprintf(stderr, "-cpu %s isn't available, using %s\n", cpu_name(cpu_limit), cpu_name(cpu & cpu_limit));
+        cpu &= cpu_limit;
     }
+    cpu_set(cpu);
+    if(cpu_limit >= 0 || bench)
+        fprintf(stderr, "SIMD kernels: %s\n", cpu_name(cpu));
     if(!avs_is_clip(res)) {
         fprintf(stderr, "error: \"%s\" didn't return a video clip\n", infile);
         goto fail;
@@ -294,7 +889,9 @@ add_outfile:
     /* if the clip is made of fields instead of frames, call weave to make them frames */
     if(avs_is_field_based(inf)) {
         fprintf(stderr, "detected fieldbased (separated) input, weaving to frames\n");
+        ts = clock_ns();
         AVS_Value tmp = avs_h.func.avs_invoke(avs_h.env, "Weave", res, NULL);
+        startup_step(timings, "Weave", NULL, ts);
         if(avs_is_error(tmp)) {
             fprintf(stderr, "error: couldn't weave fields into frames: %s\n", avs_as_error(tmp));
             goto fail;
@@ -325,8 +922,28 @@ add_outfile:
         fps_den = inf->fps_denominator;
     }
 
-    AVS_Value pixel_type = avs_h.func.avs_invoke(avs_h.env, "PixelType", res, NULL);
-    const char *pixel_type_name = avs_is_string(pixel_type) ? avs_as_string(pixel_type) : "unknown";
+    /* planar YUV is named here as PixelType would, only other colorspaces are looked up */
+    char pixel_type_buf[16];
+    const char *pixel_type_name = pixel_type_buf;
+    if(AVS_IS_Y(inf) && bits_per_component <= 16)
+        snprintf(pixel_type_buf, sizeof(pixel_type_buf), "Y%d", bits_per_component);
+    else if((AVS_IS_420(inf) || AVS_IS_422(inf) || AVS_IS_444(inf)) && bits_per_component <= 16) {
+        const char *sub = AVS_IS_420(inf) ? "420" : AVS_IS_422(inf) ? "422" : "444";
+        if(AVS_IS_YUVA(inf))
+            snprintf(pixel_type_buf, sizeof(pixel_type_buf), "YUVA%s", sub);
+        else if(bits_per_component == 8)
+            snprintf(pixel_type_buf, sizeof(pixel_type_buf), "YV%s", AVS_IS_420(inf) ? "12" : AVS_IS_422(inf) ? "16" : "24");
+        else
+            snprintf(pixel_type_buf, sizeof(pixel_type_buf), "YUV%s", sub);
+        if(bits_per_component > 8)
+            snprintf(pixel_type_buf + strlen(pixel_type_buf), sizeof(pixel_type_buf) - strlen(pixel_type_buf),
+                     "P%d", bits_per_component);
+    } else {
+        ts = clock_ns();
+        AVS_Value pixel_type = avs_h.func.avs_invoke(avs_h.env, "PixelType", res, NULL);
+        startup_step(timings, "PixelType", NULL, ts);
+        pixel_type_name = avs_is_string(pixel_type) ? avs_as_string(pixel_type) : "unknown";
+    }
 
     fprintf(stderr, "%s: %dx%d, %s, %d-bits, %s, ",
             infile, input_width, input_height, pixel_type_name, input_depth,
@@ -350,15 +967,35 @@ add_outfile:
             csp = CSP_I420; // not supported colorspaces (like RGB) we try convert to I420
     }
 
-    if( (csp == CSP_I420 && !AVS_IS_420(inf)) ||
-        (csp == CSP_I422 && !AVS_IS_422(inf)) ||
-        (csp == CSP_I444 && !AVS_IS_444(inf)) ||
-        (csp == CSP_I400 && !AVS_IS_Y(inf)) )
-    {
+    /* chroma decimation of planar YUV is done by us, on our own threads,
+       instead of in AviSynth's filter graph */
+    int src_csp = AVS_IS_444(inf) ? CSP_I444 :
+                  AVS_IS_422(inf) ? CSP_I422 :
+                  AVS_IS_420(inf) ? CSP_I420 :
+                  AVS_IS_Y(inf) ? CSP_I400 : 0;
+    int native_csp = 0;
+    int convert_csp = (csp == CSP_I420 && !AVS_IS_420(inf)) ||
+                      (csp == CSP_I422 && !AVS_IS_422(inf)) ||
+                      (csp == CSP_I444 && !AVS_IS_444(inf)) ||
+                      (csp == CSP_I400 && !AVS_IS_Y(inf));
+    if(convert_csp) {
         if(is_16bit_hack) {
             fprintf(stderr, "error: colorspace conversion is not possible with avisynth 16-bit hack\n");
             goto fail;
         }
+        if(!csp_fits_size("input clip", csp, inf->width, inf->height, interlaced))
+            goto fail;
+        native_csp = chroma_filter != CHROMA_FILTER_AVS && src_csp > csp && bits_per_component <= 16;
+    }
+    if(native_csp) {
+        static const char * const csp_names[] = {NULL, "I400", "I420", "I422", "I444"};
+        static const char * const filter_names[] = {NULL, "point", "box", "bilinear", "bicubic"};
+        if(csp == CSP_I400)
+            fprintf(stderr, "converting input clip to %s\n", csp_names[csp]);
+        else
+            fprintf(stderr, "converting input clip to %s (%s, %s chroma)\n", csp_names[csp],
+                    filter_names[chroma_filter], chroma_loc == CHROMA_LOC_CENTER ? "center" : "mpeg2");
+    } else if(convert_csp) {
         const char *csp_name;
         if(AVS_IS_AVISYNTHPLUS) {
             csp_name = csp == CSP_I400 ? "Y" :
@@ -372,25 +1009,11 @@ add_outfile:
                        "YV12";
         }
         fprintf(stderr, "converting input clip to %s\n", csp_name);
-        if(csp != CSP_I400) {
-            if(csp < CSP_I444 && (inf->width&1)) {
-                fprintf(stderr, "error: input clip width not divisible by 2 (%dx%d)\n", inf->width, inf->height);
-                goto fail;
-            }
-            if(csp == CSP_I420 && interlaced && (inf->height&3)) {
-                fprintf(stderr, "error: input clip height not divisible by 4 (%dx%d)\n", inf->width, inf->height);
-                goto fail;
-            }
-            if((csp == CSP_I420 || interlaced) && (inf->height&1)) {
-                fprintf(stderr, "error: input clip height not divisible by 2 (%dx%d)\n", inf->width, inf->height);
-                goto fail;
-            }
-        }
         char conv_func[16];
         snprintf(conv_func, sizeof(conv_func), "ConvertTo%s", csp_name);
         conv_func[sizeof(conv_func)-1] = 0;
-        AVS_Value arg_arr[2];
-        const char *arg_name[2];
+        AVS_Value arg_arr[3];
+        const char *arg_name[3];
         int arg_count = 1;
         arg_arr[0] = res;
         arg_name[0] = NULL;
@@ -399,7 +1022,14 @@ add_outfile:
             arg_name[arg_count] = "interlaced";
             arg_count++;
         }
+        if(csp == CSP_I420 && chroma_loc == CHROMA_LOC_CENTER) {
+            arg_arr[arg_count] = avs_new_value_string("MPEG1");
+            arg_name[arg_count] = "ChromaOutPlacement";
+            arg_count++;
+        }
+        ts = clock_ns();
         AVS_Value tmp = avs_h.func.avs_invoke(avs_h.env, conv_func, avs_new_value_array(arg_arr, arg_count), arg_name);
+        startup_step(timings, "ConvertTo", csp_name, ts);
         if(avs_is_error(tmp)) {
             fprintf(stderr, "error: couldn't convert input clip to %s: %s\n", csp_name, avs_as_error(tmp));
             goto fail;
@@ -408,101 +1038,110 @@ add_outfile:
     }
     avs_h.func.avs_release_value(res);
 
+    if(compare_file) {
+        /* the reference gets a script environment of its own, the library is shared */
+        ref_h = avs_h;
+        ref_h.library = NULL;
+        ref_h.clip = NULL;
+        ts = clock_ns();
+        ref_h.env = avs_h.func.avs_create_script_environment(AVS_INTERFACE_25);
+        AVS_Value ref_res = avs_h.func.avs_invoke(ref_h.env, "Import", avs_new_value_string(compare_file), NULL);
+        startup_step(timings, "Import", compare_file, ts);
+        if(avs_is_error(ref_res)) {
+            fprintf(stderr, "error: %s\n", avs_as_error(ref_res));
+            goto fail;
+        }
+        if(!avs_is_clip(ref_res)) {
+            fprintf(stderr, "error: \"%s\" didn't return a video clip\n", compare_file);
+            goto fail;
+        }
+        ref_h.clip = avs_h.func.avs_take_clip(ref_res, ref_h.env);
+        const AVS_VideoInfo *ref_inf = avs_h.func.avs_get_video_info(ref_h.clip);
+        if(avs_has_video(ref_inf) && avs_is_field_based(ref_inf)) {
+            AVS_Value tmp = avs_h.func.avs_invoke(ref_h.env, "Weave", ref_res, NULL);
+            if(avs_is_error(tmp)) {
+                fprintf(stderr, "error: couldn't weave fields into frames: %s\n", avs_as_error(tmp));
+                goto fail;
+            }
+            ref_res = internal_avs_update_clip(&ref_h, &ref_inf, tmp, ref_res);
+        }
+        avs_h.func.avs_release_value(ref_res);
+        if(!avs_has_video(ref_inf) || ref_inf->width != inf->width || ref_inf->height != inf->height ||
+           ref_inf->pixel_type != inf->pixel_type) {
+            fprintf(stderr, "error: \"%s\" doesn't have the size and colorspace of the clip\n", compare_file);
+            goto fail;
+        }
+        if(ref_inf->num_frames < inf->num_frames)
+            fprintf(stderr, "\"%s\" has %d frames, comparing up to there\n", compare_file, ref_inf->num_frames);
+    }
+
+    if(need_alpha && !AVS_IS_YUVA(inf)) {
+        fprintf(stderr, "error: input clip has no alpha plane (%s)\n", pixel_type_name);
+        goto fail;
+    }
+
+    if(resume && slave) {
+        fprintf(stderr, "error: -resume can't be used with -slave\n");
+        goto fail;
+    }
+    if(checkpoint < 0)
+        checkpoint = resume ? 60 : 0;
+    for(int i = 0; i < out_fhs; i++) {
+        out_opt[i].resume = resume;
+        out_opt[i].checkpoint = checkpoint;
+    }
+    if(hash_file && compare_log && !strcmp(hash_file, "-") && !strcmp(compare_log, "-")) {
+        fprintf(stderr, "error: can't write to stdout multiple times\n");
+        goto fail;
+    }
     for(int i = 0; i < out_fhs; i++) {
-        if(!strcmp(outfile[i], "-")) {
+        if(out_pipe[i]) {
+#ifdef SIGPIPE
+            /* an encoder quitting early shows as a failed write, and its exit status is reported */
+            signal(SIGPIPE, SIG_IGN);
+#endif
+            if(output_spawn(&out[i], outfile[i], &out_opt[i]) < 0)
+                goto fail;
+            continue;
+        }
+        if(!strcmp(outfile[i], "-") && out_opt[i].format != OUTPUT_NULL) {
             for(int j = 0; j < i; j++)
-                if(out_fh[j] == stdout) {
+                if(!out_pipe[j] && !strcmp(outfile[j], "-") && out_opt[j].format != OUTPUT_NULL) {
                     fprintf(stderr, "error: can't write to stdout multiple times\n");
                     goto fail;
                 }
-            int dupout = dup(fileno(stdout));
-            fclose(stdout);
-#ifdef _WIN32
-            _setmode(dupout, _O_BINARY);
-#endif
-            out_fh[i] = fdopen(dupout, "wb");
-        } else {
-            out_fh[i] = fopen(outfile[i], "wb");
-            if(!out_fh[i]) {
-                fprintf(stderr, "error: failed to create/open \"%s\"\n", outfile[i]);
+            if((hash_file && !strcmp(hash_file, "-")) || (compare_log && !strcmp(compare_log, "-"))) {
+                fprintf(stderr, "error: can't write to stdout multiple times\n");
                 goto fail;
             }
         }
+        if(output_open(&out[i], outfile[i], &out_opt[i]) < 0)
+            goto fail;
     }
-#if HAVE_HFYU
     if(hfyufile) {
-        char *cmd = malloc(100+strlen(hfyufile));
-        if(!cmd) {
-           fprintf(stderr, "error: malloc failed\n");
-           goto fail;
-        }
-        sprintf(cmd, "ffmpeg -loglevel quiet -v 0 -y -f yuv4mpegpipe -i - -vcodec ffvhuff -an -f avi \"%s\"", hfyufile);
-        out_fh[out_fhs] = popen(cmd, "wb");
-        free(cmd);
-        if(!out_fh[out_fhs]) {
-            fprintf(stderr, "error: failed to exec ffmpeg\n");
+        if(out_fhs == MAX_FH) {
+            fprintf(stderr, "error: too many output files\n");
             goto fail;
         }
-        y4m_headers[out_fhs] = 1;
+        output_opt_default(&out_opt[out_fhs]);
+        out_opt[out_fhs].format = OUTPUT_FFVHUFF;
+        out_opt[out_fhs].resume = resume;
+        if(output_open(&out[out_fhs], hfyufile, &out_opt[out_fhs]) < 0)
+            goto fail;
         out_fhs++;
     }
-#endif
-
-    char *interlace_type = interlaced ? tff ? "t" : "b" : "p";
-    char csp_type[200];
-    int chroma_h_shift = 0;
-    int chroma_v_shift = 0;
-    switch(csp) {
-        case CSP_I400:
-            if(input_depth > 8)
-                sprintf(csp_type, "Cmono%d", input_depth);
-            else
-                strcpy(csp_type, "Cmono");
-            break;
-        case CSP_I420:
-            if(input_depth > 8)
-                sprintf(csp_type, "C420p%d XYSCSS=420P%d", input_depth, input_depth);
-            else
-                strcpy(csp_type, "C420mpeg2 XYSCSS=420MPEG2");
-            chroma_h_shift = 1;
-            chroma_v_shift = 1;
-            break;
-        case CSP_I422:
-            if(input_depth > 8)
-                sprintf(csp_type, "C422p%d XYSCSS=422P%d", input_depth, input_depth);
-            else
-                strcpy(csp_type, "C422 XYSCSS=422");
-            chroma_h_shift = 1;
-            break;
-        case CSP_I444:
-            if(input_depth > 8)
-                sprintf(csp_type, "C444p%d XYSCSS=444P%d", input_depth, input_depth);
-            else
-                strcpy(csp_type, "C444 XYSCSS=444");
-            break;
-        default:
-            goto fail; //can't happen
-    }
+    /* regular files with the same settings are written once; devices and FIFOs
+       can't be read back, so they are always written */
     for(int i = 0; i < out_fhs; i++) {
-        if(setvbuf(out_fh[i], NULL, _IOFBF, AVS_BUFSIZE))
-        {
-            fprintf(stderr, "error: failed to create buffer for \"%s\"\n", outfile[i]);
-            goto fail;
-        }
-        if(!y4m_headers[i])
+        if(!output_is_file(&out[i]))
             continue;
-        fprintf(out_fh[i], "YUV4MPEG2 W%d H%d F%u:%u I%s A%u:%u %s\n",
-            input_width, input_height, fps_num, fps_den, interlace_type, par_width, par_height, csp_type);
-        fflush(out_fh[i]);
-    }
-
-    int planes_count = 1;
-    int frame_size = inf->width * inf->height;
-    if(csp != CSP_I400) {
-        planes_count += 2;
-        frame_size += 2 * (inf->width >> chroma_h_shift) * (inf->height >> chroma_v_shift);
+        for(int j = 0; j < i; j++)
+            if(!out_copy[j] && output_is_file(&out[j]) && output_same_stream(&out_opt[i], &out_opt[j])) {
+                out_copy[i] = j + 1;
+                fprintf(stderr, "\"%s\" will be a copy of \"%s\"\n", out[i].filename, out[j].filename);
+                break;
+            }
     }
-    int write_target = out_fhs * frame_size; // how many bytes per frame we expect to write
 
     if(slave) {
         seek = 0;
@@ -511,8 +1150,173 @@ add_outfile:
         end += seek;
         if(end <= seek || end > inf->num_frames)
             end = inf->num_frames;
+        if(compare_file)
+            end = MIN(end, avs_h.func.avs_get_video_info(ref_h.clip)->num_frames);
+    }
+
+    if(perf_counters && perf_open(seek, slave ? 0 : end - seek) < 0)
+        goto fail;
+
+    ts = clock_ns();
+    pool = threadpool_create(threads ? threads : cpu_count());
+    if(!pool) {
+        fprintf(stderr, "error: failed to create worker threads\n");
+        goto fail;
+    }
+    startup_step(timings, "start threads", NULL, ts);
+
+    /* the picture handed to the conversions: the clip as AviSynth delivers it,
+       the 16-bit hack's double width frames being 16-bit samples */
+    picture_t src = {0};
+    src.width = input_width;
+    src.height = input_height;
+    src.depth = input_depth;
+    src.component_size = is_16bit_hack ? 2 : component_size;
+    src.alpha = need_alpha;
+    picture_set_csp(&src, native_csp ? src_csp : csp);
+    convert = convert_create(&src, chroma_filter, chroma_loc, scale_filter, interlaced, pool);
+    if(!convert) {
+        fprintf(stderr, "error: malloc failed\n");
+        goto fail;
+    }
+
+    if(hash_file || golden_file) {
+        /* the clip as AviSynth delivers it, alpha included */
+        picture_t format = src;
+        format.alpha = AVS_IS_YUVA(inf);
+        hash = hash_create(hash_file, golden_file, &format, pool);
+        if(!hash)
+            goto fail;
+        hash_held = malloc(hash_batch(hash) * sizeof(AVS_VideoFrame*));
+        if(!hash_held) {
+            fprintf(stderr, "error: malloc failed\n");
+            goto fail;
+        }
+    }
+
+    if(compare_file) {
+        picture_t format = src;
+        format.alpha = 0;
+        compare = compare_create(compare_log, compare_file, &format, pool);
+        if(!compare)
+            goto fail;
+    }
+
+    for(int i = 0; i < out_fhs; i++) {
+        if(out_copy[i])
+            continue;
+        video_info_t info = {0};
+        info.width = input_width;
+        info.height = input_height;
+        if(out_opt[i].height) {
+            /* same aspect ratio, rounded to an even width */
+            info.height = out_opt[i].height;
+            info.width = (int)(((int64_t)input_width * info.height + input_height) / (2 * input_height)) * 2;
+        }
+        info.csp = out_opt[i].csp == CSP_AUTO ? csp : out_opt[i].csp;
+        info.depth = out_opt[i].depth ? out_opt[i].depth : input_depth;
+        info.fps_num = fps_num;
+        info.fps_den = fps_den * out_opt[i].step;
+        info.par_width = par_width;
+        info.par_height = par_height;
+        info.interlaced = interlaced;
+        info.tff = tff;
+        info.chroma_loc = chroma_loc;
+        int scaled = info.width != src.width || info.height != src.height;
+        if((info.csp != src.csp || scaled) && !csp_fits_size(out[i].filename, info.csp, info.width, info.height, interlaced))
+            goto fail;
+        out_stage[i] = convert_add(convert, info.width, info.height, info.csp, info.depth);
+        if(out_stage[i] < 0) {
+            static const char * const csp_names[] = {NULL, "I400", "I420", "I422", "I444"};
+            fprintf(stderr, "error: can't convert %dx%d %d-bit %s to %dx%d %d-bit %s for \"%s\"\n",
+                    src.width, src.height, src.depth, csp_names[src.csp],
+                    info.width, info.height, info.depth, csp_names[info.csp], out[i].filename);
+            goto fail;
+        }
+        if(scaled)
+            fprintf(stderr, "scaling to %dx%d (%s) for \"%s\"\n",
+                    info.width, info.height, scale_filter_name(scale_filter), out[i].filename);
+        /* cropping just offsets the planes of the converted picture */
+        output_opt_t *o = &out_opt[i];
+        int crop_width = o->crop_width ? o->crop_width : info.width - o->crop_x;
+        int crop_height = o->crop_height ? o->crop_height : info.height - o->crop_y;
+        if(crop_width <= 0 || crop_height <= 0 ||
+           o->crop_x + crop_width > info.width || o->crop_y + crop_height > info.height) {
+            fprintf(stderr, "error: crop %d:%d:%d:%d is outside the %dx%d frame of \"%s\"\n",
+                    o->crop_width, o->crop_height, o->crop_x, o->crop_y, info.width, info.height, out[i].filename);
+            goto fail;
+        }
+        picture_t crop_fmt = {0};
+        picture_set_csp(&crop_fmt, info.csp);
+        int crop_xmod = 1 << crop_fmt.h_shift;
+        int crop_ymod = (1 << crop_fmt.v_shift) << (interlaced || o->fields);
+        if(((o->crop_x | crop_width) & (crop_xmod-1)) || ((o->crop_y | crop_height) & (crop_ymod-1))) {
+            fprintf(stderr, "error: crop %d:%d:%d:%d of \"%s\" is not mod %d horizontally and mod %d vertically\n",
+                    o->crop_width, o->crop_height, o->crop_x, o->crop_y, out[i].filename, crop_xmod, crop_ymod);
+            goto fail;
+        }
+        if(o->tiles_x) {
+            /* tile edges are rounded down to the chroma subsampling */
+            int x0 = crop_width * o->tile_x / o->tiles_x & ~(crop_xmod-1);
+            int y0 = crop_height * o->tile_y / o->tiles_y & ~(crop_ymod-1);
+            int x1 = o->tile_x == o->tiles_x-1 ? crop_width : crop_width * (o->tile_x+1) / o->tiles_x & ~(crop_xmod-1);
+            int y1 = o->tile_y == o->tiles_y-1 ? crop_height : crop_height * (o->tile_y+1) / o->tiles_y & ~(crop_ymod-1);
+            if(x1 <= x0 || y1 <= y0) {
+                fprintf(stderr, "error: %dx%d can't be split into %dx%d tiles\n",
+                        crop_width, crop_height, o->tiles_x, o->tiles_y);
+                goto fail;
+            }
+            o->crop_x += x0;
+            o->crop_y += y0;
+            crop_width = x1 - x0;
+            crop_height = y1 - y0;
+        }
+        info.width = o->crop_width = crop_width;
+        info.height = o->crop_height = crop_height;
+        if(o->fields) {
+            /* progressive pictures of half height, at twice the rate when both are written */
+            info.height /= 2;
+            info.interlaced = 0;
+            info.tff = interlaced ? tff : avs_is_tff(inf);
+            if(o->fields == OUTPUT_FIELDS_BOTH)
+                info.fps_num *= 2;
+        }
+        ts = clock_ns();
+        if(output_init(&out[i], &info, pool) < 0)
+            goto fail;
+        startup_step(timings, "init outfile", out[i].filename, ts);
+    }
+
+    if(resume) {
+        /* each outfile takes up after the frames it has, the script at the earliest of them */
+        int first = -1;
+        for(int i = 0; i < out_fhs; i++) {
+            if(out_copy[i] || out_opt[i].format == OUTPUT_NULL)
+                continue;
+            int frm = output_resume(&out[i], seek, end);
+            if(out[i].resume_frames)
+                fprintf(stderr, "\"%s\" has %d frames, resuming at frame %d\n", out[i].filename, out[i].resume_frames, frm);
+            first = first < 0 ? frm : MIN(first, frm);
+        }
+        if(first >= 0)
+            seek = first;
+    }
+
+    if(stats_file) {
+        /* the frames any outfile takes */
+        int frames = 0;
+        for(int frm = seek; !slave && frm < end; frm++) {
+            int wanted = !out_fhs;
+            for(int i = 0; i < out_fhs; i++)
+                wanted |= output_wants_frame(&out[i], frm);
+            frames += wanted;
+        }
+        stats = stats_create(stats_file, stats_interval, frames, out, out_fhs);
+        if(!stats)
+            goto fail;
     }
 
+    int frames_rendered = 0;
     for(int frm = seek; frm < end; ++frm) {
         if(slave) {
             char input[80];
@@ -524,67 +1328,213 @@ add_outfile:
             } while(frm < 0);
             if(frm >= inf->num_frames)
                 frm = inf->num_frames-1;
+            if(compare && frm >= avs_h.func.avs_get_video_info(ref_h.clip)->num_frames)
+                frm = avs_h.func.avs_get_video_info(ref_h.clip)->num_frames-1;
+        }
+
+        if(out_fhs) { // no need to render frames none of the outputs takes
+            int wanted = 0;
+            for(int i = 0; i < out_fhs; i++)
+                wanted |= output_wants_frame(&out[i], frm);
+            if(!wanted)
+                continue;
         }
 
-        AVS_VideoFrame *f = avs_h.func.avs_get_frame(avs_h.clip, frm);
+        int64_t stage[BENCH_STAGES] = {0};
+        int64_t out_ns[MAX_FH];
+        perf_span_t span;
+        int64_t t = clock_ns();
+        perf_begin(&span, BENCH_GET_FRAME, frm);
+        AVS_VideoFrame *f, *ref_f = NULL;
+        if(compare) {
+            frame_fetch_t fetch = {{&avs_h, &ref_h}, {NULL, NULL}, frm};
+            threadpool_run(pool, fetch_frame, &fetch, 2);
+            f = fetch.f[0];
+            ref_f = fetch.f[1];
+        } else
+            f = avs_h.func.avs_get_frame(avs_h.clip, frm);
+        perf_end(&span);
+        stage[BENCH_GET_FRAME] = clock_ns() - t;
+        trace_span("get_frame", NULL, frm, t);
+        if(!frames_rendered++ && timings)
+            bench_phase(timings, "first get_frame", NULL, t);
         const char *err = avs_h.func.avs_clip_get_error(avs_h.clip);
         if(err) {
             fprintf(stderr, "error: %s occurred while reading frame %d\n", err, frm);
             goto fail;
         }
+        if(compare && (err = avs_h.func.avs_clip_get_error(ref_h.clip))) {
+            fprintf(stderr, "error: %s occurred while reading frame %d of \"%s\"\n", err, frm, compare_file);
+            goto fail;
+        }
 
-        if(out_fhs) {
-            static const int planes[] = {AVS_PLANAR_Y, AVS_PLANAR_U, AVS_PLANAR_V};
-            int wrote = 0;
-
-            for(int i = 0; i < out_fhs; i++)
-                if(y4m_headers[i])
-                    fwrite("FRAME\n", 1, 6, out_fh[i]);
-
-            for(int p = 0; p < planes_count; p++) {
-                int w = inf->width  >> (p ? chroma_h_shift : 0);
-                int h = inf->height >> (p ? chroma_v_shift : 0);
-                int pitch = AVS_GET_PITCH_P(f, planes[p]);
-                const BYTE* data = AVS_GET_READ_PTR_P(f, planes[p]);
-                for(int y = 0; y < h; y++) {
-                    for(int i = 0; i < out_fhs; i++)
-                        wrote += fwrite(data, component_size, w, out_fh[i]);
-                    data += pitch;
-                }
+        static const int planes[] = {AVS_PLANAR_Y, AVS_PLANAR_U, AVS_PLANAR_V};
+        picture_t pic = src;
+        for(int p = 0; p < pic.planes; p++) {
+            pic.plane[p] = (uint8_t*)AVS_GET_READ_PTR_P(f, planes[p]);
+            pic.stride[p] = AVS_GET_PITCH_P(f, planes[p]);
+        }
+        if(need_alpha || (hash && AVS_IS_YUVA(inf))) {
+            pic.plane[3] = (uint8_t*)AVS_GET_READ_PTR_P(f, AVS_PLANAR_A);
+            pic.stride[3] = AVS_GET_PITCH_P(f, AVS_PLANAR_A);
+        }
+        if(compare) {
+            picture_t ref = src;
+            for(int p = 0; p < ref.planes; p++) {
+                ref.plane[p] = (uint8_t*)AVS_GET_READ_PTR_P(ref_f, planes[p]);
+                ref.stride[p] = AVS_GET_PITCH_P(ref_f, planes[p]);
             }
-            if(wrote != write_target) {
-                fprintf(stderr, "error: wrote only %d of %d bytes\n", wrote * component_size, write_target * component_size);
+            int ret = compare_frame(compare, frm, &pic, &ref);
+            avs_h.func.avs_release_video_frame(ref_f);
+            if(ret < 0) {
+                avs_h.func.avs_release_video_frame(f);
                 goto fail;
             }
+        }
+
+        if(out_fhs) {
+            for(int i = 0; i < out_fhs; i++)
+                if(!out_copy[i] && output_wants_frame(&out[i], frm))
+                    convert_need(convert, out_stage[i]);
+            t = clock_ns();
+            perf_begin(&span, BENCH_CONVERT, frm);
+            convert_frame(convert, &pic);
+            perf_end(&span);
+            stage[BENCH_CONVERT] = clock_ns() - t;
+            trace_span("convert", NULL, frm, t);
+
+            frame_writes_t writes;
+            writes.count = 0;
+            writes.frame = frm;
+            for(int i = 0; i < out_fhs; i++) {
+                if(out_copy[i] || !output_wants_frame(&out[i], frm))
+                    continue;
+                int w = writes.count++;
+                writes.out[w] = &out[i];
+                picture_crop(&writes.pic[w], convert_picture(convert, out_stage[i]), out_opt[i].crop_x,
+                             out_opt[i].crop_y, out_opt[i].crop_width, out_opt[i].crop_height);
+            }
+            t = clock_ns();
+            perf_begin(&span, BENCH_WRITE, frm);
+            threadpool_run(pool, write_output, &writes, writes.count);
+            perf_end(&span);
+            stage[BENCH_WRITE] = clock_ns() - t;
+            trace_span("write frame", NULL, frm, t);
+            for(int w = 0; w < writes.count; w++)
+                if(writes.ret[w] < 0) {
+                    fprintf(stderr, "error: failed to write frame %d to \"%s\"\n", frm, writes.out[w]->filename);
+                    avs_h.func.avs_release_video_frame(f);
+                    goto fail;
+                }
             if(slave) { // assume timing doesn't matter in other modes
-                for(int i = 0; i < out_fhs; i++)
-                    fflush(out_fh[i]);
+                for(int i = 0; i < out_fhs; i++) {
+                    ts = trace_start();
+                    output_flush(&out[i]);
+                    trace_span("flush", out[i].filename, frm, ts);
+                }
             }
+            for(int i = 0; i < out_fhs; i++)
+                out_ns[i] = -1;
+            for(int w = 0; w < writes.count; w++)
+                out_ns[writes.out[w] - out] = writes.ns[w];
+        }
+        if(timings && bench_frame(timings, stage, out_ns) < 0) {
+            fprintf(stderr, "error: malloc failed\n");
+            avs_h.func.avs_release_video_frame(f);
+            goto fail;
         }
 
         if(verbose)
             fprintf(stderr, "%d\n", frm);
+        if(stats)
+            stats_frames(stats, frames_rendered);
 
-        avs_h.func.avs_release_video_frame(f);
+        if(hash) {
+            /* held until their batch is hashed */
+            pic.alpha = AVS_IS_YUVA(inf);
+            hash_add(hash, frm, &pic);
+            hash_held[hash_held_count++] = f;
+            if(hash_held_count == hash_batch(hash)) {
+                int ret = hash_run(hash);
+                while(hash_held_count)
+                    avs_h.func.avs_release_video_frame(hash_held[--hash_held_count]);
+                if(ret < 0)
+                    goto fail;
+            }
+        } else
+            avs_h.func.avs_release_video_frame(f);
     }
 
-    for(int i = 0; i < out_fhs; i++)
-        fflush(out_fh[i]);
+    for(int i = 0; i < out_fhs; i++) {
+        ts = trace_start();
+        output_flush(&out[i]);
+        trace_span("flush", out[i].filename, -1, ts);
+    }
 
 close_files:
     retval = 0;
+    if(hash_held_count && hash_run(hash) < 0)
+        retval = 1;
 fail:
-#if HAVE_HFYU
-    if(hfyufile) {
-        if(out_fh[out_fhs-1])
-            pclose(out_fh[out_fhs-1]);
-        out_fhs--;
-    }
-#endif
-    for(int i = 0; i < out_fhs; i++)
-        if(out_fh[i])
-            fclose(out_fh[i]);
+    while(hash_held_count)
+        avs_h.func.avs_release_video_frame(hash_held[--hash_held_count]);
+    free(hash_held);
+    /* AviSynth goes first, its memory isn't needed while queued outfiles catch up */
+    ts = trace_start();
+    if(ref_h.env)
+        internal_avs_close_library(&ref_h);
     if(avs_h.library)
         internal_avs_close_library(&avs_h);
+    trace_span("close library", NULL, -1, ts);
+    convert_delete(convert);
+    int64_t drain = clock_ns();
+    for(int i = 0; i < out_fhs; i++) {
+        if(out_copy[i])
+            continue;
+        ts = trace_start();
+        if(output_close(&out[i]) < 0)
+            retval = 1;
+        trace_span("close", out[i].filename, -1, ts);
+    }
+    if(!retval) {
+        file_copies_t copies;
+        copies.count = 0;
+        for(int i = 0; i < out_fhs; i++)
+            if(out_copy[i]) {
+                copies.out[copies.count] = &out[i];
+                copies.src[copies.count++] = out[out_copy[i]-1].filename;
+            }
+        threadpool_run(pool, copy_output, &copies, copies.count);
+        for(int c = 0; c < copies.count; c++)
+            if(copies.ret[c] < 0)
+                retval = 1;
+    }
+    for(int i = 0; i < out_fhs; i++)
+        if(out_copy[i] && output_close(&out[i]) < 0)
+            retval = 1;
+    if(hash && hash_close(hash, retval ? NULL : stderr) < 0)
+        retval = 1;
+    if(compare && compare_close(compare, retval ? NULL : stderr) < 0)
+        retval = 1;
+    if(stats_close(stats, retval) < 0)
+        retval = 1;
+    if(timings && !retval) {
+        const char *names[MAX_FH];
+        uint64_t bytes[MAX_FH];
+        int64_t first_byte[MAX_FH];
+        for(int i = 0; i < out_fhs; i++) {
+            names[i] = out[i].filename;
+            bytes[i] = out[i].bytes;
+            first_byte[i] = out[i].first_byte;
+        }
+        bench_report(timings, stderr, names, bytes, first_byte, clock_ns() - drain);
+    }
+    bench_delete(timings);
+    perf_close(retval ? NULL : stderr);
+    threadpool_delete(pool);
+    if(trace_close() < 0)
+        retval = 1;
+    for(int i = 0; i < out_fhs; i++)
+        free(out_name[i]);
     return retval;
 }
@@ -70,6 +70,8 @@ typedef struct
         AVSC_DECLARE_FUNC( avs_clip_get_error );
         AVSC_DECLARE_FUNC( avs_create_script_environment );
         AVSC_DECLARE_FUNC( avs_delete_script_environment );
+        AVSC_DECLARE_FUNC( avs_function_exists );
+        AVSC_DECLARE_FUNC( avs_get_cpu_flags );
         AVSC_DECLARE_FUNC( avs_get_error );
         AVSC_DECLARE_FUNC( avs_get_frame );
         AVSC_DECLARE_FUNC( avs_get_video_info );
@@ -91,6 +93,7 @@ typedef struct
         AVSC_DECLARE_FUNC( avs_is_y );
         AVSC_DECLARE_FUNC( avs_component_size );
         AVSC_DECLARE_FUNC( avs_bits_per_component );
+        AVSC_DECLARE_FUNC( avs_is_yuva );
     } func;
 } avs_hnd_t;
 
@@ -103,6 +106,8 @@ static int internal_avs_load_library( avs_hnd_t *h )
     LOAD_AVS_FUNC( avs_clip_get_error, 0 );
     LOAD_AVS_FUNC( avs_create_script_environment, 0 );
     LOAD_AVS_FUNC( avs_delete_script_environment, 1 );
+    LOAD_AVS_FUNC( avs_function_exists, 1 );
+    LOAD_AVS_FUNC( avs_get_cpu_flags, 1 );
     LOAD_AVS_FUNC( avs_get_error, 1 );
     LOAD_AVS_FUNC( avs_get_frame, 0 );
     LOAD_AVS_FUNC( avs_get_video_info, 0 );
@@ -124,6 +129,7 @@ static int internal_avs_load_library( avs_hnd_t *h )
     LOAD_AVS_FUNC( avs_is_y, 1 );
     LOAD_AVS_FUNC( avs_component_size, 1 );
     LOAD_AVS_FUNC( avs_bits_per_component, 1 );
+    LOAD_AVS_FUNC( avs_is_yuva, 1 );
     return 0;
 fail:
     avs_close( h->library );
@@ -0,0 +1,196 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "bench.h"
+
+typedef struct
+{
+    int64_t *ns;
+    int count, size;
+    int64_t total;
+} samples_t;
+
+typedef struct
+{
+    const char *name, *detail;
+    int64_t start, end;
+} phase_t;
+
+struct bench_t
+{
+    int outputs;
+    int64_t start;
+    samples_t stage[BENCH_STAGES];
+    samples_t *out;
+    phase_t phase[BENCH_PHASES];
+    int phases;
+};
+
+static int samples_add(samples_t *s, int64_t ns)
+{
+    if(s->count == s->size) {
+        int size = s->size ? s->size * 2 : 1024;
+        int64_t *p = realloc(s->ns, size * sizeof(int64_t));
+        if(!p)
+            return -1;
+        s->ns = p;
+        s->size = size;
+    }
+    s->ns[s->count++] = ns;
+    s->total += ns;
+    return 0;
+}
+
+static int cmp_ns(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+/* nearest rank, of samples sorted beforehand */
+static double percentile_ms(const samples_t *s, int pct)
+{
+    int i = (int)(((int64_t)s->count * pct + 99) / 100) - 1;
+    return s->ns[MAX(i, 0)] / 1e6;
+}
+
+static void print_samples(FILE *fh, const char *name, samples_t *s, int64_t wall)
+{
+    if(!s->count)
+        return;
+    qsort(s->ns, s->count, sizeof(int64_t), cmp_ns);
+    fprintf(fh, "  %-24.24s %9.3f %6.1f%% %9.3f %9.3f %9.3f %9.3f\n", name, s->total / 1e9,
+            wall ? s->total * 100. / wall : 0., percentile_ms(s, 50), percentile_ms(s, 95),
+            percentile_ms(s, 99), s->ns[s->count-1] / 1e6);
+}
+
+bench_t *bench_create(int outputs)
+{
+    bench_t *h = calloc(1, sizeof(bench_t));
+    if(!h)
+        return NULL;
+    h->outputs = outputs;
+    h->out = calloc(MAX(outputs, 1), sizeof(samples_t));
+    if(!h->out) {
+        free(h);
+        return NULL;
+    }
+    h->start = clock_ns();
+    return h;
+}
+
+void bench_delete(bench_t *h)
+{
+    if(!h)
+        return;
+    for(int i = 0; i < BENCH_STAGES; i++)
+        free(h->stage[i].ns);
+    for(int i = 0; i < h->outputs; i++)
+        free(h->out[i].ns);
+    free(h->out);
+    free(h);
+}
+
+void bench_phase(bench_t *h, const char *name, const char *detail, int64_t start)
+{
+    if(h->phases == BENCH_PHASES)
+        return;
+    phase_t *p = &h->phase[h->phases++];
+    p->name = name;
+    p->detail = detail;
+    p->start = start;
+    p->end = clock_ns();
+}
+
+static void print_startup(bench_t *h, FILE *fh, const char * const *names, const int64_t *first_byte)
+{
+    int64_t first = 0;
+    for(int i = 0; i < h->outputs; i++)
+        if(first_byte[i] && (!first || first_byte[i] < first))
+            first = first_byte[i];
+    int64_t ready = h->phases ? h->phase[h->phases-1].end : h->start;
+    fprintf(fh, "bench: startup %.3f ms", (ready - h->start) / 1e6);
+    if(first)
+        fprintf(fh, ", first frame out after %.3f ms", (first - h->start) / 1e6);
+    fprintf(fh, "\n");
+    if(!h->phases)
+        return;
+    fprintf(fh, "  %-40s %9s %9s\n", "step", "ms", "done at");
+    for(int i = 0; i < h->phases; i++) {
+        phase_t *p = &h->phase[i];
+        char name[64];
+        if(p->detail)
+            snprintf(name, sizeof(name), "%s %s", p->name, p->detail);
+        else
+            snprintf(name, sizeof(name), "%s", p->name);
+        fprintf(fh, "  %-40.40s %9.3f %9.3f\n", name, (p->end - p->start) / 1e6, (p->end - h->start) / 1e6);
+    }
+    /* time to first byte: until the outfile had a frame, which for queued ones is when
+       their writer got it out */
+    for(int i = 0; i < h->outputs; i++) {
+        if(!first_byte[i])
+            continue;
+        char name[64];
+        snprintf(name, sizeof(name), "first frame to %s", names[i]);
+        fprintf(fh, "  %-40.40s %9s %9.3f\n", name, "", (first_byte[i] - h->start) / 1e6);
+    }
+}
+
+int bench_frame(bench_t *h, const int64_t stage[BENCH_STAGES], const int64_t *out)
+{
+    for(int i = 0; i < BENCH_STAGES; i++)
+        if(samples_add(&h->stage[i], stage[i]) < 0)
+            return -1;
+    for(int i = 0; i < h->outputs; i++)
+        if(out[i] >= 0 && samples_add(&h->out[i], out[i]) < 0)
+            return -1;
+    return 0;
+}
+
+void bench_report(bench_t *h, FILE *fh, const char * const *names, const uint64_t *bytes,
+                  const int64_t *first_byte, int64_t drain)
+{
+    static const char * const stage_names[BENCH_STAGES] = {"get_frame", "convert", "write"};
+    int64_t wall = clock_ns() - h->start;
+    int frames = h->stage[0].count;
+    uint64_t total = 0;
+    for(int i = 0; i < h->outputs; i++)
+        total += bytes[i];
+    print_startup(h, fh, names, first_byte);
+    fprintf(fh, "bench: %d frames in %.3f s, %.2f fps, %.1f MB written at %.1f MB/s\n", frames, wall / 1e9,
+            wall ? frames * 1e9 / wall : 0., total / 1048576., wall ? total * 1e9 / 1048576 / wall : 0.);
+    if(!frames)
+        return;
+    fprintf(fh, "  %-24s %9s %7s %9s %9s %9s %9s\n", "stage", "total s", "share", "p50 ms", "p95 ms", "p99 ms", "max ms");
+    int64_t other = wall - drain;
+    for(int i = 0; i < BENCH_STAGES; i++) {
+        other -= h->stage[i].total;
+        print_samples(fh, stage_names[i], &h->stage[i], wall);
+    }
+    /* these overlap each other and the write stage, as the outfiles are written in parallel */
+    for(int i = 0; i < h->outputs; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "  %s", names[i]);
+        print_samples(fh, name, &h->out[i], wall);
+    }
+    if(drain)
+        fprintf(fh, "  %-24s %9.3f %6.1f%%\n", "drain", drain / 1e9, drain * 100. / wall);
+    fprintf(fh, "  %-24s %9.3f %6.1f%%\n", "other", MAX(other, 0) / 1e9, MAX(other, 0) * 100. / wall);
+
+    /* whichever the frame loop waited on the most; outfiles catching up after the last frame
+       count as writing */
+    int64_t render = h->stage[BENCH_GET_FRAME].total;
+    int64_t convert = h->stage[BENCH_CONVERT].total;
+    int64_t io = h->stage[BENCH_WRITE].total + drain;
+    const char *bound = render >= convert && render >= io ? "renderer-bound (AviSynth's GetFrame)"
+                      : io >= convert ? "I/O-bound (writing the outfiles)" : "conversion-bound";
+    fprintf(fh, "bench: %s, render %.1f%% / convert %.1f%% / write %.1f%% of the time\n", bound,
+            render * 100. / wall, convert * 100. / wall, io * 100. / wall);
+}
@@ -0,0 +1,39 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#ifndef AVS2YUV_BENCH_H
+#define AVS2YUV_BENCH_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* per-frame timings of the stages of the frame loop, summarized by bench_report */
+#define BENCH_GET_FRAME 0 // avs_get_frame, the script rendering the frame
+#define BENCH_CONVERT   1 // conversions for the outfiles
+#define BENCH_WRITE     2 // until all outfiles have taken the frame
+#define BENCH_STAGES    3
+
+#define BENCH_PHASES    96 // startup steps kept, the rest aren't reported
+
+typedef struct bench_t bench_t;
+
+/* the clock of the whole run starts here */
+bench_t *bench_create(int outputs);
+void bench_delete(bench_t *h);
+/* a step of the startup, begun at start (clock_ns) and ending now. name and detail (which
+   may be NULL) must stay valid until bench_report */
+void bench_phase(bench_t *h, const char *name, const char *detail, int64_t start);
+/* adds a frame's stage times in ns, and the write time of each outfile taking it
+   (out[i] < 0 for those that don't) */
+int bench_frame(bench_t *h, const int64_t stage[BENCH_STAGES], const int64_t *out);
+/* prints the startup steps, throughput, latency percentiles and where the time went;
+   bytes is what each outfile was given, first_byte when its first frame reached it
+   (0 for none) and drain the time spent closing them after the last frame */
+void bench_report(bench_t *h, FILE *fh, const char * const *names, const uint64_t *bytes,
+                  const int64_t *first_byte, int64_t drain);
+
+#endif
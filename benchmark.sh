@@ -0,0 +1,92 @@
+#!/bin/sh
+# Output throughput of avs2yuv for every input colorspace/depth and output format,
+# rendered by the mock libavisynth.so (make mock) so that runs are reproducible
+# without AviSynth. Frames are written to $OUTDIR (default /dev/null).
+#
+#   WIDTH=1920 HEIGHT=1080 FRAMES=200 THREADS= OUTDIR=/dev/null ./benchmark.sh [filter]
+#
+# filter, if given, is a grep pattern selecting the "pixel_type output" cases to run, the
+# conversion cases being named i420/<chroma filter>, odepth<n> and ladder/<scale filter>.
+
+WIDTH=${WIDTH:-1920}
+HEIGHT=${HEIGHT:-1080}
+FRAMES=${FRAMES:-200}
+THREADS=${THREADS:+-threads $THREADS}
+OUTDIR=${OUTDIR:-/dev/null}
+AVS2YUV=${AVS2YUV:-./avs2yuv}
+
+if [ ! -x "$AVS2YUV" ] || [ ! -f libavisynth.so ]; then
+    echo "build avs2yuv and the mock first: make && make mock" >&2
+    exit 1
+fi
+
+TMP=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMP"' EXIT INT TERM
+
+# the formats each input can be written to without a conversion
+formats()
+{
+    case $1 in
+    YV12|YUV420P8) echo "y4m raw nv12 ffvhuff" ;;
+    YV16|YUV422P8) echo "y4m raw nv12 uyvy ffvhuff" ;;
+    YUV422P10)     echo "y4m raw p010 v210 y210" ;;
+    YUV420P10)     echo "y4m raw p010" ;;
+    YUV420P12)     echo "y4m raw p012" ;;
+    *P16)          echo "y4m raw p016" ;;
+    YUVA*)         echo "raw raw+alpha" ;;
+    *)             echo "y4m raw" ;;
+    esac
+}
+
+# one run: input pixel_type, the name it is reported as, avs2yuv options
+bench()
+{
+    pt=$1 name=$2
+    shift 2
+    echo "$pt $name" | grep -q -- "$FILTER" || return
+    avs=$TMP/$pt.avs
+    printf "width=%d\nheight=%d\npixel_type=%s\nframes=%d\npool=4\n" "$WIDTH" "$HEIGHT" "$pt" "$FRAMES" > "$avs"
+    out=$OUTDIR
+    [ "$OUTDIR" = /dev/null ] || out=$OUTDIR/bench-$pt-$(echo "$name" | tr / -)
+    case $name in
+    ffvhuff) [ "$OUTDIR" = /dev/null ] && out=$TMP/out.avi ;;
+    ladder*) if [ "$OUTDIR" = /dev/null ]; then out=$TMP/%d; set -- "$@" -format null; else out=$out-%d; fi ;;
+    esac
+    log=$TMP/log
+    if ! "$AVS2YUV" $THREADS -csp auto -bench "$@" -o "$out" "$avs" > /dev/null 2> "$log"; then
+        printf "%-12s %-16s %10s\n" "$pt" "$name" "failed"
+        sed 's/^/    /' "$log" >&2
+        return
+    fi
+    # "bench: 200 frames in 1.234 s, 162.07 fps, 1186.5 MB written at 961.5 MB/s"
+    awk -v pt="$pt" -v name="$name" '
+        /^bench: [0-9]+ frames in/ { fps = $7; mbs = $13 }
+        /^bench: .*-bound/ { sub(/^bench: /, ""); sub(/[ ,].*/, ""); bound = $0 }
+        END { printf "%-12s %-16s %10.1f %10.1f  %s\n", pt, name, fps, mbs, bound }' "$log"
+    [ "$out" = /dev/null ] || rm -f "$out" "$out.layout" "$OUTDIR"/bench-$pt-ladder*
+}
+FILTER=${1:-.}
+
+printf "%-12s %-16s %10s %10s  %s\n" "input" "output" "fps" "MB/s" "bound"
+# the formats each input is written to as is
+for pt in Y8 YV12 YV16 YV24 Y10 YUV420P10 YUV422P10 YUV444P10 YUV420P12 YUV420P16 YUV444P16 YUVA420 YUVA444P10; do
+    for fmt in $(formats $pt); do
+        case $fmt in
+        raw+alpha) bench $pt $fmt -raw -alpha ;;
+        *)         bench $pt $fmt -format $fmt ;;
+        esac
+    done
+done
+# the conversion stages: chroma decimation per -chroma-filter, depth changes and -ladder scaling,
+# whose rungs are converted but not written when OUTDIR is /dev/null
+for pt in YV24 YV16; do
+    for filter in point box bilinear bicubic; do
+        bench $pt i420/$filter -ocsp i420 -chroma-filter $filter
+    done
+done
+bench YV12 odepth10 -odepth 10
+bench YV12 odepth16 -odepth 16
+bench YUV420P10 odepth8 -odepth 8
+for filter in bilinear bicubic spline36 lanczos; do
+    bench YV12 ladder/$filter -scale-filter $filter -ladder $((HEIGHT * 2 / 3 / 2 * 2))/$((HEIGHT / 2 / 2 * 2))/$((HEIGHT / 3 / 2 * 2))
+done
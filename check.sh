@@ -0,0 +1,419 @@
+#!/bin/sh
+# Regression cases for avs2yuv, rendered by the mock libavisynth.so (make mock).
+# Each case prints ok, FAILED or skipped; the exit status is the number of failures.
+# The bytes of each output format and mode are checked against ref.py below, which
+# makes them from the mock's sample formula; those cases need python3.
+#
+#   ./check.sh [filter]
+#
+# filter, if given, is a grep pattern selecting the cases to run.
+
+AVS2YUV=${AVS2YUV:-./avs2yuv}
+
+if [ ! -x "$AVS2YUV" ] || [ ! -f libavisynth.so ]; then
+    echo "build avs2yuv and the mock first: make && make mock" >&2
+    exit 1
+fi
+
+TMP=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMP"' EXIT INT TERM
+printf "width=64\nheight=48\npixel_type=YV12\nframes=5\n" > "$TMP/clip.avs"
+"$AVS2YUV" "$TMP/clip.avs" -o "$TMP/ref.y4m" 2> /dev/null || { echo "the reference render failed" >&2; exit 1; }
+
+cat > "$TMP/ref.py" <<'REF'
+# the bytes avs2yuv should write for a clip of the mock, from the mock's own sample formula
+import math, struct, sys
+
+def clip_format(pt):
+    pt = pt.upper()
+    named = {"YV12": "YUV420P8", "YV16": "YUV422P8", "YV24": "YUV444P8", "Y8": "Y8", "YUVA420": "YUVA420P8",
+             "YUVA422": "YUVA422P8", "YUVA444": "YUVA444P8"}
+    pt = named.get(pt, pt)
+    if pt.startswith("Y") and pt[1:].isdigit():
+        return 0, 0, int(pt[1:]), 1, False
+    alpha = pt.startswith("YUVA")
+    sub = pt[3 + alpha:6 + alpha]
+    bits = int(pt[7 + alpha:])
+    return (0 if sub == "444" else 1), (1 if sub == "420" else 0), bits, 3, alpha
+
+def render(pt, w, h, frames, pool=4, bias=0):
+    sw, sh, bits, planes, alpha = clip_format(pt)
+    mx = (1 << bits) - 1
+    tmpl = []
+    for n in range(pool):
+        pics = []
+        for p in range(planes + alpha):
+            pw, ph = (w >> sw, h >> sh) if p in (1, 2) else (w, h)
+            rows = []
+            for y in range(ph):
+                row = []
+                for x in range(pw):
+                    v = (x * (3 + p) + y * (2 + p) + n * 7 + ((x ^ y) & 15) * p) * (mx + 1) // 1024
+                    r = v % (2 * mx + 2)
+                    v = (2 * mx + 1 - r if r > mx else r) + bias
+                    row.append(min(max(v, 0), mx))
+                rows.append(row)
+            pics.append(rows)
+        tmpl.append(pics)
+    return [tmpl[n % pool] for n in range(frames)], bits
+
+def samples(rows, bits, shift=0):
+    fmt = "<%dH" if bits > 8 else "%dB"
+    return b"".join(struct.pack(fmt % len(r), *[s << shift for s in r]) for r in rows)
+
+def crop(plane, w, h, x, y):
+    return [r[x:x + w] for r in plane[y:y + h]]
+
+def v210_row(l, u, v, width):
+    out = b""
+    for x in range(0, (width + 5) // 6 * 6, 6):
+        s = [0] * 12
+        for i in range(0, 6, 2):
+            if x + i < width:
+                s[2*i:2*i + 4] = [u[(x + i) >> 1], l[x + i], v[(x + i) >> 1], l[x + i + 1]]
+        out += struct.pack("<4I", *[s[3*i] | s[3*i + 1] << 10 | s[3*i + 2] << 20 for i in range(4)])
+    return out + bytes((width + 47) // 48 * 128 - len(out))
+
+def crc32c(data):
+    crc = 0xFFFFFFFF
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = crc >> 1 ^ (0x82F63B78 if crc & 1 else 0)
+    return crc ^ 0xFFFFFFFF
+
+def avi_frames(data, pos=12, end=None):
+    end = len(data) if end is None else end
+    while pos + 8 <= end:
+        fourcc, size = data[pos:pos + 4], struct.unpack("<I", data[pos + 4:pos + 8])[0]
+        if fourcc in (b"RIFF", b"LIST"):
+            yield from avi_frames(data, pos + 12, pos + 8 + size)
+        elif fourcc == b"00dc":
+            yield data[pos + 8:pos + 8 + size]
+        pos += 8 + size + (size & 1)
+
+def ffvhuff_decode(frame, w, h, sw, sh):
+    """FFmpeg's FFVHuff with median prediction and per frame tables, 8-bit 4:2:0 or 4:2:2"""
+    bits = "".join(format(struct.unpack("<I", frame[i:i + 4])[0], "032b") for i in range(0, len(frame) & ~3, 4))
+    pos = 0
+    def read(n):
+        nonlocal pos
+        pos += n
+        return int(bits[pos - n:pos], 2)
+    codes = []
+    for p in range(3):
+        lens = []
+        while len(lens) < 256:
+            v = read(8)
+            repeat = v >> 5 or read(8)
+            lens += [v & 31] * repeat
+        code, table = 0, {}
+        for l in range(32, 0, -1):
+            for sym in range(256):
+                if lens[sym] == l:
+                    table[format(code, "0%db" % l)] = sym
+                    code += 1
+            code >>= 1
+        codes.append(table)
+    def symbol(p):
+        nonlocal pos
+        for n in range(1, 32):
+            sym = codes[p].get(bits[pos:pos + n])
+            if sym is not None:
+                pos += n
+                return sym
+        raise ValueError("no code at bit %d" % pos)
+    cw, ch = w >> 1, h >> sh
+    res = [[[] for _ in range(h)], [[] for _ in range(ch)], [[] for _ in range(ch)]]
+    v0, y1, u0, y0 = read(8), read(8), read(8), read(8)
+    for y in range(h):
+        c = y if not sh or y < 2 else -1 if y & 1 or y == 2 else y // 2
+        if c < 0:
+            res[0][y] = [symbol(0) for x in range(w)]
+            continue
+        for x in range(int(not y), cw):
+            res[0][y] += [symbol(0)]
+            res[1][c] += [symbol(1)]
+            res[0][y] += [symbol(0)]
+            res[2][c] += [symbol(2)]
+    res[0][0] = [y0, y1] + res[0][0]
+    res[1][0] = [u0] + res[1][0]
+    res[2][0] = [v0] + res[2][0]
+    planes = []
+    for p, left in ((0, 4), (1, 2), (2, 2)):
+        rows = []
+        for r, d in enumerate(res[p]):
+            pw = len(d)
+            cur = [0] * pw
+            for x in range(pw):
+                if r == 0:
+                    pred = 0 if x == 0 or (p == 0 and x == 1) else cur[x - 1]
+                elif x == 0:
+                    top = rows[r - 1]
+                    pred = top[pw - 1] if r == 1 else mid(top[pw - 1], top[0], (top[pw - 1] + top[0] - rows[r - 2][pw - 1]) & 255)
+                elif r == 1 and x < left:
+                    pred = cur[x - 1]
+                else:
+                    top = rows[r - 1]
+                    pred = mid(cur[x - 1], top[x], (cur[x - 1] + top[x] - top[x - 1]) & 255)
+                cur[x] = (d[x] + pred) & 255
+            rows.append(cur)
+        planes.append(rows)
+    return planes
+
+def mid(a, b, c):
+    return max(min(a, b), min(max(a, b), c))
+
+def main(pt, w, h, frames, mode, *args):
+    w, h, frames = int(w), int(h), int(frames)
+    if mode == "ffvhuff":              # decodes the FFVHuff AVI args[0] to raw
+        sw, sh = clip_format(pt)[:2]
+        for frame in avi_frames(open(args[0], "rb").read()):
+            sys.stdout.buffer.write(b"".join(samples(p, 8) for p in ffvhuff_decode(frame, w, h, sw, sh)))
+        return
+    pics, bits = render(pt, w, h, frames, bias=int(args[0]) if mode == "psnr" and args else 0)
+    sw, sh = clip_format(pt)[:2]
+    out = sys.stdout.buffer
+    for n, planes in enumerate(pics):
+        if mode == "raw":              # Y U V, and A with -alpha
+            out.write(b"".join(samples(p, bits) for p in planes))
+        elif mode == "frames":         # the pictures of a y4m file
+            out.write(b"FRAME\n" + b"".join(samples(p, bits) for p in planes[:3]))
+        elif mode == "plane":          # one plane of every frame, as -planes and -alpha-o write it
+            out.write(samples(planes[int(args[0])], bits))
+        elif mode == "crop":           # -crop W:H:X:Y, also each -tiles tile
+            cw, ch, cx, cy = map(int, args[0].split(":"))
+            out.write(b"".join(samples(crop(p, cw >> (sw if i in (1, 2) else 0), ch >> (sh if i in (1, 2) else 0),
+                                            cx >> (sw if i in (1, 2) else 0), cy >> (sh if i in (1, 2) else 0)), bits)
+                               for i, p in enumerate(planes[:3])))
+        elif mode == "fields":         # -fields top/bottom/both of a top field first clip
+            for f in {"top": [0], "bottom": [1], "both": [0, 1]}[args[0]]:
+                out.write(b"".join(samples(p[f::2], bits) for p in planes[:3]))
+        elif mode == "nv12":           # nv12 and p01x: MSB-aligned above 8 bits
+            shift = 16 - bits if bits > 8 else 0
+            uv = [[s for pair in zip(u, v) for s in pair] for u, v in zip(planes[1], planes[2])]
+            out.write(samples(planes[0], bits, shift) + samples(uv, bits, shift))
+        elif mode == "uyvy":
+            for l, u, v in zip(*planes):
+                out.write(bytes(s for x in range(0, w, 2) for s in (u[x >> 1], l[x], v[x >> 1], l[x + 1])))
+        elif mode == "y210":
+            for l, u, v in zip(*planes):
+                out.write(struct.pack("<%dH" % (2 * w), *[s << 6 for x in range(0, w, 2)
+                                                          for s in (l[x], u[x >> 1], l[x + 1], v[x >> 1])]))
+        elif mode == "v210":
+            for l, u, v in zip(*planes):
+                out.write(v210_row(l, u, v, w))
+        elif mode == "hash":           # the -hash manifest
+            if not n:
+                out.write(b"crc32c %d %d %d %s\n" % (w, h, bits, b"YUVA"[:len(planes)]))
+            out.write(("%d %s\n" % (n, " ".join("%08x" % crc32c(samples(p, bits)) for p in planes))).encode())
+        elif mode == "psnr":           # the global PSNR of -compare against the clip with bias=args[0]
+            ref, _ = render(pt, w, h, frames)
+            mx = (1 << bits) - 1
+            sse = sum((a - b) ** 2 for f in range(frames) for p in range(3)
+                      for ra, rb in zip(pics[f][p], ref[f][p]) for a, b in zip(ra, rb))
+            count = sum(len(p) * len(p[0]) for p in pics[0][:3]) * frames
+            print("%.3f" % (10 * math.log10(mx * mx * count / sse)))
+            return
+
+main(*sys.argv[1:])
+REF
+ref()
+{
+    python3 "$TMP/ref.py" "$@"
+}
+have_python=$(python3 -c 'print(1)' 2> /dev/null)
+
+FILTER=$1
+failed=0
+run()
+{
+    name=$1
+    shift
+    echo "$name" | grep -q -- "${FILTER:-.}" || return
+    D=$TMP/case
+    rm -rf "$D" && mkdir "$D" || exit 1
+    "$@" > "$TMP/log" 2>&1
+    ret=$?
+    if [ $ret = 0 ]; then
+        printf "%-40s ok\n" "$name"
+    elif [ $ret = 77 ]; then
+        printf "%-40s skipped, %s\n" "$name" "$(tail -n 1 "$TMP/log")"
+    else
+        printf "%-40s FAILED\n" "$name"
+        sed 's/^/    /' "$TMP/log" >&2
+        failed=$((failed + 1))
+    fi
+}
+
+# an outfile listed twice, directly or through a link, still holds the render
+dup_name()
+{
+    "$AVS2YUV" "$TMP/clip.avs" -o "$D/s.y4m" -o "$D/s.y4m" && cmp "$D/s.y4m" "$TMP/ref.y4m"
+}
+dup_link()
+{
+    touch "$D/s1.y4m" && ln -s s1.y4m "$D/l.y4m" &&
+    "$AVS2YUV" "$TMP/clip.avs" -o "$D/s1.y4m" -o "$D/l.y4m" && cmp "$D/s1.y4m" "$TMP/ref.y4m"
+}
+dup_dangling_link()
+{
+    ln -s s1.y4m "$D/l.y4m" &&
+    "$AVS2YUV" "$TMP/clip.avs" -o "$D/s1.y4m" -o "$D/l.y4m" && cmp "$D/s1.y4m" "$TMP/ref.y4m"
+}
+# only regular files are copied: a device or a FIFO listed first leaves the next outfile written
+copy_from_device()
+{
+    "$AVS2YUV" "$TMP/clip.avs" -o /dev/null -o "$D/f.y4m" && cmp "$D/f.y4m" "$TMP/ref.y4m"
+}
+device_twice()
+{
+    "$AVS2YUV" "$TMP/clip.avs" -o /dev/null -raw -o /dev/null
+}
+copy_from_fifo()
+{
+    mkfifo "$D/fifo" || return
+    cat "$D/fifo" > "$D/fifo.y4m" &
+    timeout 60 "$AVS2YUV" "$TMP/clip.avs" -o "$D/fifo" -o "$D/f.y4m" &&
+    wait && cmp "$D/fifo.y4m" "$TMP/ref.y4m" && cmp "$D/f.y4m" "$TMP/ref.y4m"
+}
+# -align pads with zeros whatever the clip's pitch, queued or not
+align()
+{
+    sed "s/pitch_align=.*/pitch_align=64/" "$TMP/align.avs" > "$D/clip.avs" &&
+    "$AVS2YUV" "$D/clip.avs" -raw -align 64 $1 -o "$D/out.raw" && cmp "$D/out.raw" "$TMP/align.raw"
+}
+align_direct() { align ""; }
+align_queued() { align "-queue 2"; }
+# every outfile may need its own chroma, scaled and depth stages
+many_stages()
+{
+    "$AVS2YUV" "$TMP/clip.avs" -odepth 10 -format null -ladder "$(seq 46 -2 6 | paste -sd/ -)" -o "$D/%d.yuv"
+}
+
+# the bytes of each format and mode against ref.py: clip pixel_type width height [key=value]
+clip()
+{
+    printf "width=%d\nheight=%d\npixel_type=%s\nframes=5\n%s\n" "$2" "$3" "$1" "$4" > "$D/$1.avs"
+}
+# format pixel_type width height ref-mode [ref-arg] -- avs2yuv options, the outfile option last
+format()
+{
+    [ -n "$have_python" ] || { echo "no python3"; return 77; }
+    pt=$1 w=$2 h=$3
+    shift 3
+    mode=
+    while [ "$1" != -- ]; do mode="$mode $1"; shift; done
+    shift
+    clip $pt $w $h &&
+    "$AVS2YUV" "$D/$pt.avs" -csp auto "$@" "$D/out" && ref $pt $w $h 5 $mode | cmp - "$D/out"
+}
+y4m()
+{
+    [ -n "$have_python" ] || { echo "no python3"; return 77; }
+    header=$(head -n 1 "$TMP/ref.y4m")
+    echo "$header" | grep -q "^YUV4MPEG2 W64 H48 F25:1 Ip A0:0 C420mpeg2" &&
+    ref YV12 64 48 5 frames > "$D/frames" &&
+    tail -c +$((${#header} + 2)) "$TMP/ref.y4m" | cmp - "$D/frames"
+}
+tiles()
+{
+    [ -n "$have_python" ] || { echo "no python3"; return 77; }
+    clip YV12 64 48 && "$AVS2YUV" "$D/YV12.avs" -raw -tiles 2x2 -o "$D/%d.yuv" &&
+    ref YV12 64 48 5 crop 32:24:0:0 | cmp - "$D/0.yuv" && ref YV12 64 48 5 crop 32:24:32:0 | cmp - "$D/1.yuv" &&
+    ref YV12 64 48 5 crop 32:24:0:24 | cmp - "$D/2.yuv" && ref YV12 64 48 5 crop 32:24:32:24 | cmp - "$D/3.yuv"
+}
+planes()
+{
+    [ -n "$have_python" ] || { echo "no python3"; return 77; }
+    clip YV12 64 48 && "$AVS2YUV" "$D/YV12.avs" -planes -o "$D/%c.yuv" &&
+    ref YV12 64 48 5 plane 0 | cmp - "$D/y.yuv" && ref YV12 64 48 5 plane 1 | cmp - "$D/u.yuv" &&
+    ref YV12 64 48 5 plane 2 | cmp - "$D/v.yuv"
+}
+resume()
+{
+    "$AVS2YUV" "$TMP/clip.avs" -frames 3 -resume -o "$D/r.y4m" &&
+    printf "FRAME\npart of a frame" >> "$D/r.y4m" &&
+    "$AVS2YUV" "$TMP/clip.avs" -resume -o "$D/r.y4m" && cmp "$D/r.y4m" "$TMP/ref.y4m"
+}
+resume_raw()
+{
+    [ -n "$have_python" ] || { echo "no python3"; return 77; }
+    clip YV12 64 48 && "$AVS2YUV" "$D/YV12.avs" -frames 3 -raw -resume -o "$D/r.yuv" &&
+    "$AVS2YUV" "$D/YV12.avs" -raw -resume -o "$D/r.yuv" && ref YV12 64 48 5 raw | cmp - "$D/r.yuv" &&
+    cp "$TMP/ref.y4m" "$D/y.y4m" && ! "$AVS2YUV" "$D/YV12.avs" -raw -resume -o "$D/y.y4m" &&
+    cmp "$D/y.y4m" "$TMP/ref.y4m"
+}
+hashes()
+{
+    [ -n "$have_python" ] || { echo "no python3"; return 77; }
+    clip YV12 64 48 bias=1 &&
+    "$AVS2YUV" "$TMP/clip.avs" -hash "$D/hash.txt" && ref YV12 64 48 5 hash | cmp - "$D/hash.txt" &&
+    "$AVS2YUV" "$TMP/clip.avs" -hash-compare "$D/hash.txt" &&
+    ! "$AVS2YUV" "$D/YV12.avs" -hash-compare "$D/hash.txt"
+}
+compare()
+{
+    [ -n "$have_python" ] || { echo "no python3"; return 77; }
+    clip YV12 64 48 bias=1 &&
+    "$AVS2YUV" "$D/YV12.avs" -compare "$TMP/clip.avs" > "$D/log" 2>&1 && cat "$D/log" &&
+    grep -q "Global:$(ref YV12 64 48 5 psnr 1)\$" "$D/log" &&
+    "$AVS2YUV" "$TMP/clip.avs" -compare "$TMP/clip.avs" 2>&1 | grep -q "SSIM .*All:1.00000"
+}
+pipe_shell() { "$AVS2YUV" "$TMP/clip.avs" -pipe "cat > '$D/p.y4m'" && cmp "$D/p.y4m" "$TMP/ref.y4m"; }
+pipe_spawn() { "$AVS2YUV" "$TMP/clip.avs" -pipe "dd of='$D/p.y4m' status=none" && cmp "$D/p.y4m" "$TMP/ref.y4m"; }
+pipe_backslash()
+{
+    "$AVS2YUV" "$TMP/clip.avs" -pipe "dd of=\"$D/a\\b\\\"c\" status=none" && cmp "$D/a\\b\"c" "$TMP/ref.y4m"
+}
+spill()
+{
+    "$AVS2YUV" "$TMP/clip.avs" -queue 1 -spill "$D" -pipe "sleep 1; cat > '$D/p.y4m'" > "$D/log" 2>&1 &&
+    cat "$D/log" && grep -q "went through the spill file" "$D/log" && cmp "$D/p.y4m" "$TMP/ref.y4m"
+}
+ffvhuff()
+{
+    [ -n "$have_python" ] || { echo "no python3"; return 77; }
+    "$AVS2YUV" "$TMP/clip.avs" -hfyu "$D/out.avi" && ref YV12 64 48 5 ffvhuff "$D/out.avi" > "$D/out.yuv" &&
+    ref YV12 64 48 5 raw | cmp - "$D/out.yuv" &&
+    clip YV16 64 48 && "$AVS2YUV" "$D/YV16.avs" -csp auto -format ffvhuff -o "$D/422.avi" &&
+    ref YV16 64 48 5 ffvhuff "$D/422.avi" > "$D/422.yuv" && ref YV16 64 48 5 raw | cmp - "$D/422.yuv"
+}
+
+printf "width=60\nheight=48\npixel_type=YV12\nframes=5\npitch_align=0\n" > "$TMP/align.avs"
+"$AVS2YUV" "$TMP/align.avs" -raw -align 64 -o "$TMP/align.raw" 2> /dev/null || { echo "the reference render failed" >&2; exit 1; }
+
+run "outfile listed twice" dup_name
+run "outfile and a link to it" dup_link
+run "outfile and a link made before it" dup_dangling_link
+run "/dev/null, then an outfile" copy_from_device
+run "a FIFO, then an outfile" copy_from_fifo
+run "/dev/null twice, different formats" device_twice
+run "-align, pitch matching the outfile" align_direct
+run "-align, pitch matching, queued" align_queued
+run "10-bit outfiles at 21 scaled heights" many_stages
+run "y4m" y4m
+run "raw 10-bit 4:4:4" format YUV444P10 64 48 raw -- -raw -o
+run "nv12" format YV12 64 48 nv12 -- -format nv12 -o
+run "p010" format YUV420P10 64 48 nv12 -- -format p010 -o
+run "uyvy" format YV16 64 48 uyvy -- -format uyvy -o
+run "y210" format YUV422P10 64 48 y210 -- -format y210 -o
+run "v210, a width padded to 48 pixels" format YUV422P10 100 48 v210 -- -format v210 -o
+run "-crop" format YV12 64 48 crop 32:16:8:4 -- -raw -crop 32:16:8:4 -o
+run "-fields both" format YV12 64 48 fields both -- -raw -fields both -o
+run "-fields top" format YV12 64 48 fields top -- -raw -fields top -o
+run "-tiles" tiles
+run "-planes" planes
+run "-alpha" format YUVA420 64 48 raw -- -raw -alpha -o
+run "-alpha-o" format YUVA420P10 64 48 plane 3 -- -raw -alpha-o
+run "-resume" resume
+run "-resume raw, needing its checkpoint" resume_raw
+run "-hash, -hash-compare" hashes
+run "-compare" compare
+run "-pipe through a shell" pipe_shell
+run "-pipe, spawned" pipe_spawn
+run "-pipe, a backslash in double quotes" pipe_backslash
+run "-spill" spill
+run "ffvhuff, decoded" ffvhuff
+
+exit $failed
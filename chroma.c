@@ -0,0 +1,252 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef _MSC_VER
+#define strcasecmp _stricmp
+#else
+#include <strings.h>
+#endif
+#include "chroma.h"
+#include "pixel.h"
+
+#define PAD 16 // samples of edge extension around rows fed to hfilter
+
+typedef struct
+{
+    int taps;
+    int offset; // position of the first tap relative to 2*x
+    int16_t coef[FILTER_MAX_TAPS];
+} filter_t;
+
+struct chroma_resampler_t
+{
+    pixel_funcs_t pf;
+    threadpool_t *pool;
+    int src_width, src_height; // source chroma plane size
+    int dst_width, dst_height;
+    int component_size;
+    int max;
+    int hdecimate, vdecimate;
+    int interlaced;
+    filter_t hfilter;
+    filter_t vfilter[2]; // per field, [0] only for progressive
+    int jobs;
+    uint8_t **tmp;       // one padded row per job
+    picture_t *dst;
+    const picture_t *src;
+};
+
+static const char * const filter_names[] = {"avs", "point", "box", "bilinear", "bicubic", NULL};
+static const char * const loc_names[] = {"mpeg2", "center", NULL};
+
+int chroma_filter_from_name(const char *name)
+{
+    for(int i = 0; filter_names[i]; i++)
+        if(!strcasecmp(name, filter_names[i]))
+            return i;
+    return -1;
+}
+
+int chroma_loc_from_name(const char *name)
+{
+    for(int i = 0; loc_names[i]; i++)
+        if(!strcasecmp(name, loc_names[i]))
+            return i;
+    return -1;
+}
+
+static double kernel(int filter, double x)
+{
+    x = fabs(x);
+    switch(filter) {
+        case CHROMA_FILTER_BOX:
+            return x < 0.5;
+        case CHROMA_FILTER_BILINEAR:
+            return x < 1 ? 1 - x : 0;
+        case CHROMA_FILTER_BICUBIC: {
+            /* Mitchell-Netravali, same as AviSynth's default chromaresample */
+            const double b = 1./3, c = 1./3;
+            if(x < 1)
+                return ((12 - 9*b - 6*c) * x*x*x + (-18 + 12*b + 6*c) * x*x + (6 - 2*b)) / 6;
+            if(x < 2)
+                return ((-b - 6*c) * x*x*x + (6*b + 30*c) * x*x + (-12*b - 48*c) * x + (8*b + 24*c)) / 6;
+            return 0;
+        }
+    }
+    return 0;
+}
+
+static double kernel_support(int filter)
+{
+    return filter == CHROMA_FILTER_BICUBIC ? 2 : filter == CHROMA_FILTER_BILINEAR ? 1 : 0.5;
+}
+
+/* builds the 2:1 decimation filter for an output sample located at
+   input position 2*x + center. Weights are the kernel (stretched by the
+   decimation factor) integrated over each input sample's footprint */
+static void make_filter(filter_t *f, int filter, double center, int even_taps)
+{
+    double w[FILTER_MAX_TAPS] = {0};
+    memset(f, 0, sizeof(*f));
+    if(filter == CHROMA_FILTER_POINT) {
+        f->offset = (int)floor(center) + (center - floor(center) > 0.5);
+        f->taps = 1;
+        f->coef[0] = 1 << FILTER_SHIFT;
+    } else {
+        double radius = 2 * kernel_support(filter);
+        int first = (int)ceil(center - radius - 0.5);
+        int last = (int)floor(center + radius + 0.5);
+        double sum = 0;
+        for(int k = first; k <= last && k - first < FILTER_MAX_TAPS; k++) {
+            const int steps = 32;
+            double acc = 0;
+            for(int i = 0; i < steps; i++)
+                acc += kernel(filter, (k - 0.5 + (i + 0.5) / steps - center) / 2);
+            w[k-first] = acc / steps;
+            sum += w[k-first];
+        }
+        /* quantize, then put the rounding error on the largest tap */
+        int taps = MIN(last - first + 1, FILTER_MAX_TAPS);
+        int total = 0, peak = 0;
+        int16_t q[FILTER_MAX_TAPS] = {0};
+        for(int t = 0; t < taps; t++) {
+            q[t] = (int16_t)floor(w[t] / sum * (1 << FILTER_SHIFT) + 0.5);
+            total += q[t];
+            if(w[t] > w[peak])
+                peak = t;
+        }
+        q[peak] += (1 << FILTER_SHIFT) - total;
+        int lo = 0, hi = taps - 1;
+        while(lo < hi && !q[lo])
+            lo++;
+        while(hi > lo && !q[hi])
+            hi--;
+        f->offset = first + lo;
+        f->taps = hi - lo + 1;
+        memcpy(f->coef, q + lo, f->taps * sizeof(int16_t));
+    }
+    if(even_taps && (f->taps & 1))
+        f->coef[f->taps++] = 0;
+}
+
+static void pad_row(uint8_t *row, int width, int component_size)
+{
+    if(component_size == 2) {
+        uint16_t *r = (uint16_t*)row;
+        for(int i = 1; i <= PAD; i++) {
+            r[-i] = r[0];
+            r[width-1+i] = r[width-1];
+        }
+    } else {
+        memset(row - PAD, row[0], PAD);
+        memset(row + width, row[width-1], PAD);
+    }
+}
+
+static void resample_stripe(void *arg, int job)
+{
+    chroma_resampler_t *h = arg;
+    int cs = h->component_size;
+    int y0 = h->dst_height * job / h->jobs;
+    int y1 = h->dst_height * (job + 1) / h->jobs;
+    uint8_t *tmp = h->tmp[job] + PAD * cs;
+    for(int p = 1; p < 3; p++) {
+        const uint8_t *src = h->src->plane[p];
+        intptr_t src_stride = h->src->stride[p];
+        uint8_t *dst = h->dst->plane[p] + y0 * h->dst->stride[p];
+        for(int y = y0; y < y1; y++, dst += h->dst->stride[p]) {
+            uint8_t *row = h->hdecimate ? tmp : dst;
+            if(h->vdecimate) {
+                const uint8_t *rows[FILTER_MAX_TAPS];
+                int field = h->interlaced ? y & 1 : 0;
+                const filter_t *f = &h->vfilter[field];
+                for(int t = 0; t < f->taps; t++) {
+                    if(h->interlaced) {
+                        int line = 2 * (y >> 1) + f->offset + t;
+                        line = MIN(MAX(line, 0), h->src_height / 2 - 1);
+                        rows[t] = src + (2 * line + field) * src_stride;
+                    } else {
+                        int line = 2 * y + f->offset + t;
+                        line = MIN(MAX(line, 0), h->src_height - 1);
+                        rows[t] = src + line * src_stride;
+                    }
+                }
+                h->pf.vfilter[cs-1](row, rows, f->coef, f->taps, h->src_width, h->max);
+            } else
+                memcpy(row, src + y * src_stride, h->src_width * cs);
+            if(h->hdecimate) {
+                pad_row(tmp, h->src_width, cs);
+                h->pf.hfilter[cs-1](dst, tmp + h->hfilter.offset * cs, h->hfilter.coef,
+                                    h->hfilter.taps, h->dst_width, h->max);
+            }
+        }
+    }
+}
+
+chroma_resampler_t *chroma_resampler_create(int width, int height, int depth, int src_csp, int dst_csp,
+                                            int filter, int loc, int interlaced, threadpool_t *pool)
+{
+    chroma_resampler_t *h = calloc(1, sizeof(chroma_resampler_t));
+    if(!h)
+        return NULL;
+    picture_t src_fmt = {0}, dst_fmt = {0};
+    picture_set_csp(&src_fmt, src_csp);
+    picture_set_csp(&dst_fmt, dst_csp);
+    pixel_init(&h->pf);
+    h->pool = pool;
+    h->component_size = depth > 8 ? 2 : 1;
+    h->max = (1 << depth) - 1;
+    h->interlaced = interlaced;
+    h->src_width = width >> src_fmt.h_shift;
+    h->src_height = height >> src_fmt.v_shift;
+    h->dst_width = width >> dst_fmt.h_shift;
+    h->dst_height = height >> dst_fmt.v_shift;
+    h->hdecimate = dst_fmt.h_shift > src_fmt.h_shift;
+    h->vdecimate = dst_fmt.v_shift > src_fmt.v_shift;
+    make_filter(&h->hfilter, filter, loc == CHROMA_LOC_CENTER ? 0.5 : 0, 1);
+    if(interlaced) {
+        /* 4:2:0 field chroma sits 1/4 (top) or 3/4 (bottom) of the way between two field lines */
+        make_filter(&h->vfilter[0], filter, 0.25, 0);
+        make_filter(&h->vfilter[1], filter, 0.75, 0);
+    } else
+        make_filter(&h->vfilter[0], filter, 0.5, 0);
+
+    h->jobs = MIN(threadpool_threads(pool) * 4, MAX(h->dst_height / 8, 1));
+    h->tmp = calloc(h->jobs, sizeof(uint8_t*));
+    if(!h->tmp)
+        goto fail;
+    for(int i = 0; i < h->jobs; i++) {
+        h->tmp[i] = aligned_malloc((h->src_width + 2 * PAD) * h->component_size + NATIVE_ALIGN);
+        if(!h->tmp[i])
+            goto fail;
+    }
+    return h;
+fail:
+    chroma_resampler_delete(h);
+    return NULL;
+}
+
+void chroma_resampler_delete(chroma_resampler_t *h)
+{
+    if(!h)
+        return;
+    if(h->tmp)
+        for(int i = 0; i < h->jobs; i++)
+            aligned_free(h->tmp[i]);
+    free(h->tmp);
+    free(h);
+}
+
+void chroma_resample(chroma_resampler_t *h, picture_t *dst, const picture_t *src)
+{
+    h->dst = dst;
+    h->src = src;
+    threadpool_run(h->pool, resample_stripe, h, h->jobs);
+}
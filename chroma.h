@@ -0,0 +1,37 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#ifndef AVS2YUV_CHROMA_H
+#define AVS2YUV_CHROMA_H
+
+#include "common.h"
+#include "threads.h"
+
+#define CHROMA_FILTER_AVS      0 // let AviSynth's ConvertTo*() do it
+#define CHROMA_FILTER_POINT    1
+#define CHROMA_FILTER_BOX      2
+#define CHROMA_FILTER_BILINEAR 3
+#define CHROMA_FILTER_BICUBIC  4
+
+#define CHROMA_LOC_MPEG2  0 // horizontally co-sited with luma
+#define CHROMA_LOC_CENTER 1 // horizontally between luma samples (jpeg/mpeg1)
+
+typedef struct chroma_resampler_t chroma_resampler_t;
+
+int chroma_filter_from_name(const char *name);
+int chroma_loc_from_name(const char *name);
+
+/* decimates the chroma planes of src_csp pictures down to dst_csp.
+   interlaced pictures are filtered per field with 4:2:0 field siting */
+chroma_resampler_t *chroma_resampler_create(int width, int height, int depth, int src_csp, int dst_csp,
+                                            int filter, int loc, int interlaced, threadpool_t *pool);
+void chroma_resampler_delete(chroma_resampler_t *h);
+
+/* dst must have its chroma planes allocated, the luma plane is left alone */
+void chroma_resample(chroma_resampler_t *h, picture_t *dst, const picture_t *src);
+
+#endif
@@ -0,0 +1,206 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "common.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <unistd.h>
+#include <time.h>
+#endif
+
+void *aligned_malloc(size_t size)
+{
+#ifdef _WIN32
+    return _aligned_malloc(size, NATIVE_ALIGN);
+#else
+    void *ptr;
+    if(posix_memalign(&ptr, NATIVE_ALIGN, size))
+        return NULL;
+    return ptr;
+#endif
+}
+
+void aligned_free(void *ptr)
+{
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+int cpu_count(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return si.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+int64_t clock_ns(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (int64_t)((double)now.QuadPart * 1e9 / freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+void json_put_string(FILE *fh, const char *str)
+{
+    fputc('"', fh);
+    for(; *str; str++) {
+        unsigned char c = *str;
+        if(c == '"' || c == '\\')
+            fprintf(fh, "\\%c", c);
+        else if(c < 0x20)
+            fprintf(fh, "\\u%04x", c);
+        else
+            fputc(c, fh);
+    }
+    fputc('"', fh);
+}
+
+void picture_set_csp(picture_t *pic, int csp)
+{
+    pic->csp = csp;
+    pic->planes = csp == CSP_I400 ? 1 : 3;
+    pic->h_shift = csp == CSP_I420 || csp == CSP_I422;
+    pic->v_shift = csp == CSP_I420;
+}
+
+int picture_alloc(picture_t *pic)
+{
+    size_t size = 0;
+    intptr_t offset[4];
+    for(int p = 0; p < 4; p++) {
+        if(p >= pic->planes && !(p == 3 && pic->alpha))
+            continue;
+        pic->stride[p] = ALIGN(picture_plane_width(pic, p) * pic->component_size, NATIVE_ALIGN);
+        offset[p] = size;
+        size += pic->stride[p] * picture_plane_height(pic, p);
+    }
+    pic->buffer = aligned_malloc(size);
+    if(!pic->buffer)
+        return -1;
+    for(int p = 0; p < 4; p++)
+        if(p < pic->planes || (p == 3 && pic->alpha))
+            pic->plane[p] = pic->buffer + offset[p];
+    return 0;
+}
+
+void picture_crop(picture_t *dst, const picture_t *src, int x, int y, int width, int height)
+{
+    *dst = *src;
+    dst->buffer = NULL;
+    dst->width = width;
+    dst->height = height;
+    for(int p = 0; p < 4; p++) {
+        if(p >= src->planes && !(p == 3 && src->alpha))
+            continue;
+        int chroma = p == 1 || p == 2;
+        dst->plane[p] += (y >> (chroma ? src->v_shift : 0)) * src->stride[p] +
+                         (x >> (chroma ? src->h_shift : 0)) * src->component_size;
+    }
+}
+
+void picture_field(picture_t *dst, const picture_t *src, int bottom)
+{
+    *dst = *src;
+    dst->buffer = NULL;
+    dst->height = src->height / 2;
+    for(int p = 0; p < 4; p++) {
+        if(p >= src->planes && !(p == 3 && src->alpha))
+            continue;
+        if(bottom)
+            dst->plane[p] += src->stride[p];
+        dst->stride[p] = src->stride[p] * 2;
+    }
+}
+
+void picture_free(picture_t *pic)
+{
+    aligned_free(pic->buffer);
+    pic->buffer = NULL;
+}
+
+typedef struct freebuf_t
+{
+    struct freebuf_t *next;
+} freebuf_t;
+
+struct bufpool_t
+{
+    pthread_mutex_t lock;
+    size_t size;
+    freebuf_t *free;
+};
+
+bufpool_t *bufpool_create(size_t size)
+{
+    bufpool_t *pool = calloc(1, sizeof(bufpool_t));
+    if(!pool)
+        return NULL;
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->size = ALIGN(MAX(size, sizeof(freebuf_t)), NATIVE_ALIGN);
+    return pool;
+}
+
+void bufpool_delete(bufpool_t *pool)
+{
+    if(!pool)
+        return;
+    while(pool->free) {
+        freebuf_t *next = pool->free->next;
+        aligned_free(pool->free);
+        pool->free = next;
+    }
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+uint8_t *bufpool_get(bufpool_t *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    freebuf_t *buf = pool->free;
+    if(buf)
+        pool->free = buf->next;
+    pthread_mutex_unlock(&pool->lock);
+    return buf ? (uint8_t*)buf : aligned_malloc(pool->size);
+}
+
+void bufpool_put(bufpool_t *pool, uint8_t *buf)
+{
+    if(!buf)
+        return;
+    freebuf_t *f = (freebuf_t*)buf;
+    pthread_mutex_lock(&pool->lock);
+    f->next = pool->free;
+    pool->free = f;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+size_t bufpool_size(const bufpool_t *pool)
+{
+    return pool->size;
+}
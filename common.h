@@ -0,0 +1,83 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#ifndef AVS2YUV_COMMON_H
+#define AVS2YUV_COMMON_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define CSP_AUTO (-1)
+#define CSP_I400 1
+#define CSP_I420 2
+#define CSP_I422 3
+#define CSP_I444 4
+
+#define NATIVE_ALIGN 64
+
+/* outfiles a run can write, each -o, ladder rung, tile or plane being one */
+#define MAX_FH 64
+
+#define ALIGN(x, a) (((x) + ((a)-1)) & ~((intptr_t)(a)-1))
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+/* a view of one video frame: either the planes of an AVS_VideoFrame
+   or buffers of our own, already converted to the output format */
+typedef struct
+{
+    int csp;
+    int width, height;    // luma dimensions
+    int depth;            // bits per component
+    int component_size;   // bytes per component
+    int planes;
+    int h_shift, v_shift; // chroma subsampling
+    int alpha;            // plane[3] is alpha
+    uint8_t *plane[4];
+    intptr_t stride[4];   // in bytes
+    uint8_t *buffer;      // owned memory (picture_alloc), NULL for views
+} picture_t;
+
+static inline int picture_plane_width(const picture_t *pic, int p)
+{
+    return (p == 1 || p == 2) ? pic->width >> pic->h_shift : pic->width;
+}
+
+static inline int picture_plane_height(const picture_t *pic, int p)
+{
+    return (p == 1 || p == 2) ? pic->height >> pic->v_shift : pic->height;
+}
+
+/* fills in csp dependent fields (planes count, chroma shifts) */
+void picture_set_csp(picture_t *pic, int csp);
+/* allocates NATIVE_ALIGN aligned planes (and alpha) for the format described by pic */
+int picture_alloc(picture_t *pic);
+void picture_free(picture_t *pic);
+/* makes dst a view of the width x height rectangle at x, y of src,
+   which must be aligned to the chroma subsampling */
+void picture_crop(picture_t *dst, const picture_t *src, int x, int y, int width, int height);
+/* makes dst a view of the top (bottom = 0) or bottom field of src */
+void picture_field(picture_t *dst, const picture_t *src, int bottom);
+
+/* thread-safe free list of equally sized NATIVE_ALIGN aligned buffers */
+typedef struct bufpool_t bufpool_t;
+bufpool_t *bufpool_create(size_t size);
+void bufpool_delete(bufpool_t *pool);
+uint8_t *bufpool_get(bufpool_t *pool);
+void bufpool_put(bufpool_t *pool, uint8_t *buf);
+size_t bufpool_size(const bufpool_t *pool);
+
+void *aligned_malloc(size_t size);
+void aligned_free(void *ptr);
+int cpu_count(void);
+/* monotonic, from an arbitrary start */
+int64_t clock_ns(void);
+/* writes str as a quoted JSON string */
+void json_put_string(FILE *fh, const char *str);
+
+#endif
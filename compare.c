@@ -0,0 +1,251 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "compare.h"
+#include "pixel.h"
+#include "trace.h"
+
+static const char plane_names[] = "yuv";
+
+struct compare_t
+{
+    threadpool_t *pool;
+    pixel_funcs_t pf;
+    int planes;
+    int stripes;                // per plane, a job each
+    double max2;                // the largest sample value squared
+    double c1, c2;              // SSIM's constants, scaled to sums over a window
+    int64_t pixels[3];
+    int64_t windows[3];
+    /* the frame being measured */
+    const picture_t *pic, *ref;
+    int64_t (*blocks)[4];       // 2 rows of 4x4 block sums per job
+    int block_row;
+    uint64_t *sse;              // per job
+    double *ssim;
+    /* the log */
+    FILE *log;
+    const char *log_name;
+    int failed;
+    /* the summary, [3] being the whole frame */
+    const char *reference;
+    int frames;
+    double psnr_sum[4];
+    double ssim_sum[4];
+    uint64_t sse_total;
+};
+
+static double psnr(const compare_t *h, uint64_t sse, int64_t pixels)
+{
+    if(!sse)
+        return 100.;
+    return MIN(10. * log10(h->max2 * pixels / sse), 100.);
+}
+
+/* s are the sums of the 64 samples of a window, as ssim_4x4 makes them */
+static double ssim_end(const compare_t *h, const int64_t *s)
+{
+    double s1 = s[0], s2 = s[1], ss = s[2], s12 = s[3];
+    double vars = ss * 64 - s1 * s1 - s2 * s2;
+    double covar = s12 * 64 - s1 * s2;
+    return (2 * s1 * s2 + h->c1) * (2 * covar + h->c2) / ((s1 * s1 + s2 * s2 + h->c1) * (vars + h->c2));
+}
+
+static void compare_stripe(void *arg, int job)
+{
+    compare_t *h = arg;
+    int p = job / h->stripes;
+    int s = job % h->stripes;
+    const picture_t *a = h->pic;
+    const picture_t *b = h->ref;
+    int width = picture_plane_width(a, p);
+    int height = picture_plane_height(a, p);
+    int k = a->component_size - 1;
+
+    uint64_t sse = 0;
+    for(int y = height * s / h->stripes; y < height * (s+1) / h->stripes; y++)
+        sse += h->pf.ssd[k](a->plane[p] + (intptr_t)y * a->stride[p], b->plane[p] + (intptr_t)y * b->stride[p], width);
+    h->sse[job] = sse;
+
+    /* window row r is made of the block rows r and r+1, the second being kept for the next one */
+    int blocks = width / 4;
+    int rows = height / 4 - 1;
+    int r0 = rows * s / h->stripes;
+    int r1 = rows * (s+1) / h->stripes;
+    int64_t (*cur)[4] = h->blocks + (size_t)job * 2 * h->block_row;
+    int64_t (*next)[4] = cur + h->block_row;
+    double ssim = 0;
+    for(int r = r0; r < r1; r++) {
+        if(r == r0)
+            h->pf.ssim_4x4[k](cur, a->plane[p] + (intptr_t)4 * r * a->stride[p], a->stride[p],
+                              b->plane[p] + (intptr_t)4 * r * b->stride[p], b->stride[p], blocks);
+        else {
+            int64_t (*tmp)[4] = cur;
+            cur = next;
+            next = tmp;
+        }
+        h->pf.ssim_4x4[k](next, a->plane[p] + (intptr_t)4 * (r+1) * a->stride[p], a->stride[p],
+                          b->plane[p] + (intptr_t)4 * (r+1) * b->stride[p], b->stride[p], blocks);
+        for(int x = 0; x < blocks - 1; x++) {
+            int64_t w[4];
+            for(int i = 0; i < 4; i++)
+                w[i] = cur[x][i] + cur[x+1][i] + next[x][i] + next[x+1][i];
+            ssim += ssim_end(h, w);
+        }
+    }
+    h->ssim[job] = ssim;
+}
+
+compare_t *compare_create(const char *log, const char *reference, const picture_t *format, threadpool_t *pool)
+{
+    for(int p = 0; p < format->planes; p++)
+        if(picture_plane_width(format, p) < 8 || picture_plane_height(format, p) < 8) {
+            fprintf(stderr, "error: %dx%d is too small to compare, planes have to be at least 8x8\n",
+                    format->width, format->height);
+            return NULL;
+        }
+    compare_t *h = calloc(1, sizeof(compare_t));
+    if(!h) {
+        fprintf(stderr, "error: malloc failed\n");
+        return NULL;
+    }
+    h->pool = pool;
+    pixel_init(&h->pf);
+    h->planes = format->planes;
+    h->stripes = threadpool_threads(pool);
+    double max = (1 << format->depth) - 1;
+    h->max2 = max * max;
+    h->c1 = .01 * .01 * h->max2 * 64 * 64;
+    h->c2 = .03 * .03 * h->max2 * 64 * 63;
+    for(int p = 0; p < h->planes; p++) {
+        int width = picture_plane_width(format, p);
+        int height = picture_plane_height(format, p);
+        h->pixels[p] = (int64_t)width * height;
+        h->windows[p] = (int64_t)(width / 4 - 1) * (height / 4 - 1);
+    }
+    h->reference = reference;
+
+    int jobs = h->planes * h->stripes;
+    h->block_row = format->width / 4;
+    h->blocks = malloc((size_t)jobs * 2 * h->block_row * sizeof(*h->blocks));
+    h->sse = malloc(jobs * sizeof(uint64_t));
+    h->ssim = malloc(jobs * sizeof(double));
+    if(!h->blocks || !h->sse || !h->ssim) {
+        fprintf(stderr, "error: malloc failed\n");
+        goto fail;
+    }
+    if(log) {
+        h->log_name = log;
+        h->log = !strcmp(log, "-") ? stdout : fopen(log, "w");
+        if(!h->log) {
+            fprintf(stderr, "error: failed to create/open \"%s\"\n", log);
+            goto fail;
+        }
+        fprintf(h->log, "frame");
+        for(int p = 0; p < h->planes; p++)
+            fprintf(h->log, " psnr_%c", plane_names[p]);
+        if(h->planes > 1)
+            fprintf(h->log, " psnr");
+        for(int p = 0; p < h->planes; p++)
+            fprintf(h->log, " ssim_%c", plane_names[p]);
+        if(h->planes > 1)
+            fprintf(h->log, " ssim");
+        fputc('\n', h->log);
+    }
+    return h;
+fail:
+    compare_close(h, NULL);
+    return NULL;
+}
+
+int compare_frame(compare_t *h, int frame, const picture_t *pic, const picture_t *ref)
+{
+    h->pic = pic;
+    h->ref = ref;
+    int64_t start = trace_start();
+    threadpool_run(h->pool, compare_stripe, h, h->planes * h->stripes);
+    trace_span("compare", NULL, frame, start);
+
+    double frame_psnr[4] = {0}, frame_ssim[4] = {0};
+    uint64_t sse_all = 0;
+    int64_t pixels_all = 0;
+    double ssim_all = 0;
+    for(int p = 0; p < h->planes; p++) {
+        uint64_t sse = 0;
+        double ssim = 0;
+        for(int s = 0; s < h->stripes; s++) {
+            sse += h->sse[p * h->stripes + s];
+            ssim += h->ssim[p * h->stripes + s];
+        }
+        frame_psnr[p] = psnr(h, sse, h->pixels[p]);
+        frame_ssim[p] = ssim / h->windows[p];
+        sse_all += sse;
+        pixels_all += h->pixels[p];
+        ssim_all += frame_ssim[p] * h->pixels[p];
+    }
+    /* the planes weighed by their samples */
+    frame_psnr[3] = psnr(h, sse_all, pixels_all);
+    frame_ssim[3] = ssim_all / pixels_all;
+    for(int i = 0; i < 4; i++) {
+        h->psnr_sum[i] += frame_psnr[i];
+        h->ssim_sum[i] += frame_ssim[i];
+    }
+    h->sse_total += sse_all;
+    h->frames++;
+
+    if(!h->log)
+        return 0;
+    fprintf(h->log, "%d", frame);
+    for(int p = 0; p < h->planes; p++)
+        fprintf(h->log, " %.3f", frame_psnr[p]);
+    if(h->planes > 1)
+        fprintf(h->log, " %.3f", frame_psnr[3]);
+    for(int p = 0; p < h->planes; p++)
+        fprintf(h->log, " %.5f", frame_ssim[p]);
+    if(h->planes > 1)
+        fprintf(h->log, " %.5f", frame_ssim[3]);
+    fputc('\n', h->log);
+    if(ferror(h->log)) {
+        h->failed = 1;
+        fprintf(stderr, "error: failed to write to \"%s\"\n", h->log_name);
+        return -1;
+    }
+    return 0;
+}
+
+int compare_close(compare_t *h, FILE *fh)
+{
+    int ret = h->failed ? -1 : 0;
+    if(h->log && h->log != stdout && fclose(h->log) && !h->failed) {
+        fprintf(stderr, "error: failed to write to \"%s\"\n", h->log_name);
+        ret = -1;
+    }
+    if(fh && h->frames) {
+        int64_t pixels = 0;
+        for(int p = 0; p < h->planes; p++)
+            pixels += h->pixels[p];
+        fprintf(fh, "compare: %d frames against \"%s\"\ncompare: PSNR", h->frames, h->reference);
+        for(int p = 0; p < h->planes; p++)
+            fprintf(fh, " %c:%.3f", plane_names[p] - 'a' + 'A', h->psnr_sum[p] / h->frames);
+        if(h->planes > 1)
+            fprintf(fh, " Avg:%.3f", h->psnr_sum[3] / h->frames);
+        fprintf(fh, " Global:%.3f\ncompare: SSIM", psnr(h, h->sse_total, pixels * h->frames));
+        for(int p = 0; p < h->planes; p++)
+            fprintf(fh, " %c:%.5f", plane_names[p] - 'a' + 'A', h->ssim_sum[p] / h->frames);
+        double ssim = h->ssim_sum[3] / h->frames;
+        fprintf(fh, " All:%.5f (%.3f dB)\n", ssim, 1. - ssim > 1e-10 ? -10. * log10(1. - ssim) : 100.);
+    }
+    free(h->blocks);
+    free(h->sse);
+    free(h->ssim);
+    free(h);
+    return ret;
+}
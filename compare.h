@@ -0,0 +1,31 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#ifndef AVS2YUV_COMPARE_H
+#define AVS2YUV_COMPARE_H
+
+#include "common.h"
+#include "threads.h"
+
+/* PSNR and SSIM of each plane of each frame of the clip against a reference clip of the
+   same format. A frame's planes are split into stripes measured in parallel. SSIM is
+   taken over 8x8 windows on a 4 pixel grid, as x264 does, and PSNR of identical planes
+   is capped at 100 dB.
+
+   The log, when asked for, is a line "frame psnr_y ... ssim_y ..." followed by a line per
+   frame with its number and the PSNR and SSIM of each plane and of the whole frame */
+typedef struct compare_t compare_t;
+
+/* log may be NULL or "-" for stdout. reference names the reference clip in the report.
+   format gives the size and planes of the pictures, which must be at least 8x8 */
+compare_t *compare_create(const char *log, const char *reference, const picture_t *format, threadpool_t *pool);
+/* measures pic against ref and logs the frame, failing when the log can't be written */
+int compare_frame(compare_t *h, int frame, const picture_t *pic, const picture_t *ref);
+/* prints the averages to fh (unless NULL) and frees h */
+int compare_close(compare_t *h, FILE *fh);
+
+#endif
@@ -1 +1 @@
-gcc avs2yuv.c -o avs2yuv.exe -O3 -ffast-math -Wall -Wshadow -Wempty-body -I. -std=gnu99 -fomit-frame-pointer -s -fno-tree-vectorize -fno-zero-initialized-in-bss -Wl,--large-address-aware -Wl,--nxcompat -Wl,--dynamicbase
+gcc avs2yuv.c common.c threads.c pixel.c chroma.c convert.c scale.c output.c ffvhuff.c avi.c writer.c bench.c trace.c perf.c stats.c hash.c compare.c cpu.c selftest.c -o avs2yuv.exe -O3 -ffast-math -Wall -Wshadow -Wempty-body -I. -std=gnu99 -fomit-frame-pointer -s -fno-tree-vectorize -fno-zero-initialized-in-bss -Wl,--large-address-aware -pthread -Wl,--nxcompat -Wl,--dynamicbase
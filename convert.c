@@ -0,0 +1,261 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#include <stdlib.h>
+#include <string.h>
+#include "convert.h"
+#include "chroma.h"
+#include "scale.h"
+#include "pixel.h"
+
+/* the source, then at most a chroma, a scaled and a depth stage per outfile */
+#define MAX_STAGES (1 + 3 * MAX_FH)
+
+typedef struct
+{
+    int src;                       // stage this one converts from
+    int level;                     // 0 for the source, 1 + level of src otherwise
+    chroma_resampler_t *resampler; // chroma decimation, NULL when only chroma planes are dropped
+    scaler_t *scaler;              // resizing of all planes
+    int depth_change;              // all planes converted from src->depth to pic.depth
+    picture_t pic;
+    int needed;
+} stage_t;
+
+struct convert_t
+{
+    pixel_funcs_t pf;
+    threadpool_t *pool;
+    int chroma_filter, chroma_loc, scale_filter, interlaced;
+    int jobs;                      // row blocks of depth conversions
+    int stages;
+    stage_t stage[MAX_STAGES];
+    int run[MAX_STAGES];           // stages of the level being run
+};
+
+typedef struct
+{
+    convert_t *h;
+    stage_t *s;
+} depth_job_t;
+
+convert_t *convert_create(const picture_t *fmt, int chroma_filter, int chroma_loc, int scale_filter,
+                          int interlaced, threadpool_t *pool)
+{
+    convert_t *h = calloc(1, sizeof(convert_t));
+    if(!h)
+        return NULL;
+    pixel_init(&h->pf);
+    h->pool = pool;
+    h->chroma_filter = chroma_filter;
+    h->chroma_loc = chroma_loc;
+    h->scale_filter = scale_filter;
+    h->interlaced = interlaced;
+    h->jobs = MIN(threadpool_threads(pool) * 4, MAX(fmt->height / 16, 1));
+    h->stage[0].pic = *fmt;
+    h->stage[0].pic.buffer = NULL;
+    h->stages = 1;
+    return h;
+}
+
+void convert_delete(convert_t *h)
+{
+    if(!h)
+        return;
+    for(int i = 1; i < h->stages; i++) {
+        chroma_resampler_delete(h->stage[i].resampler);
+        scaler_delete(h->stage[i].scaler);
+        picture_free(&h->stage[i].pic);
+    }
+    free(h);
+}
+
+static int find_stage(const convert_t *h, int width, int height, int csp, int depth)
+{
+    for(int i = 0; i < h->stages; i++) {
+        const picture_t *pic = &h->stage[i].pic;
+        if(pic->width == width && pic->height == height && pic->csp == csp && pic->depth == depth)
+            return i;
+    }
+    return -1;
+}
+
+/* the smallest existing csp/depth stage at least width x height */
+static int find_larger_stage(const convert_t *h, int width, int height, int csp, int depth)
+{
+    int best = -1;
+    for(int i = 0; i < h->stages; i++) {
+        const picture_t *pic = &h->stage[i].pic;
+        if(pic->width >= width && pic->height >= height && pic->csp == csp && pic->depth == depth &&
+           (best < 0 || (int64_t)pic->width * pic->height <
+                        (int64_t)h->stage[best].pic.width * h->stage[best].pic.height))
+            best = i;
+    }
+    return best;
+}
+
+static stage_t *new_stage(convert_t *h, int src)
+{
+    if(h->stages == MAX_STAGES)
+        return NULL;
+    stage_t *s = &h->stage[h->stages];
+    s->src = src;
+    s->level = h->stage[src].level + 1;
+    s->pic = h->stage[src].pic;
+    s->pic.buffer = NULL;
+    return s;
+}
+
+int convert_add(convert_t *h, int width, int height, int csp, int depth)
+{
+    int id = find_stage(h, width, height, csp, depth);
+    if(id >= 0)
+        return id;
+    const picture_t *fmt = &h->stage[0].pic;
+    if(depth != fmt->depth) {
+        /* size and chroma first, at the source depth, so that they can be shared too */
+        int src = convert_add(h, width, height, csp, fmt->depth);
+        if(src < 0)
+            return -1;
+        stage_t *s = new_stage(h, src);
+        if(!s)
+            return -1;
+        s->depth_change = 1;
+        s->pic.depth = depth;
+        s->pic.component_size = depth > 8 ? 2 : 1;
+        if(picture_alloc(&s->pic))
+            return -1;
+        return h->stages++;
+    }
+    if(width != fmt->width || height != fmt->height) {
+        /* scaled after chroma decimation, from the nearest larger picture */
+        if(h->interlaced && height != fmt->height)
+            return -1;
+        int src = find_larger_stage(h, width, height, csp, depth);
+        if(src < 0)
+            src = convert_add(h, fmt->width, fmt->height, csp, depth);
+        if(src < 0)
+            return -1;
+        stage_t *s = new_stage(h, src);
+        if(!s)
+            return -1;
+        s->pic.width = width;
+        s->pic.height = height;
+        s->scaler = scaler_create(&h->stage[src].pic, width, height, h->scale_filter, h->chroma_loc, h->pool);
+        if(!s->scaler)
+            return -1;
+        if(picture_alloc(&s->pic)) {
+            scaler_delete(s->scaler);
+            s->scaler = NULL;
+            return -1;
+        }
+        return h->stages++;
+    }
+    if(csp > fmt->csp || h->chroma_filter == CHROMA_FILTER_AVS)
+        return -1;
+    stage_t *s = new_stage(h, 0);
+    if(!s)
+        return -1;
+    picture_set_csp(&s->pic, csp);
+    if(csp != CSP_I400) {
+        s->resampler = chroma_resampler_create(fmt->width, fmt->height, fmt->depth, fmt->csp, csp,
+                                               h->chroma_filter, h->chroma_loc, h->interlaced, h->pool);
+        if(!s->resampler)
+            return -1;
+        if(picture_alloc(&s->pic)) {
+            chroma_resampler_delete(s->resampler);
+            s->resampler = NULL;
+            return -1;
+        }
+    }
+    return h->stages++;
+}
+
+static void convert_rows(const convert_t *h, const picture_t *dst, const picture_t *src, int p, int y0, int y1)
+{
+    int w = picture_plane_width(src, p);
+    const uint8_t *s = src->plane[p] + y0 * src->stride[p];
+    uint8_t *d = dst->plane[p] + y0 * dst->stride[p];
+    for(int y = y0; y < y1; y++, s += src->stride[p], d += dst->stride[p]) {
+        if(src->component_size == 1)
+            h->pf.depth_up_8(d, s, w, dst->depth - 8);
+        else if(dst->depth > src->depth)
+            h->pf.copy_shl_16(d, s, w, dst->depth - src->depth);
+        else
+            h->pf.depth_down[dst->component_size-1](d, s, w, src->depth - dst->depth, (1 << dst->depth) - 1);
+    }
+}
+
+static void depth_stripe(void *arg, int job)
+{
+    depth_job_t *j = arg;
+    const picture_t *src = &j->h->stage[j->s->src].pic;
+    for(int p = 0; p < 4; p++) {
+        if(p >= src->planes && !(p == 3 && src->alpha))
+            continue;
+        int h = picture_plane_height(src, p);
+        convert_rows(j->h, &j->s->pic, src, p, h * job / j->h->jobs, h * (job + 1) / j->h->jobs);
+    }
+}
+
+static void run_stage(void *arg, int job)
+{
+    convert_t *h = arg;
+    stage_t *s = &h->stage[h->run[job]];
+    const picture_t *src = &h->stage[s->src].pic;
+    if(s->depth_change) {
+        depth_job_t j = {h, s};
+        threadpool_run(h->pool, depth_stripe, &j, h->jobs);
+        return;
+    }
+    if(s->scaler) {
+        scale_picture(s->scaler, &s->pic, src);
+        return;
+    }
+    /* luma and alpha are the source's own */
+    s->pic.plane[0] = src->plane[0];
+    s->pic.stride[0] = src->stride[0];
+    s->pic.plane[3] = src->plane[3];
+    s->pic.stride[3] = src->stride[3];
+    if(s->resampler)
+        chroma_resample(s->resampler, &s->pic, src);
+}
+
+void convert_need(convert_t *h, int stage)
+{
+    h->stage[stage].needed = 1;
+}
+
+void convert_frame(convert_t *h, const picture_t *src)
+{
+    picture_t *pic = &h->stage[0].pic;
+    for(int p = 0; p < 4; p++) {
+        pic->plane[p] = src->plane[p];
+        pic->stride[p] = src->stride[p];
+    }
+    /* stages are added after the ones they depend on */
+    int levels = 0;
+    for(int i = h->stages - 1; i > 0; i--)
+        if(h->stage[i].needed) {
+            h->stage[h->stage[i].src].needed = 1;
+            levels = MAX(levels, h->stage[i].level);
+        }
+    for(int level = 1; level <= levels; level++) {
+        int runs = 0;
+        for(int i = 1; i < h->stages; i++)
+            if(h->stage[i].needed && h->stage[i].level == level)
+                h->run[runs++] = i;
+        threadpool_run(h->pool, run_stage, h, runs);
+    }
+    for(int i = 0; i < h->stages; i++)
+        h->stage[i].needed = 0;
+}
+
+const picture_t *convert_picture(const convert_t *h, int stage)
+{
+    return &h->stage[stage].pic;
+}
@@ -0,0 +1,38 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#ifndef AVS2YUV_CONVERT_H
+#define AVS2YUV_CONVERT_H
+
+#include "common.h"
+#include "threads.h"
+
+/* the per frame conversions of the source picture into the size/csp/depth
+   combinations the outputs ask for. Every distinct combination is one stage,
+   computed once per frame however many outputs use it, and stages which
+   don't depend on each other run in parallel */
+typedef struct convert_t convert_t;
+
+/* fmt describes the source pictures, alpha included if fmt->alpha */
+convert_t *convert_create(const picture_t *fmt, int chroma_filter, int chroma_loc, int scale_filter,
+                          int interlaced, threadpool_t *pool);
+void convert_delete(convert_t *h);
+
+/* returns the stage making width x height csp/depth, 0 being the source itself,
+   or -1 if that isn't possible (chroma upsampling, CHROMA_FILTER_AVS, vertical
+   scaling of interlaced pictures). Scaled stages are made from the smallest
+   stage added before that is at least as large, so adding sizes in decreasing
+   order cascades them */
+int convert_add(convert_t *h, int width, int height, int csp, int depth);
+
+/* marks a stage as used by the next convert_frame */
+void convert_need(convert_t *h, int stage);
+/* runs the needed stages on src and clears the marks */
+void convert_frame(convert_t *h, const picture_t *src);
+const picture_t *convert_picture(const convert_t *h, int stage);
+
+#endif
@@ -0,0 +1,104 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#include <stdint.h>
+#include <string.h>
+#include "cpu.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__i386__) || defined(__x86_64__))
+#include <cpuid.h>
+#define HAVE_CPUID 1
+#else
+#define HAVE_CPUID 0
+#endif
+
+static const struct
+{
+    int flag;
+    const char *name;
+} levels[CPU_LEVELS] = {
+    {CPU_SSE2,   "sse2"},
+    {CPU_SSSE3,  "ssse3"},
+    {CPU_SSE42,  "sse4.2"},
+    {CPU_AVX2,   "avx2"},
+    {CPU_AVX512, "avx512"},
+};
+
+static int cpu = -1;
+
+#if HAVE_CPUID
+/* the register state the OS saves on context switches */
+static uint64_t xgetbv(void)
+{
+    uint32_t lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((uint64_t)hi << 32) | lo;
+}
+#endif
+
+int cpu_detect(void)
+{
+    int flags = 0;
+#if HAVE_CPUID
+    unsigned eax, ebx, ecx, edx;
+    if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return 0;
+    if(edx & (1 << 26))
+        flags |= CPU_SSE2;
+    if(ecx & (1 << 9))
+        flags |= CPU_SSSE3;
+    if(ecx & (1 << 20))
+        flags |= CPU_SSE42;
+    /* AVX needs OSXSAVE and the OS saving the xmm and ymm halves (XCR0 bits 1-2) */
+    if(!(ecx & (1 << 27)) || !(ecx & (1 << 28)))
+        return flags;
+    uint64_t xcr0 = xgetbv();
+    unsigned ebx7 = 0;
+    if(__get_cpuid_count(7, 0, &eax, &ebx7, &ecx, &edx)) {
+        if((xcr0 & 0x06) == 0x06 && (ebx7 & (1 << 5)))
+            flags |= CPU_AVX2;
+        /* AVX-512 also needs the opmask and zmm state saved (XCR0 bits 5-7) */
+        if((xcr0 & 0xe6) == 0xe6 && (ebx7 & (1 << 16)) && (ebx7 & (1 << 30)) && (ebx7 & (1u << 31)))
+            flags |= CPU_AVX512;
+    }
+#endif
+    return flags;
+}
+
+int cpu_from_name(const char *name)
+{
+    if(!strcmp(name, "c"))
+        return 0;
+    int flags = 0;
+    for(int i = 0; i < CPU_LEVELS; i++) {
+        flags |= levels[i].flag;
+        if(!strcmp(name, levels[i].name))
+            return flags;
+    }
+    return -1;
+}
+
+const char *cpu_name(int flags)
+{
+    const char *name = "c";
+    for(int i = 0; i < CPU_LEVELS; i++)
+        if(flags & levels[i].flag)
+            name = levels[i].name;
+    return name;
+}
+
+int cpu_get(void)
+{
+    if(cpu < 0)
+        cpu = cpu_detect();
+    return cpu;
+}
+
+void cpu_set(int flags)
+{
+    cpu = flags;
+}
@@ -0,0 +1,32 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#ifndef AVS2YUV_CPU_H
+#define AVS2YUV_CPU_H
+
+#include <stddef.h>
+
+/* instruction sets the pixel kernels are written for, each level implying the ones below */
+#define CPU_SSE2   0x01
+#define CPU_SSSE3  0x02
+#define CPU_SSE42  0x04
+#define CPU_AVX2   0x08
+#define CPU_AVX512 0x10 // F, BW and VL
+#define CPU_LEVELS 5
+
+/* what the CPU and the OS (for the AVX registers) support, by cpuid; 0 when not x86 */
+int cpu_detect(void);
+/* the instruction sets up to a level by name: c, sse2, ssse3, sse4.2, avx2 or avx512;
+   -1 for an unknown name */
+int cpu_from_name(const char *name);
+/* the name of the highest level in flags, "c" for none */
+const char *cpu_name(int flags);
+/* the instruction sets pixel_init binds kernels for: cpu_detect() until cpu_set is called */
+int cpu_get(void);
+void cpu_set(int flags);
+
+#endif
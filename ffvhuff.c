@@ -0,0 +1,385 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#include <stdlib.h>
+#include <string.h>
+#include "ffvhuff.h"
+#include "pixel.h"
+
+#define VLC_N 256
+#define PRED_MEDIAN 2
+
+typedef struct
+{
+    int y0, y1;                  // luma rows coded by the slice
+    uint32_t hist[3][VLC_N];
+    uint64_t offset, bits;       // where its part of the bitstream goes
+    size_t first, last;          // words shared with the neighbouring slices
+    uint32_t edge[2];
+} slice_t;
+
+typedef struct
+{
+    uint32_t *buf;
+    uint64_t acc;
+    int n;                       // bits of acc not yet written
+    size_t pos;
+    slice_t *s;
+} bitwriter_t;
+
+struct ffvhuff_t
+{
+    pixel_funcs_t pf;
+    threadpool_t *pool;
+    int width, height, csp;
+    int cwidth, cheight;
+    uint8_t *res[3];             // prediction residuals of the planes
+    uint8_t len[3][VLC_N];
+    uint32_t code[3][VLC_N];
+    uint8_t table[3*VLC_N];      // the frame's code lengths, run-length coded
+    int table_size;
+    uint8_t extradata[4 + 3*3];
+    int slices;
+    slice_t *slice;
+    uint32_t *buf;
+    size_t buf_words;
+    const picture_t *pic;
+};
+
+int ffvhuff_check(int width, int height, int csp, int depth)
+{
+    return (csp == CSP_I420 || csp == CSP_I422) && depth == 8 && !(width & 3) && !(height & 1) && height >= 4 ? 0 : -1;
+}
+
+/* the chroma row coded along with luma row y, -1 for 4:2:0's luma only rows.
+   The first two rows carry chroma rows 0 and 1, later ones chroma row y/2 on even rows */
+static int chroma_row(const ffvhuff_t *h, int y)
+{
+    if(h->csp == CSP_I422 || y < 2)
+        return y;
+    return (y & 1) || y == 2 ? -1 : y / 2;
+}
+
+static inline int mid_pred(int a, int b, int c)
+{
+    return MAX(MIN(a, b), MIN(MAX(a, b), c));
+}
+
+/* each row carries on from the end of the previous one: the first row is left predicted,
+   the start of the second one too (left pixels), everything else median predicted */
+static void predict_row(const ffvhuff_t *h, uint8_t *dst, const uint8_t *cur, intptr_t stride, int r, int w, int left)
+{
+    const uint8_t *top = cur - stride;
+    if(!r) {
+        dst[0] = cur[0];
+        for(int x = 1; x < w; x++)
+            dst[x] = cur[x] - cur[x-1];
+        return;
+    }
+    if(r == 1) {
+        dst[0] = cur[0] - top[w-1];
+        for(int x = 1; x < left; x++)
+            dst[x] = cur[x] - cur[x-1];
+    } else {
+        int l = top[w-1], t = top[0];
+        dst[0] = cur[0] - mid_pred(l, t, (l + t - top[w-1-stride]) & 0xFF);
+        left = 1;
+    }
+    h->pf.median_residual(dst + left, top + left, cur + left, w - left);
+}
+
+static void count(uint32_t *hist, const uint8_t *res, int n)
+{
+    for(int x = 0; x < n; x++)
+        hist[res[x]]++;
+}
+
+/* residuals and symbol counts of the slice's rows */
+static void predict_slice(void *arg, int job)
+{
+    ffvhuff_t *h = arg;
+    slice_t *s = &h->slice[job];
+    const picture_t *pic = h->pic;
+    memset(s->hist, 0, sizeof(s->hist));
+    for(int y = s->y0; y < s->y1; y++) {
+        uint8_t *res = h->res[0] + (size_t)y * h->width;
+        predict_row(h, res, pic->plane[0] + y * pic->stride[0], pic->stride[0], y, h->width, 4);
+        /* the first pixels are stored raw */
+        count(s->hist[0], res + (y ? 0 : 2), h->width - (y ? 0 : 2));
+        int c = chroma_row(h, y);
+        if(c < 0)
+            continue;
+        for(int p = 1; p < 3; p++) {
+            res = h->res[p] + (size_t)c * h->cwidth;
+            predict_row(h, res, pic->plane[p] + c * pic->stride[p], pic->stride[p], c, h->cwidth, 2);
+            count(s->hist[p], res + !c, h->cwidth - !c);
+        }
+    }
+}
+
+/* lengths of a Huffman code of all symbols shorter than 32 bits. As FFmpeg does,
+   the rare symbols are made less rare until the code is short enough */
+static void make_lengths(uint8_t *len, const uint64_t *stats)
+{
+    for(uint64_t offset = 1; ; offset <<= 1) {
+        uint64_t w[2*VLC_N];
+        int order[VLC_N], parent[2*VLC_N];
+        for(int i = 0; i < VLC_N; i++) {
+            w[i] = (stats[i] << 14) + offset;
+            int j = i;
+            for(; j > 0 && w[order[j-1]] > w[i]; j--)
+                order[j] = order[j-1];
+            order[j] = i;
+        }
+        /* merging from the queue of sorted leaves and the one of new nodes, whose weights grow */
+        int leaf = 0, node = VLC_N;
+        for(int next = VLC_N; next < 2*VLC_N - 1; next++) {
+            int pick[2];
+            for(int k = 0; k < 2; k++)
+                pick[k] = leaf < VLC_N && (node == next || w[order[leaf]] <= w[node]) ? order[leaf++] : node++;
+            w[next] = w[pick[0]] + w[pick[1]];
+            parent[pick[0]] = parent[pick[1]] = next;
+        }
+        int depth[2*VLC_N], max = 0;
+        depth[2*VLC_N - 2] = 0;
+        for(int i = 2*VLC_N - 3; i >= 0; i--)
+            depth[i] = depth[parent[i]] + 1;
+        for(int i = 0; i < VLC_N; i++) {
+            len[i] = depth[i];
+            max = MAX(max, depth[i]);
+        }
+        if(max < 32)
+            return;
+    }
+}
+
+/* canonical codes, assigned from the longest */
+static void make_codes(uint32_t *code, const uint8_t *len)
+{
+    uint32_t bits = 0;
+    for(int l = 32; l > 0; l--) {
+        for(int i = 0; i < VLC_N; i++)
+            if(len[i] == l)
+                code[i] = bits++;
+        bits >>= 1;
+    }
+}
+
+/* runs of equal lengths: 3-bit count and 5-bit length, or a zero count followed by an 8-bit one */
+static int store_table(uint8_t *buf, const uint8_t *len)
+{
+    int size = 0;
+    for(int i = 0; i < VLC_N;) {
+        int val = len[i], repeat = 0;
+        for(; i < VLC_N && len[i] == val && repeat < 255; i++)
+            repeat++;
+        if(repeat > 7) {
+            buf[size++] = val;
+            buf[size++] = repeat;
+        } else
+            buf[size++] = val | repeat << 5;
+    }
+    return size;
+}
+
+/* the bitstream is MSB first in 32-bit words. Words a slice shares with its
+   neighbours are kept aside and merged once all slices are written */
+static inline void put_word(bitwriter_t *w, uint32_t v)
+{
+    if(w->pos == w->s->first)
+        w->s->edge[0] = v;
+    else
+        w->buf[w->pos] = v;
+    w->pos++;
+}
+
+static inline void put_bits(bitwriter_t *w, int n, uint32_t bits)
+{
+    w->acc = w->acc << n | bits;
+    w->n += n;
+    if(w->n >= 32) {
+        w->n -= 32;
+        put_word(w, (uint32_t)(w->acc >> w->n));
+    }
+}
+
+static void flush_bits(bitwriter_t *w)
+{
+    if(!w->n)
+        return;
+    uint32_t v = (uint32_t)(w->acc << (32 - w->n));
+    if(w->pos == w->s->first)
+        w->s->edge[0] |= v;
+    else {
+        w->s->last = w->pos;
+        w->s->edge[1] = v;
+    }
+}
+
+static void write_slice(void *arg, int job)
+{
+    ffvhuff_t *h = arg;
+    slice_t *s = &h->slice[job];
+    if(!s->bits)
+        return;
+    bitwriter_t w = {h->buf, 0, s->offset & 31, s->offset >> 5, s};
+    s->first = w.pos;
+    s->last = (size_t)-1;
+    s->edge[0] = s->edge[1] = 0;
+    int y = s->y0;
+    if(!y) {
+        /* the frame's tables, then the first pixels raw */
+        const picture_t *pic = h->pic;
+        for(int i = 0; i < h->table_size; i++)
+            put_bits(&w, 8, h->table[i]);
+        put_bits(&w, 8, pic->plane[2][0]);
+        put_bits(&w, 8, pic->plane[0][1]);
+        put_bits(&w, 8, pic->plane[1][0]);
+        put_bits(&w, 8, pic->plane[0][0]);
+    }
+    for(; y < s->y1; y++) {
+        const uint8_t *ry = h->res[0] + (size_t)y * h->width;
+        int c = chroma_row(h, y);
+        if(c < 0) {
+            for(int x = 0; x < h->width; x++)
+                put_bits(&w, h->len[0][ry[x]], h->code[0][ry[x]]);
+            continue;
+        }
+        const uint8_t *ru = h->res[1] + (size_t)c * h->cwidth;
+        const uint8_t *rv = h->res[2] + (size_t)c * h->cwidth;
+        for(int x = !y; x < h->cwidth; x++) {
+            put_bits(&w, h->len[0][ry[2*x]], h->code[0][ry[2*x]]);
+            put_bits(&w, h->len[1][ru[x]], h->code[1][ru[x]]);
+            put_bits(&w, h->len[0][ry[2*x+1]], h->code[0][ry[2*x+1]]);
+            put_bits(&w, h->len[2][rv[x]], h->code[2][rv[x]]);
+        }
+    }
+    flush_bits(&w);
+}
+
+ffvhuff_t *ffvhuff_create(int width, int height, int csp, threadpool_t *pool)
+{
+    ffvhuff_t *h = calloc(1, sizeof(ffvhuff_t));
+    if(!h)
+        return NULL;
+    pixel_init(&h->pf);
+    h->pool = pool;
+    h->width = width;
+    h->height = height;
+    h->csp = csp;
+    h->cwidth = width / 2;
+    h->cheight = csp == CSP_I420 ? height / 2 : height;
+    for(int p = 0; p < 3; p++) {
+        h->res[p] = malloc(p ? (size_t)h->cwidth * h->cheight : (size_t)width * height);
+        if(!h->res[p])
+            goto fail;
+    }
+    /* the longest codes are 31 bits */
+    size_t samples = (size_t)width * height + 2 * (size_t)h->cwidth * h->cheight;
+    h->buf_words = (sizeof(h->table) * 8 + 32 + samples * 31) / 32 + 2;
+    h->buf = malloc(h->buf_words * 4);
+    h->slices = MIN(threadpool_threads(pool) * 4, MAX(height / 16, 1));
+    h->slice = calloc(h->slices, sizeof(slice_t));
+    if(!h->buf || !h->slice)
+        goto fail;
+    for(int i = 0; i < h->slices; i++) {
+        h->slice[i].y0 = height * i / h->slices;
+        h->slice[i].y1 = height * (i + 1) / h->slices;
+    }
+
+    /* predictor, bits per pixel, progressive with per frame tables ("context"), version 2.
+       The tables given here are a flat 8-bit code, each frame brings its own */
+    uint8_t *e = h->extradata;
+    e[0] = PRED_MEDIAN;
+    e[1] = ffvhuff_bit_count(h);
+    e[2] = 0x20 | 0x40;
+    e[3] = 0;
+    uint8_t flat[VLC_N];
+    memset(flat, 8, VLC_N);
+    for(int p = 0, size = 4; p < 3; p++)
+        size += store_table(e + size, flat);
+    return h;
+fail:
+    ffvhuff_delete(h);
+    return NULL;
+}
+
+void ffvhuff_delete(ffvhuff_t *h)
+{
+    if(!h)
+        return;
+    for(int p = 0; p < 3; p++)
+        free(h->res[p]);
+    free(h->buf);
+    free(h->slice);
+    free(h);
+}
+
+int ffvhuff_bit_count(const ffvhuff_t *h)
+{
+    return h->csp == CSP_I420 ? 12 : 16;
+}
+
+const uint8_t *ffvhuff_extradata(const ffvhuff_t *h, int *size)
+{
+    *size = sizeof(h->extradata);
+    return h->extradata;
+}
+
+size_t ffvhuff_encode(ffvhuff_t *h, const picture_t *pic, const uint8_t **data)
+{
+    h->pic = pic;
+    threadpool_run(h->pool, predict_slice, h, h->slices);
+
+    h->table_size = 0;
+    for(int p = 0; p < 3; p++) {
+        uint64_t stats[VLC_N] = {0};
+        for(int i = 0; i < h->slices; i++)
+            for(int v = 0; v < VLC_N; v++)
+                stats[v] += h->slice[i].hist[p][v];
+        make_lengths(h->len[p], stats);
+        make_codes(h->code[p], h->len[p]);
+        h->table_size += store_table(h->table + h->table_size, h->len[p]);
+    }
+
+    /* the size of each slice's bits is known from its counts, so all can be written at once */
+    uint64_t offset = 0;
+    for(int i = 0; i < h->slices; i++) {
+        slice_t *s = &h->slice[i];
+        s->offset = offset;
+        s->bits = s->y0 ? 0 : h->table_size * 8 + 32;
+        for(int p = 0; p < 3; p++)
+            for(int v = 0; v < VLC_N; v++)
+                s->bits += (uint64_t)s->hist[p][v] * h->len[p][v];
+        offset += s->bits;
+    }
+    threadpool_run(h->pool, write_slice, h, h->slices);
+    for(int i = 0; i < h->slices; i++)
+        if(h->slice[i].bits) {
+            h->buf[h->slice[i].first] = 0;
+            if(h->slice[i].last != (size_t)-1)
+                h->buf[h->slice[i].last] = 0;
+        }
+    for(int i = 0; i < h->slices; i++)
+        if(h->slice[i].bits) {
+            h->buf[h->slice[i].first] |= h->slice[i].edge[0];
+            if(h->slice[i].last != (size_t)-1)
+                h->buf[h->slice[i].last] |= h->slice[i].edge[1];
+        }
+
+    /* FFmpeg's packet size, counting the tables in bytes, the bitstream with 31 bits of padding */
+    size_t words = (h->table_size + (offset - h->table_size * 8 + 31) / 8) / 4;
+    size_t used = (offset + 31) / 32;
+    memset(h->buf + used, 0, (words - used) * 4);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    /* the words are stored little-endian */
+    for(size_t i = 0; i < words; i++)
+        h->buf[i] = __builtin_bswap32(h->buf[i]);
+#endif
+    *data = (const uint8_t*)h->buf;
+    return words * 4;
+}
@@ -0,0 +1,31 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#ifndef AVS2YUV_FFVHUFF_H
+#define AVS2YUV_FFVHUFF_H
+
+#include "common.h"
+#include "threads.h"
+
+/* lossless FFVHuff encoder (FFmpeg's HuffYUV variant, version 2 bitstream):
+   median prediction with Huffman tables made for each frame.
+   Prediction and the writing of the bitstream are split into row slices run on threads */
+typedef struct ffvhuff_t ffvhuff_t;
+
+/* 8-bit 4:2:0 or 4:2:2, width a multiple of 4 and an even height of at least 4 */
+int ffvhuff_check(int width, int height, int csp, int depth);
+ffvhuff_t *ffvhuff_create(int width, int height, int csp, threadpool_t *pool);
+void ffvhuff_delete(ffvhuff_t *h);
+
+/* what the stream header (AVI BITMAPINFOHEADER) needs */
+int ffvhuff_bit_count(const ffvhuff_t *h);
+const uint8_t *ffvhuff_extradata(const ffvhuff_t *h, int *size);
+
+/* returns the size of the coded frame, *data staying valid until the next call */
+size_t ffvhuff_encode(ffvhuff_t *h, const picture_t *pic, const uint8_t **data);
+
+#endif
@@ -0,0 +1,240 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hash.h"
+#include "pixel.h"
+#include "trace.h"
+
+static const char plane_names[] = "YUVA";
+
+struct hash_t
+{
+    threadpool_t *pool;
+    pixel_funcs_t pf;
+    int plane[4];               // the picture planes hashed, in manifest order
+    int planes;
+    char header[64];
+    FILE *manifest;
+    const char *manifest_name;
+    /* the frames of a batch */
+    int batch, count;
+    int *frame;
+    picture_t *pic;
+    uint32_t (*crc)[4];
+    /* the golden manifest */
+    const char *golden_name;
+    uint32_t (*golden)[4];
+    uint8_t *golden_has;        // the frame is in it
+    int golden_frames;
+    int compared, differ, missing;
+    int first_frame, first_plane; // of the first mismatch, -1 for none / a missing frame
+    uint32_t first_crc, first_golden;
+    int failed;
+};
+
+static void hash_plane(void *arg, int job)
+{
+    hash_t *h = arg;
+    int i = job / h->planes;
+    int p = h->plane[job % h->planes];
+    const picture_t *pic = &h->pic[i];
+    size_t row = (size_t)picture_plane_width(pic, p) * pic->component_size;
+    int height = picture_plane_height(pic, p);
+    const uint8_t *src = pic->plane[p];
+    uint32_t crc = 0;
+    for(int y = 0; y < height; y++, src += pic->stride[p])
+        crc = h->pf.crc32c(crc, src, row);
+    h->crc[i][job % h->planes] = crc;
+}
+
+static int load_golden(hash_t *h, const char *filename)
+{
+    FILE *fh = fopen(filename, "r");
+    if(!fh) {
+        fprintf(stderr, "error: failed to open \"%s\"\n", filename);
+        return -1;
+    }
+    char line[256];
+    if(!fgets(line, sizeof(line), fh) || strncmp(line, h->header, strlen(h->header)) ||
+       (line[strlen(h->header)] != '\n' && line[strlen(h->header)] != '\r')) {
+        line[strcspn(line, "\r\n")] = 0;
+        fprintf(stderr, "error: \"%s\" is a manifest of \"%s\", the clip is \"%s\"\n", filename, line, h->header);
+        fclose(fh);
+        return -1;
+    }
+    while(fgets(line, sizeof(line), fh)) {
+        char *p = line, *end;
+        long frame = strtol(p, &end, 10);
+        if(end == p || frame < 0 || frame >= (1 << 30))
+            continue;
+        if(frame >= h->golden_frames) {
+            int frames = MAX(frame + 1, h->golden_frames * 2);
+            uint32_t (*golden)[4] = realloc(h->golden, frames * sizeof(*golden));
+            uint8_t *has = realloc(h->golden_has, frames);
+            if(golden)
+                h->golden = golden;
+            if(has)
+                h->golden_has = has;
+            if(!golden || !has) {
+                fprintf(stderr, "error: malloc failed\n");
+                fclose(fh);
+                return -1;
+            }
+            memset(has + h->golden_frames, 0, frames - h->golden_frames);
+            h->golden_frames = frames;
+        }
+        for(int i = 0; i < h->planes; i++) {
+            p = end;
+            h->golden[frame][i] = strtoul(p, &end, 16);
+            if(end == p)
+                break;
+            if(i == h->planes - 1)
+                h->golden_has[frame] = 1;
+        }
+    }
+    fclose(fh);
+    return 0;
+}
+
+hash_t *hash_create(const char *manifest, const char *golden, const picture_t *format, threadpool_t *pool)
+{
+    hash_t *h = calloc(1, sizeof(hash_t));
+    if(!h) {
+        fprintf(stderr, "error: malloc failed\n");
+        return NULL;
+    }
+    h->pool = pool;
+    pixel_init(&h->pf);
+    for(int p = 0; p < format->planes; p++)
+        h->plane[h->planes++] = p;
+    if(format->alpha)
+        h->plane[h->planes++] = 3;
+    int len = snprintf(h->header, sizeof(h->header), "crc32c %d %d %d ", format->width, format->height, format->depth);
+    for(int i = 0; i < h->planes; i++)
+        h->header[len++] = plane_names[h->plane[i]];
+    h->header[len] = 0;
+    h->first_frame = -1;
+
+    h->batch = threadpool_threads(pool) * 2;
+    h->frame = malloc(h->batch * sizeof(int));
+    h->pic = malloc(h->batch * sizeof(picture_t));
+    h->crc = malloc(h->batch * sizeof(*h->crc));
+    if(!h->frame || !h->pic || !h->crc) {
+        fprintf(stderr, "error: malloc failed\n");
+        goto fail;
+    }
+    if(golden) {
+        h->golden_name = golden;
+        if(load_golden(h, golden) < 0)
+            goto fail;
+    }
+    if(manifest) {
+        h->manifest_name = manifest;
+        h->manifest = !strcmp(manifest, "-") ? stdout : fopen(manifest, "w");
+        if(!h->manifest) {
+            fprintf(stderr, "error: failed to create/open \"%s\"\n", manifest);
+            goto fail;
+        }
+        fprintf(h->manifest, "%s\n", h->header);
+    }
+    return h;
+fail:
+    hash_close(h, NULL);
+    return NULL;
+}
+
+int hash_batch(const hash_t *h)
+{
+    return h->batch;
+}
+
+void hash_add(hash_t *h, int frame, const picture_t *pic)
+{
+    h->frame[h->count] = frame;
+    h->pic[h->count++] = *pic;
+}
+
+int hash_run(hash_t *h)
+{
+    int64_t start = trace_start();
+    threadpool_run(h->pool, hash_plane, h, h->count * h->planes);
+    trace_span("hash", NULL, h->frame[0], start);
+    for(int i = 0; i < h->count; i++) {
+        int frame = h->frame[i];
+        if(h->manifest) {
+            fprintf(h->manifest, "%d", frame);
+            for(int p = 0; p < h->planes; p++)
+                fprintf(h->manifest, " %08x", h->crc[i][p]);
+            fputc('\n', h->manifest);
+        }
+        if(!h->golden_name)
+            continue;
+        h->compared++;
+        if(frame >= h->golden_frames || !h->golden_has[frame]) {
+            if(h->first_frame < 0) {
+                h->first_frame = frame;
+                h->first_plane = -1;
+            }
+            h->missing++;
+            continue;
+        }
+        for(int p = 0; p < h->planes; p++) {
+            if(h->crc[i][p] == h->golden[frame][p])
+                continue;
+            if(h->first_frame < 0) {
+                h->first_frame = frame;
+                h->first_plane = p;
+                h->first_crc = h->crc[i][p];
+                h->first_golden = h->golden[frame][p];
+            }
+            h->differ++;
+            break;
+        }
+    }
+    h->count = 0;
+    if(h->manifest && ferror(h->manifest)) {
+        h->failed = 1;
+        fprintf(stderr, "error: failed to write to \"%s\"\n", h->manifest_name);
+        return -1;
+    }
+    return 0;
+}
+
+int hash_close(hash_t *h, FILE *fh)
+{
+    int ret = h->failed ? -1 : 0;
+    if(h->manifest && h->manifest != stdout && fclose(h->manifest) && !h->failed) {
+        fprintf(stderr, "error: failed to write to \"%s\"\n", h->manifest_name);
+        ret = -1;
+    }
+    if(h->golden_name && (h->differ || h->missing))
+        ret = -1;
+    if(fh && h->golden_name) {
+        if(!h->differ && !h->missing)
+            fprintf(fh, "hash: %d frames match \"%s\"\n", h->compared, h->golden_name);
+        else {
+            fprintf(fh, "hash: %d of %d frames differ from \"%s\"", h->differ, h->compared, h->golden_name);
+            if(h->missing)
+                fprintf(fh, ", %d more aren't in it", h->missing);
+            if(h->first_plane < 0)
+                fprintf(fh, "\nhash: the first is frame %d, which isn't in it\n", h->first_frame);
+            else
+                fprintf(fh, "\nhash: the first is frame %d, plane %c is %08x instead of %08x\n", h->first_frame,
+                        plane_names[h->plane[h->first_plane]], h->first_crc, h->first_golden);
+        }
+    }
+    free(h->frame);
+    free(h->pic);
+    free(h->crc);
+    free(h->golden);
+    free(h->golden_has);
+    free(h);
+    return ret;
+}
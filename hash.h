@@ -0,0 +1,35 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#ifndef AVS2YUV_HASH_H
+#define AVS2YUV_HASH_H
+
+#include "common.h"
+#include "threads.h"
+
+/* CRC32C of each plane of each frame, straight from the clip's planes with the pitch
+   padding left out, written to a manifest and/or checked against a golden one.
+   Frames are added in batches and hashed in parallel, a job per frame and plane.
+
+   The manifest is a line "crc32c width height depth planes" (planes being Y, YUV or
+   YUVA) followed by a line per frame: its number and the CRC of each plane in hex */
+typedef struct hash_t hash_t;
+
+/* manifest or golden may be NULL. format gives the size and planes of the pictures */
+hash_t *hash_create(const char *manifest, const char *golden, const picture_t *format, threadpool_t *pool);
+/* the frames hash_add takes before hash_run has to be called */
+int hash_batch(const hash_t *h);
+/* pic must stay valid until hash_run */
+void hash_add(hash_t *h, int frame, const picture_t *pic);
+/* hashes the frames added, writes them to the manifest and compares them to the golden one.
+   Fails when the manifest can't be written, not on a mismatch */
+int hash_run(hash_t *h);
+/* reports the comparison to fh (unless NULL) and frees h, failing if a frame differed
+   or wasn't in the golden manifest, or the manifest couldn't be written */
+int hash_close(hash_t *h, FILE *fh);
+
+#endif
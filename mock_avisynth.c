@@ -0,0 +1,468 @@
+// Mock AviSynth C interface for benchmarking and testing avs2yuv
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+// Builds a libavisynth.so which implements the subset of the C API that
+// internal_avs_load_library() looks up. Import() does not run a script:
+// it reads "key=value" pairs from the file (anything else is ignored) and
+// returns a clip of generated frames:
+//   width=1920 height=1080 pixel_type=YUV420P10 frames=250 fps=25/1
+//   pitch_align=64    row alignment of generated planes (0 = packed)
+//   pool=4            number of distinct pre-rendered frames
+//   latency_us=0      per-frame avs_get_frame delay
+//   jitter_us=0       random extra delay in [0, jitter_us)
+//   bias=0            added to every sample (to create a second, slightly different clip)
+//   fieldbased=0 tff=1 mt=0 error_at=-1
+// avs_get_cpu_flags reports every SIMD level, or MOCK_AVS_CPU_FLAGS when it is set.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "avisynth_c.h"
+
+struct AVS_ScriptEnvironment {
+    const char *error;
+    int cpu_flags;
+};
+
+typedef struct {
+    int width, height, pixel_type, frames;
+    unsigned fps_num, fps_den;
+    int pitch_align, pool, latency_us, jitter_us, bias;
+    int fieldbased, tff, mt, error_at;
+} mock_params_t;
+
+struct AVS_Clip {
+    volatile long refcount;
+    AVS_VideoInfo vi;
+    mock_params_t par;
+    AVS_VideoFrameBuffer *vfb;
+    AVS_VideoFrame *tmpl;
+    const char *error;
+    unsigned seed;
+    pthread_mutex_t lock;
+};
+
+static const struct {
+    const char *name;
+    int pixel_type;
+} pixel_types[] = {
+    {"YV12", AVS_CS_YV12}, {"I420", AVS_CS_YV12}, {"YV16", AVS_CS_YV16}, {"YV24", AVS_CS_YV24},
+    {"Y8", AVS_CS_Y8}, {"YUY2", AVS_CS_YUY2}, {"RGB24", AVS_CS_BGR24}, {"RGB32", AVS_CS_BGR32},
+    {"YUV420P8", AVS_CS_YV12}, {"YUV422P8", AVS_CS_YV16}, {"YUV444P8", AVS_CS_YV24},
+    {"YUV420P10", AVS_CS_YUV420P10}, {"YUV422P10", AVS_CS_YUV422P10}, {"YUV444P10", AVS_CS_YUV444P10},
+    {"YUV420P12", AVS_CS_YUV420P12}, {"YUV422P12", AVS_CS_YUV422P12}, {"YUV444P12", AVS_CS_YUV444P12},
+    {"YUV420P14", AVS_CS_YUV420P14}, {"YUV422P14", AVS_CS_YUV422P14}, {"YUV444P14", AVS_CS_YUV444P14},
+    {"YUV420P16", AVS_CS_YUV420P16}, {"YUV422P16", AVS_CS_YUV422P16}, {"YUV444P16", AVS_CS_YUV444P16},
+    {"Y10", AVS_CS_Y10}, {"Y12", AVS_CS_Y12}, {"Y14", AVS_CS_Y14}, {"Y16", AVS_CS_Y16},
+    {"YUVA420", AVS_CS_YUVA420}, {"YUVA422", AVS_CS_YUVA422}, {"YUVA444", AVS_CS_YUVA444},
+    {"YUVA420P10", AVS_CS_YUVA420P10}, {"YUVA422P10", AVS_CS_YUVA422P10}, {"YUVA444P10", AVS_CS_YUVA444P10},
+    {"YUVA420P16", AVS_CS_YUVA420P16}, {"YUVA422P16", AVS_CS_YUVA422P16}, {"YUVA444P16", AVS_CS_YUVA444P16},
+    {NULL, 0}
+};
+
+/* pixel type queries */
+
+static int is_planar_yuv(int t) { return (t & AVS_CS_PLANAR) && (t & (AVS_CS_YUV|AVS_CS_YUVA)) && !(t & AVS_CS_INTERLEAVED); }
+static int is_y(int t) { return (t & AVS_CS_GENERIC_Y) == AVS_CS_GENERIC_Y; }
+static int sub_w(int t) { return ((t & AVS_CS_SUB_WIDTH_MASK) == AVS_CS_SUB_WIDTH_1) ? 0 : 1; }
+static int sub_h(int t) { return ((t & AVS_CS_SUB_HEIGHT_MASK) == AVS_CS_SUB_HEIGHT_1) ? 0 : 1; }
+
+static int bits_of(int t)
+{
+    if(!(t & AVS_CS_PLANAR) && !is_y(t))
+        return (t & AVS_CS_SAMPLE_BITS_MASK) == AVS_CS_SAMPLE_BITS_16 ? 16 : 8;
+    switch(t & AVS_CS_SAMPLE_BITS_MASK) {
+        case AVS_CS_SAMPLE_BITS_10: return 10;
+        case AVS_CS_SAMPLE_BITS_12: return 12;
+        case AVS_CS_SAMPLE_BITS_14: return 14;
+        case AVS_CS_SAMPLE_BITS_16: return 16;
+        case AVS_CS_SAMPLE_BITS_32: return 32;
+    }
+    return 8;
+}
+
+static int with_bits(int generic, int bits)
+{
+    switch(bits) {
+        case 10: return generic | AVS_CS_SAMPLE_BITS_10;
+        case 12: return generic | AVS_CS_SAMPLE_BITS_12;
+        case 14: return generic | AVS_CS_SAMPLE_BITS_14;
+        case 16: return generic | AVS_CS_SAMPLE_BITS_16;
+    }
+    return generic | AVS_CS_SAMPLE_BITS_8;
+}
+
+static const char *pixel_type_name(int t)
+{
+    for(int i = 0; pixel_types[i].name; i++)
+        if(pixel_types[i].pixel_type == t)
+            return pixel_types[i].name;
+    return "unknown";
+}
+
+/* frame generation */
+
+static void mock_render(struct AVS_Clip *c)
+{
+    int t = c->vi.pixel_type;
+    int bits = bits_of(t);
+    int cs = bits > 8 ? 2 : 1;
+    int w = c->vi.width, h = c->vi.height;
+    int interleaved = !(t & AVS_CS_PLANAR);
+    int bpp = interleaved ? (avs_is_yuy2(&c->vi) ? 2 : (t == AVS_CS_BGR32 ? 4 : 3)) : cs;
+    int yuv = is_planar_yuv(t);
+    int chroma = yuv && !is_y(t);
+    int alpha = yuv && (t & AVS_CS_YUVA);
+    int sw = chroma ? sub_w(t) : 0, sh = chroma ? sub_h(t) : 0;
+    int align = c->par.pitch_align > 0 ? c->par.pitch_align : 1;
+    int pitch = (w * bpp + align - 1) / align * align;
+    int cw = w >> sw, ch = h >> sh;
+    int pitch_uv = chroma ? (cw * cs + align - 1) / align * align : 0;
+    size_t y_size = (size_t)pitch * h, uv_size = (size_t)pitch_uv * ch;
+    size_t frame_size = y_size + 2 * uv_size + (alpha ? y_size : 0);
+    int pool = c->par.pool > 0 ? c->par.pool : 1;
+
+    c->vfb = calloc(pool, sizeof(*c->vfb));
+    c->tmpl = calloc(pool, sizeof(*c->tmpl));
+    for(int n = 0; n < pool; n++) {
+        BYTE *data = aligned_alloc(64, (frame_size + 63) & ~(size_t)63);
+        /* pitch padding that isn't zero, as AviSynth's often isn't */
+        memset(data, 0xAA, frame_size);
+        AVS_VideoFrame *f = &c->tmpl[n];
+        c->vfb[n].data = data;
+        c->vfb[n].data_size = (int)frame_size;
+        c->vfb[n].refcount = 1;
+        f->vfb = &c->vfb[n];
+        f->offset = 0;
+        f->pitch = pitch;
+        f->row_size = w * bpp;
+        f->height = h;
+        if(chroma) {
+            f->offsetU = (int)y_size;
+            f->offsetV = (int)(y_size + uv_size);
+            f->pitchUV = pitch_uv;
+            f->row_sizeUV = cw * cs;
+            f->heightUV = ch;
+        }
+        if(alpha) {
+            f->offsetA = (int)(y_size + 2 * uv_size);
+            f->pitchA = pitch;
+            f->row_sizeA = w * cs;
+        }
+        int max = (1 << (bits > 16 ? 16 : bits)) - 1;
+        int planes = interleaved ? 1 : 1 + (chroma ? 2 : 0) + (alpha ? 1 : 0);
+        for(int p = 0; p < planes; p++) {
+            int pw = interleaved ? w * bpp : p == 1 || p == 2 ? cw : w;
+            int ph = p == 1 || p == 2 ? ch : h;
+            int pp = p == 1 || p == 2 ? pitch_uv : pitch;
+            BYTE *dst = data + (p == 0 ? 0 : p == 1 ? f->offsetU : p == 2 ? f->offsetV : f->offsetA);
+            for(int y = 0; y < ph; y++) {
+                for(int x = 0; x < pw; x++) {
+                    int v = (x * (3 + p) + y * (2 + p) + n * 7 + ((x ^ y) & 15) * p) * (max + 1) / 1024;
+                    v = ((v % (2 * max + 2)) > max ? 2 * max + 1 - v % (2 * max + 2) : v % (2 * max + 2)) + c->par.bias;
+                    v = v < 0 ? 0 : v > max ? max : v;
+                    if(cs == 2 && !interleaved)
+                        ((uint16_t*)dst)[x] = (uint16_t)v;
+                    else
+                        dst[x] = (BYTE)v;
+                }
+                dst += pp;
+            }
+        }
+    }
+}
+
+static struct AVS_Clip *mock_new_clip(const mock_params_t *par)
+{
+    struct AVS_Clip *c = calloc(1, sizeof(*c));
+    c->refcount = 1;
+    c->par = *par;
+    c->seed = 12345;
+    c->vi.width = par->width;
+    c->vi.height = par->height;
+    c->vi.fps_numerator = par->fps_num;
+    c->vi.fps_denominator = par->fps_den;
+    c->vi.num_frames = par->frames;
+    c->vi.pixel_type = par->pixel_type;
+    c->vi.image_type = (par->tff ? AVS_IT_TFF : AVS_IT_BFF) | (par->fieldbased ? AVS_IT_FIELDBASED : 0);
+    pthread_mutex_init(&c->lock, NULL);
+    mock_render(c);
+    return c;
+}
+
+static void mock_parse(mock_params_t *par, const char *text)
+{
+    const char *s = text;
+    while((s = strchr(s, '='))) {
+        const char *k = s;
+        while(k > text && (k[-1] == '_' || (k[-1] >= 'a' && k[-1] <= 'z')))
+            k--;
+        char key[32] = {0}, val[64] = {0};
+        if(s - k > 0 && s - k < (int)sizeof(key))
+            memcpy(key, k, s - k);
+        if(sscanf(s + 1, " \"%63[^\"]\"", val) != 1)
+            sscanf(s + 1, " %63[^,) \t\r\n]", val);
+        s++;
+        if(!strcmp(key, "width")) par->width = atoi(val);
+        else if(!strcmp(key, "height")) par->height = atoi(val);
+        else if(!strcmp(key, "frames")) par->frames = atoi(val);
+        else if(!strcmp(key, "fps")) { if(sscanf(val, "%u/%u", &par->fps_num, &par->fps_den) != 2) { par->fps_num = atoi(val); par->fps_den = 1; } }
+        else if(!strcmp(key, "pitch_align")) par->pitch_align = atoi(val);
+        else if(!strcmp(key, "pool")) par->pool = atoi(val);
+        else if(!strcmp(key, "latency_us")) par->latency_us = atoi(val);
+        else if(!strcmp(key, "jitter_us")) par->jitter_us = atoi(val);
+        else if(!strcmp(key, "bias")) par->bias = atoi(val);
+        else if(!strcmp(key, "fieldbased")) par->fieldbased = atoi(val);
+        else if(!strcmp(key, "tff")) par->tff = atoi(val);
+        else if(!strcmp(key, "mt")) par->mt = atoi(val);
+        else if(!strcmp(key, "error_at")) par->error_at = atoi(val);
+        else if(!strcmp(key, "pixel_type")) {
+            for(int i = 0; pixel_types[i].name; i++)
+                if(!strcasecmp(pixel_types[i].name, val))
+                    par->pixel_type = pixel_types[i].pixel_type;
+        }
+    }
+}
+
+/* C API */
+
+AVSC_API(AVS_ScriptEnvironment *, avs_create_script_environment)(int version)
+{
+    (void)version;
+    AVS_ScriptEnvironment *env = calloc(1, sizeof(*env));
+    /* every level avs2yuv has kernels for: the host's cpuid decides, MOCK_AVS_CPU_FLAGS narrows it */
+    env->cpu_flags = AVS_CPU_SSE2 | AVS_CPUF_SSSE3 | AVS_CPUF_SSE4_2 | AVS_CPUF_AVX2 |
+                     AVS_CPUF_AVX512F | AVS_CPUF_AVX512BW | AVS_CPUF_AVX512VL;
+    return env;
+}
+
+AVSC_API(void, avs_delete_script_environment)(AVS_ScriptEnvironment *env)
+{
+    free(env);
+}
+
+AVSC_API(const char *, avs_get_error)(AVS_ScriptEnvironment *env)
+{
+    return env->error;
+}
+
+AVSC_API(int, avs_get_cpu_flags)(AVS_ScriptEnvironment *env)
+{
+    const char *s = getenv("MOCK_AVS_CPU_FLAGS");
+    return s ? (int)strtol(s, NULL, 0) : env->cpu_flags;
+}
+
+AVSC_API(const char *, avs_clip_get_error)(AVS_Clip *c)
+{
+    return c->error;
+}
+
+AVSC_API(const AVS_VideoInfo *, avs_get_video_info)(AVS_Clip *c)
+{
+    return &c->vi;
+}
+
+AVSC_API(AVS_VideoFrame *, avs_get_frame)(AVS_Clip *c, int n)
+{
+    c->error = NULL;
+    if(n == c->par.error_at) {
+        c->error = "mock error";
+        return NULL;
+    }
+    int delay = c->par.latency_us;
+    if(c->par.jitter_us > 0) {
+        pthread_mutex_lock(&c->lock);
+        delay += rand_r(&c->seed) % c->par.jitter_us;
+        pthread_mutex_unlock(&c->lock);
+    }
+    if(delay > 0) {
+        struct timespec ts = {delay / 1000000, (delay % 1000000) * 1000L};
+        nanosleep(&ts, NULL);
+    }
+    int pool = c->par.pool > 0 ? c->par.pool : 1;
+    AVS_VideoFrame *f = malloc(sizeof(*f));
+    *f = c->tmpl[(n < 0 ? 0 : n) % pool];
+    f->refcount = 1;
+    __sync_fetch_and_add(&f->vfb->refcount, 1);
+    return f;
+}
+
+AVSC_API(void, avs_release_video_frame)(AVS_VideoFrame *f)
+{
+    if(!f)
+        return;
+    __sync_fetch_and_sub(&f->vfb->refcount, 1);
+    free(f);
+}
+
+AVSC_API(void, avs_release_clip)(AVS_Clip *c)
+{
+    if(!c || __sync_sub_and_fetch(&c->refcount, 1))
+        return;
+    int pool = c->par.pool > 0 ? c->par.pool : 1;
+    for(int n = 0; n < pool; n++)
+        free(c->vfb[n].data);
+    free(c->vfb);
+    free(c->tmpl);
+    pthread_mutex_destroy(&c->lock);
+    free(c);
+}
+
+AVSC_API(AVS_Clip *, avs_take_clip)(AVS_Value v, AVS_ScriptEnvironment *env)
+{
+    (void)env;
+    struct AVS_Clip *c = v.d.clip;
+    __sync_fetch_and_add(&c->refcount, 1);
+    return c;
+}
+
+AVSC_API(void, avs_release_value)(AVS_Value v)
+{
+    if(v.type == 'c')
+        avs_release_clip(v.d.clip);
+}
+
+static AVS_Value clip_value(struct AVS_Clip *c)
+{
+    AVS_Value v = {0};
+    v.type = 'c';
+    v.d.clip = c;
+    return v;
+}
+
+static AVS_Value derive(AVS_Value src, int pixel_type, int width, int height, int frames, int fieldbased)
+{
+    struct AVS_Clip *s = src.d.clip;
+    mock_params_t par = s->par;
+    par.pixel_type = pixel_type;
+    par.width = width;
+    par.height = height;
+    par.frames = frames;
+    par.fieldbased = fieldbased;
+    return clip_value(mock_new_clip(&par));
+}
+
+AVSC_API(AVS_Value, avs_invoke)(AVS_ScriptEnvironment *env, const char *name, AVS_Value args, const char **arg_names)
+{
+    (void)env; (void)arg_names;
+    AVS_Value arg0 = avs_array_elt(args, 0);
+    if(!strcmp(name, "Import")) {
+        const char *path = avs_as_string(arg0);
+        FILE *fh = path ? fopen(path, "rb") : NULL;
+        if(!fh)
+            return avs_new_value_error("Import: couldn't open script");
+        char text[4096] = {0};
+        size_t len = fread(text, 1, sizeof(text) - 1, fh);
+        text[len] = 0;
+        fclose(fh);
+        mock_params_t par = {640, 360, AVS_CS_YV12, 100, 25, 1, 64, 4, 0, 0, 0, 0, 1, 0, -1};
+        mock_parse(&par, text);
+        if(par.width <= 0 || par.height <= 0 || !par.pixel_type)
+            return avs_new_value_error("Import: bad mock parameters");
+        return clip_value(mock_new_clip(&par));
+    }
+    if(!strcmp(name, "GetMTMode")) {
+        return avs_new_value_int(0);
+    }
+    if(!avs_is_clip(arg0))
+        return avs_new_value_error("mock: function needs a clip argument");
+    struct AVS_Clip *c = arg0.d.clip;
+    int t = c->vi.pixel_type, bits = bits_of(t);
+    if(!strcmp(name, "Distributor")) {
+        __sync_fetch_and_add(&c->refcount, 1);
+        return arg0;
+    }
+    if(!strcmp(name, "PixelType"))
+        return avs_new_value_string(pixel_type_name(t));
+    if(!strcmp(name, "Weave"))
+        return derive(arg0, t, c->vi.width, c->vi.height * 2, c->vi.num_frames / 2, 0);
+    if(!strcmp(name, "SeparateFields"))
+        return derive(arg0, t, c->vi.width, c->vi.height / 2, c->vi.num_frames * 2, 1);
+    if(!strncmp(name, "ConvertTo", 9)) {
+        const char *to = name + 9;
+        int generic;
+        if(!strcmp(to, "YV12")) { generic = AVS_CS_GENERIC_YUV420; bits = 8; }
+        else if(!strcmp(to, "YV16")) { generic = AVS_CS_GENERIC_YUV422; bits = 8; }
+        else if(!strcmp(to, "YV24")) { generic = AVS_CS_GENERIC_YUV444; bits = 8; }
+        else if(!strcmp(to, "Y8")) { generic = AVS_CS_GENERIC_Y; bits = 8; }
+        else if(!strcmp(to, "YUV420")) generic = AVS_CS_GENERIC_YUV420;
+        else if(!strcmp(to, "YUV422")) generic = AVS_CS_GENERIC_YUV422;
+        else if(!strcmp(to, "YUV444")) generic = AVS_CS_GENERIC_YUV444;
+        else if(!strcmp(to, "Y")) generic = AVS_CS_GENERIC_Y;
+        else return avs_new_value_error("mock: unsupported conversion");
+        if(bits > 16 || !(t & AVS_CS_PLANAR))
+            bits = 8;
+        return derive(arg0, with_bits(generic, bits), c->vi.width, c->vi.height, c->vi.num_frames, 0);
+    }
+    return avs_new_value_error("mock: there is no function with this name");
+}
+
+/* like AviSynth+, which answers GetMTMode only when called */
+AVSC_API(int, avs_function_exists)(AVS_ScriptEnvironment *env, const char *name)
+{
+    static const char * const names[] = {"Import", "Distributor", "PixelType", "Weave", "SeparateFields", NULL};
+    (void)env;
+    for(int i = 0; names[i]; i++)
+        if(!strcmp(names[i], name))
+            return 1;
+    return !strncmp(name, "ConvertTo", 9);
+}
+
+AVSC_API(int, avs_get_pitch_p)(const AVS_VideoFrame *p, int plane)
+{
+    switch(plane) {
+        case AVS_PLANAR_U: case AVS_PLANAR_V: return p->pitchUV;
+        case AVS_PLANAR_A: return p->pitchA;
+    }
+    return p->pitch;
+}
+
+AVSC_API(int, avs_get_row_size_p)(const AVS_VideoFrame *p, int plane)
+{
+    switch(plane) {
+        case AVS_PLANAR_U: case AVS_PLANAR_V: return p->pitchUV ? p->row_sizeUV : 0;
+        case AVS_PLANAR_A: return p->pitchA ? p->row_sizeA : 0;
+    }
+    return p->row_size;
+}
+
+AVSC_API(int, avs_get_height_p)(const AVS_VideoFrame *p, int plane)
+{
+    switch(plane) {
+        case AVS_PLANAR_U: case AVS_PLANAR_V: return p->pitchUV ? p->heightUV : 0;
+        case AVS_PLANAR_A: return p->pitchA ? p->height : 0;
+    }
+    return p->height;
+}
+
+AVSC_API(const BYTE *, avs_get_read_ptr_p)(const AVS_VideoFrame *p, int plane)
+{
+    switch(plane) {
+        case AVS_PLANAR_U: return p->vfb->data + p->offsetU;
+        case AVS_PLANAR_V: return p->vfb->data + p->offsetV;
+        case AVS_PLANAR_A: return p->vfb->data + p->offsetA;
+    }
+    return p->vfb->data + p->offset;
+}
+
+AVSC_API(int, avs_is_yv24)(const AVS_VideoInfo *p) { return is_planar_yuv(p->pixel_type) && !is_y(p->pixel_type) && !(p->pixel_type & AVS_CS_YUVA) && !sub_w(p->pixel_type) && !sub_h(p->pixel_type) && bits_of(p->pixel_type) == 8; }
+AVSC_API(int, avs_is_yv16)(const AVS_VideoInfo *p) { return is_planar_yuv(p->pixel_type) && !is_y(p->pixel_type) && !(p->pixel_type & AVS_CS_YUVA) && sub_w(p->pixel_type) && !sub_h(p->pixel_type) && bits_of(p->pixel_type) == 8; }
+AVSC_API(int, avs_is_yv12)(const AVS_VideoInfo *p) { return is_planar_yuv(p->pixel_type) && !is_y(p->pixel_type) && !(p->pixel_type & AVS_CS_YUVA) && sub_w(p->pixel_type) && sub_h(p->pixel_type) && bits_of(p->pixel_type) == 8; }
+AVSC_API(int, avs_is_y8)(const AVS_VideoInfo *p) { return is_y(p->pixel_type) && bits_of(p->pixel_type) == 8; }
+AVSC_API(int, avs_is_444)(const AVS_VideoInfo *p) { return is_planar_yuv(p->pixel_type) && !is_y(p->pixel_type) && !sub_w(p->pixel_type) && !sub_h(p->pixel_type); }
+AVSC_API(int, avs_is_422)(const AVS_VideoInfo *p) { return is_planar_yuv(p->pixel_type) && !is_y(p->pixel_type) && sub_w(p->pixel_type) && !sub_h(p->pixel_type); }
+AVSC_API(int, avs_is_420)(const AVS_VideoInfo *p) { return is_planar_yuv(p->pixel_type) && !is_y(p->pixel_type) && sub_w(p->pixel_type) && sub_h(p->pixel_type); }
+AVSC_API(int, avs_is_y)(const AVS_VideoInfo *p) { return is_y(p->pixel_type); }
+AVSC_API(int, avs_is_yuva)(const AVS_VideoInfo *p) { return is_planar_yuv(p->pixel_type) && (p->pixel_type & AVS_CS_YUVA); }
+AVSC_API(int, avs_num_components)(const AVS_VideoInfo *p) { return is_y(p->pixel_type) ? 1 : (p->pixel_type & AVS_CS_YUVA) ? 4 : 3; }
+AVSC_API(int, avs_component_size)(const AVS_VideoInfo *p) { int b = bits_of(p->pixel_type); return b > 16 ? 4 : b > 8 ? 2 : 1; }
+AVSC_API(int, avs_bits_per_component)(const AVS_VideoInfo *p) { return bits_of(p->pixel_type); }
@@ -0,0 +1,1066 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#define _GNU_SOURCE // F_SETPIPE_SZ
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include "output.h"
+#include "chroma.h"
+#include "trace.h"
+#include "perf.h"
+
+#ifdef _MSC_VER
+#define strcasecmp _stricmp
+#else
+#include <strings.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>  /* MoveFileExA() */
+#include <io.h>       /* _setmode(), _commit(), _chsize_s() */
+#include <fcntl.h>    /* _O_BINARY */
+#include <sys/stat.h>
+#define fileno _fileno
+#define dup _dup
+#define fdopen _fdopen
+#define popen _popen
+#define pclose _pclose
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+extern char **environ;
+#endif
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h> /* FICLONE */
+#endif
+
+#define AVS_BUFSIZE (128*1024)
+
+int output_format_from_name(const char *name, int *format, int *depth)
+{
+    *depth = 0;
+    if(!strcasecmp(name, "y4m"))
+        *format = OUTPUT_Y4M;
+    else if(!strcasecmp(name, "raw"))
+        *format = OUTPUT_RAW;
+    else if(!strcasecmp(name, "nv12"))
+        *format = OUTPUT_NV12;
+    else if(!strcasecmp(name, "p010") || !strcasecmp(name, "p012") || !strcasecmp(name, "p016")) {
+        *format = OUTPUT_NV12;
+        *depth = atoi(name + 1);
+    } else if(!strcasecmp(name, "v210"))
+        *format = OUTPUT_V210;
+    else if(!strcasecmp(name, "uyvy"))
+        *format = OUTPUT_UYVY;
+    else if(!strcasecmp(name, "y210"))
+        *format = OUTPUT_Y210;
+    else if(!strcasecmp(name, "ffvhuff"))
+        *format = OUTPUT_FFVHUFF;
+    else if(!strcasecmp(name, "null"))
+        *format = OUTPUT_NULL;
+    else
+        return -1;
+    return 0;
+}
+
+int output_fields_from_name(const char *name)
+{
+    static const char * const names[] = {"none", "both", "top", "bottom", NULL};
+    for(int i = 0; names[i]; i++)
+        if(!strcasecmp(name, names[i]))
+            return i;
+    return -1;
+}
+
+int output_range_from_string(const char *str, int *first, int *last)
+{
+    char *end;
+    *first = strtol(str, &end, 10);
+    if(*end++ != '-' || *first < 0)
+        return -1;
+    *last = *end ? strtol(end, &end, 10) : -1;
+    if(*end || (*last >= 0 && *last < *first))
+        return -1;
+    return 0;
+}
+
+int output_crop_from_string(const char *str, int *width, int *height, int *x, int *y)
+{
+    char c;
+    if(sscanf(str, "%d:%d:%d:%d%c", width, height, x, y, &c) != 4 ||
+       *width < 0 || *height < 0 || *x < 0 || *y < 0)
+        return -1;
+    return 0;
+}
+
+void output_opt_default(output_opt_t *opt)
+{
+    memset(opt, 0, sizeof(output_opt_t));
+    opt->format = OUTPUT_Y4M;
+    opt->alpha = OUTPUT_ALPHA_NONE;
+    opt->csp = CSP_AUTO;
+    opt->last = -1;
+    opt->step = 1;
+}
+
+int output_same_stream(const output_opt_t *a, const output_opt_t *b)
+{
+    return a->format == b->format && a->format_depth == b->format_depth && a->alpha == b->alpha &&
+           a->csp == b->csp && a->depth == b->depth && a->height == b->height &&
+           a->crop_x == b->crop_x && a->crop_y == b->crop_y &&
+           a->crop_width == b->crop_width && a->crop_height == b->crop_height &&
+           a->tile_x == b->tile_x && a->tile_y == b->tile_y &&
+           a->tiles_x == b->tiles_x && a->tiles_y == b->tiles_y && a->fields == b->fields && a->plane == b->plane &&
+           a->align == b->align && a->resume == b->resume &&
+           a->first == b->first && a->last == b->last && a->step == b->step;
+}
+
+int output_is_file(const output_t *out)
+{
+    struct stat st;
+    return out->fh && !out->is_pipe && !out->pid && strcmp(out->filename, "-") &&
+           !fstat(fileno(out->fh), &st) && (st.st_mode & S_IFMT) == S_IFREG;
+}
+
+int output_same_file(const char *a, const char *b)
+{
+    struct stat sa, sb;
+    int a_exists = !stat(a, &sa), b_exists = !stat(b, &sb);
+    /* devices and FIFOs take any number of writers, like /dev/null */
+    if((a_exists && (sa.st_mode & S_IFMT) != S_IFREG) || (b_exists && (sb.st_mode & S_IFMT) != S_IFREG))
+        return 0;
+    if(!strcmp(a, b))
+        return 1;
+#ifndef _WIN32
+    /* links to one file, when it exists already */
+    if(a_exists && b_exists && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino)
+        return 1;
+#endif
+    return 0;
+}
+
+int output_open(output_t *out, const char *filename, const output_opt_t *opt)
+{
+    memset(out, 0, sizeof(output_t));
+    out->filename = filename;
+    out->opt = *opt;
+    if(opt->format == OUTPUT_NULL)
+        return 0;
+    if(!strcmp(filename, "-")) {
+        int dupout = dup(fileno(stdout));
+        fclose(stdout);
+#ifdef _WIN32
+        _setmode(dupout, _O_BINARY);
+#endif
+        out->fh = fdopen(dupout, "wb");
+    } else {
+        if(opt->resume)
+            out->fh = fopen(filename, "r+b");
+        if(!out->fh)
+            out->fh = fopen(filename, "wb");
+    }
+    if(!out->fh) {
+        fprintf(stderr, "error: failed to create/open \"%s\"\n", filename);
+        return -1;
+    }
+    return 0;
+}
+
+int output_popen(output_t *out, const char *cmd, const char *name, const output_opt_t *opt)
+{
+    memset(out, 0, sizeof(output_t));
+    out->filename = name;
+    out->opt = *opt;
+    out->is_pipe = 1;
+    out->fh = popen(cmd, "wb");
+    if(!out->fh) {
+        fprintf(stderr, "error: failed to exec \"%s\"\n", cmd);
+        return -1;
+    }
+    return 0;
+}
+
+#ifndef _WIN32
+/* splits a command line into arguments, handling quotes and backslashes.
+   Returns NULL when it needs a shell: redirections, pipes, globs, variables, assignments */
+static char **split_command(const char *cmd)
+{
+    size_t n = strlen(cmd), max_args = n / 2 + 2;
+    if(strpbrk(cmd, "|&;<>()$`*?[]{}~#!\n"))
+        return NULL;
+    char **argv = malloc(max_args * sizeof(char*) + n + 1);
+    if(!argv)
+        return NULL;
+    char *d = (char*)(argv + max_args);
+    int argc = 0;
+    for(const char *s = cmd;;) {
+        while(*s == ' ' || *s == '\t')
+            s++;
+        if(!*s)
+            break;
+        argv[argc++] = d;
+        char quote = 0;
+        for(; *s && (quote || (*s != ' ' && *s != '\t')); s++) {
+            if(quote == '\'' && *s != '\'')
+                *d++ = *s;
+            /* as in sh, within double quotes a backslash only escapes " and itself
+               ($, ` and newlines having gone to the shell) */
+            else if(*s == '\\' && s[1] && (!quote || s[1] == '"' || s[1] == '\\'))
+                *d++ = *++s;
+            else if(*s == quote)
+                quote = 0;
+            else if(!quote && (*s == '\'' || *s == '"'))
+                quote = *s;
+            else
+                *d++ = *s;
+        }
+        *d++ = 0;
+        if(quote || (argc == 1 && strchr(argv[0], '='))) {
+            free(argv);
+            return NULL;
+        }
+    }
+    argv[argc] = NULL;
+    if(!argc) {
+        free(argv);
+        return NULL;
+    }
+    return argv;
+}
+#endif
+
+int output_spawn(output_t *out, const char *cmd, const output_opt_t *opt)
+{
+#ifdef _WIN32
+    return output_popen(out, cmd, cmd, opt);
+#else
+    memset(out, 0, sizeof(output_t));
+    out->filename = cmd;
+    out->opt = *opt;
+    out->is_pipe = 1;
+    /* the write end mustn't leak into the other encoders, or they would never see the end of their input */
+    int fd[2];
+    if(pipe(fd) < 0 || fcntl(fd[0], F_SETFD, FD_CLOEXEC) < 0 || fcntl(fd[1], F_SETFD, FD_CLOEXEC) < 0) {
+        fprintf(stderr, "error: failed to create a pipe for \"%s\"\n", cmd);
+        return -1;
+    }
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fd[0], 0);
+    /* run directly, without a shell unless the command line needs one */
+    char **argv = split_command(cmd);
+    char *sh_argv[] = {"sh", "-c", (char*)cmd, NULL};
+    pid_t pid;
+    int err = argv ? posix_spawnp(&pid, argv[0], &actions, NULL, argv, environ)
+                   : posix_spawn(&pid, "/bin/sh", &actions, NULL, sh_argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    free(argv);
+    close(fd[0]);
+    if(err) {
+        close(fd[1]);
+        fprintf(stderr, "error: failed to exec \"%s\": %s\n", cmd, strerror(err));
+        return -1;
+    }
+    out->pid = pid;
+    out->fh = fdopen(fd[1], "wb");
+    if(!out->fh) {
+        close(fd[1]);
+        fprintf(stderr, "error: failed to open the pipe to \"%s\"\n", cmd);
+        return -1;
+    }
+    return 0;
+#endif
+}
+
+/* size of a picture as it is in the file */
+static size_t record_size(const output_t *out)
+{
+    return (out->opt.format == OUTPUT_Y4M ? 6 : 0) + out->frame_size;
+}
+
+/* a pipe holding pipe_buffer frames, or as much of it as an unprivileged process may have */
+static void set_pipe_buffer(output_t *out)
+{
+#ifdef F_SETPIPE_SZ
+    int fd = fileno(out->fh);
+    size_t frame = record_size(out) * (out->opt.fields == OUTPUT_FIELDS_BOTH ? 2 : 1);
+    int size = (int)MIN((size_t)out->opt.pipe_buffer * frame, 1 << 30);
+    if(fcntl(fd, F_SETPIPE_SZ, size) >= 0)
+        return;
+    int max = 0;
+    FILE *fh = fopen("/proc/sys/fs/pipe-max-size", "r");
+    if(fh) {
+        if(fscanf(fh, "%d", &max) != 1)
+            max = 0;
+        fclose(fh);
+    }
+    if(max > 0 && max < size && fcntl(fd, F_SETPIPE_SZ, max) >= 0)
+        fprintf(stderr, "pipe buffer of \"%s\" limited to %d bytes (fs.pipe-max-size)\n", out->filename, max);
+    else
+        fprintf(stderr, "failed to set the pipe buffer of \"%s\"\n", out->filename);
+#endif
+}
+
+static void y4m_csp_string(char *csp_type, const video_info_t *info, int alpha)
+{
+    int depth = info->depth;
+    if(alpha == OUTPUT_ALPHA_PLANE) {
+        strcpy(csp_type, "C444alpha");
+        return;
+    }
+    switch(alpha == OUTPUT_ALPHA_ONLY ? CSP_I400 : info->csp) {
+        case CSP_I400:
+            if(depth > 8)
+                sprintf(csp_type, "Cmono%d", depth);
+            else
+                strcpy(csp_type, "Cmono");
+            break;
+        case CSP_I420:
+            if(depth > 8)
+                sprintf(csp_type, "C420p%d XYSCSS=420P%d", depth, depth);
+            else if(info->chroma_loc == CHROMA_LOC_CENTER)
+                strcpy(csp_type, "C420jpeg XYSCSS=420JPEG");
+            else
+                strcpy(csp_type, "C420mpeg2 XYSCSS=420MPEG2");
+            break;
+        case CSP_I422:
+            if(depth > 8)
+                sprintf(csp_type, "C422p%d XYSCSS=422P%d", depth, depth);
+            else
+                strcpy(csp_type, "C422 XYSCSS=422");
+            break;
+        case CSP_I444:
+            if(depth > 8)
+                sprintf(csp_type, "C444p%d XYSCSS=444P%d", depth, depth);
+            else
+                strcpy(csp_type, "C444 XYSCSS=444");
+            break;
+    }
+}
+
+static const char *packed_name(int format)
+{
+    return format == OUTPUT_V210 ? "v210" : format == OUTPUT_UYVY ? "UYVY" : "Y210";
+}
+
+/* whether plane p (3 being alpha) of a picture of planes planes goes to the output */
+static int writes_plane(const output_t *out, int planes, int p)
+{
+    if(p == 3)
+        return out->opt.alpha != OUTPUT_ALPHA_NONE;
+    return p < planes && out->opt.alpha != OUTPUT_ALPHA_ONLY && (!out->opt.plane || p == out->opt.plane-1);
+}
+
+/* describes the planes of aligned raw output in a filename.layout sidecar, none for stdout and pipes */
+static int write_layout(output_t *out, const picture_t *fmt)
+{
+    static const char * const csp_names[] = {NULL, "i400", "i420", "i422", "i444"};
+    if(out->is_pipe || !strcmp(out->filename, "-"))
+        return 0;
+    char *name = malloc(strlen(out->filename) + 8);
+    if(!name)
+        return -1;
+    sprintf(name, "%s.layout", out->filename);
+    FILE *fh = fopen(name, "w");
+    if(!fh) {
+        fprintf(stderr, "error: failed to create \"%s\"\n", name);
+        free(name);
+        return -1;
+    }
+    fprintf(fh, "width=%d\nheight=%d\ncsp=%s\ndepth=%d\nalign=%d\nframe_size=%"PRIu64"\n",
+            out->info.width, out->info.height, csp_names[out->info.csp], out->info.depth,
+            out->opt.align, (uint64_t)out->frame_size);
+    uint64_t offset = 0;
+    for(int p = 0; p < 4; p++) {
+        if(!writes_plane(out, fmt->planes, p))
+            continue;
+        int h = picture_plane_height(fmt, p);
+        fprintf(fh, "plane=%c offset=%"PRIu64" stride=%"PRIu64" width=%d height=%d\n", "yuva"[p], offset,
+                (uint64_t)out->stride[p], picture_plane_width(fmt, p), h);
+        offset += (uint64_t)out->stride[p] * h;
+    }
+    int ret = ferror(fh) | fclose(fh) ? -1 : 0;
+    if(ret < 0)
+        fprintf(stderr, "error: failed to write \"%s\"\n", name);
+    free(name);
+    return ret;
+}
+
+static int64_t file_size(FILE *fh)
+{
+#ifdef _WIN32
+    struct _stati64 st;
+    if(_fstati64(fileno(fh), &st))
+        return -1;
+#else
+    struct stat st;
+    if(fstat(fileno(fh), &st))
+        return -1;
+#endif
+    return st.st_size;
+}
+
+static int truncate_file(FILE *fh, int64_t size)
+{
+    if(fflush(fh))
+        return -1;
+#ifdef _WIN32
+    return _chsize_s(fileno(fh), size) ? -1 : 0;
+#else
+    return ftruncate(fileno(fh), size);
+#endif
+}
+
+/* the file's data reaches the disk, not its metadata unless needed to read it back */
+static int sync_file(FILE *fh)
+{
+    if(fflush(fh))
+        return -1;
+#ifdef _WIN32
+    return _commit(fileno(fh));
+#elif defined(__APPLE__)
+    return fsync(fileno(fh));
+#else
+    return fdatasync(fileno(fh));
+#endif
+}
+
+/* syncs the file, then records the pictures it holds in filename.ckpt, written to
+   filename.ckpt.tmp and renamed over it so that it is always whole */
+static int write_checkpoint(output_t *out)
+{
+    int64_t start = trace_start();
+    out->last_checkpoint = clock_ns();
+    char *tmp = malloc(strlen(out->checkpoint_name) + 5);
+    int ret = -1;
+    if(tmp && !sync_file(out->fh)) {
+        sprintf(tmp, "%s.tmp", out->checkpoint_name);
+        FILE *fh = fopen(tmp, "w");
+        if(fh) {
+            fprintf(fh, "pictures=%"PRId64"\nrecord=%"PRIu64"\n", out->pictures, (uint64_t)record_size(out));
+            ret = ferror(fh) | fclose(fh) ? -1 : 0;
+        }
+#ifdef _WIN32
+        if(!ret && !MoveFileExA(tmp, out->checkpoint_name, MOVEFILE_REPLACE_EXISTING))
+            ret = -1;
+#else
+        if(!ret)
+            ret = rename(tmp, out->checkpoint_name);
+#endif
+    }
+    free(tmp);
+    if(ret < 0)
+        fprintf(stderr, "error: failed to checkpoint \"%s\"\n", out->filename);
+    trace_span("checkpoint", out->filename, -1, start);
+    return ret;
+}
+
+static int checkpoint_due(const output_t *out)
+{
+    return out->checkpoint_name && out->opt.checkpoint &&
+           clock_ns() - out->last_checkpoint >= out->opt.checkpoint * INT64_C(1000000000);
+}
+
+/* keeps the whole frames an earlier run left in the file, as far as its checkpoint vouches
+   for them, and cuts off the rest. Returns 1 when the file is to be written from the start */
+static int resume_file(output_t *out, const char *header, size_t header_size)
+{
+    int per_frame = out->opt.fields == OUTPUT_FIELDS_BOTH ? 2 : 1;
+    size_t record = record_size(out);
+    int64_t size = file_size(out->fh);
+    if(size < 0) {
+        fprintf(stderr, "error: failed to read \"%s\"\n", out->filename);
+        return -1;
+    }
+    if(size <= (int64_t)header_size) {
+        /* nothing or a part of the header */
+        if(truncate_file(out->fh, 0) < 0) {
+            fprintf(stderr, "error: failed to truncate \"%s\"\n", out->filename);
+            return -1;
+        }
+        return 1;
+    }
+    if(header_size) {
+        char buf[256];
+        if(fread(buf, 1, header_size, out->fh) != header_size || memcmp(buf, header, header_size)) {
+            fprintf(stderr, "error: \"%s\" was written with other settings, it can't be resumed\n", out->filename);
+            return -1;
+        }
+    }
+    int64_t pictures = (size - header_size) / record;
+    int vouched = 0;
+    FILE *fh = fopen(out->checkpoint_name, "r");
+    if(fh) {
+        int64_t synced;
+        uint64_t synced_record;
+        if(fscanf(fh, "pictures=%"SCNd64" record=%"SCNu64, &synced, &synced_record) == 2) {
+            if(synced_record != record) {
+                fprintf(stderr, "error: \"%s\" was written with frames of %"PRIu64" bytes, not %"PRIu64"\n",
+                        out->filename, synced_record, (uint64_t)record);
+                fclose(fh);
+                return -1;
+            }
+            pictures = MIN(pictures, synced);
+            vouched = 1;
+        }
+        fclose(fh);
+    }
+    /* without a header, only the checkpoint tells what the file holds */
+    if(!header_size && !vouched) {
+        fprintf(stderr, "error: \"%s\" has no checkpoint \"%s\" telling what it holds, it can't be resumed\n",
+                out->filename, out->checkpoint_name);
+        return -1;
+    }
+    pictures -= pictures % per_frame;
+    out->pictures = pictures;
+    out->resume_frames = pictures / per_frame;
+    if(header_size + pictures * record < (uint64_t)size &&
+       truncate_file(out->fh, header_size + pictures * record) < 0) {
+        fprintf(stderr, "error: failed to truncate \"%s\"\n", out->filename);
+        return -1;
+    }
+    if(fseek(out->fh, 0, SEEK_END)) {
+        fprintf(stderr, "error: failed to seek in \"%s\"\n", out->filename);
+        return -1;
+    }
+    return 0;
+}
+
+int output_resume(output_t *out, int first, int end)
+{
+    int frm = first;
+    for(int frames = 0; frm < end && frames < out->resume_frames; frm++)
+        frames += output_wants_frame(out, frm);
+    out->resume_frame = frm;
+    return frm;
+}
+
+/* on the writer thread */
+static int write_block(void *arg, const uint8_t *data, size_t size)
+{
+    output_t *out = arg;
+    int64_t start = trace_start();
+    perf_span_t span;
+    perf_begin(&span, BENCH_WRITE, -1);
+    int ret;
+    if(!data)
+        ret = fflush(out->fh) ? -1 : 0;
+    else if(out->opt.format == OUTPUT_FFVHUFF)
+        ret = avi_write_frame(out->avi, data, size);
+    else
+        ret = fwrite(data, 1, size, out->fh) == size ? 0 : -1;
+    if(data && !ret) {
+        out->pictures++;
+        if(checkpoint_due(out))
+            ret = write_checkpoint(out);
+    }
+    if(data && !ret && !out->first_byte)
+        out->first_byte = clock_ns();
+    if(data)
+        __atomic_fetch_sub(&out->queued, 1, __ATOMIC_RELAXED);
+    perf_end(&span);
+    trace_span(data ? "write block" : "flush", out->filename, -1, start);
+    return ret;
+}
+
+int output_init(output_t *out, const video_info_t *info, threadpool_t *threads)
+{
+    out->info = *info;
+    out->threads = threads;
+    out->jobs = MIN(threadpool_threads(threads) * 4, MAX(info->height / 16, 1));
+    pixel_init(&out->pf);
+    picture_t fmt = {0};
+    fmt.width = info->width;
+    fmt.height = info->height;
+    fmt.component_size = info->depth > 8 ? 2 : 1;
+    picture_set_csp(&fmt, info->csp);
+    for(int p = 0; p < 4; p++) {
+        out->stride[p] = (size_t)picture_plane_width(&fmt, p) * fmt.component_size;
+        if(out->opt.align)
+            out->stride[p] = ALIGN(out->stride[p], out->opt.align);
+    }
+    out->frame_size = 0;
+    for(int p = 0; p < 4; p++)
+        if(writes_plane(out, fmt.planes, p))
+            out->frame_size += out->stride[p] * picture_plane_height(&fmt, p);
+    if(out->opt.format == OUTPUT_NULL)
+        return 0;
+
+    if(setvbuf(out->fh, NULL, _IOFBF, AVS_BUFSIZE)) {
+        fprintf(stderr, "error: failed to create buffer for \"%s\"\n", out->filename);
+        return -1;
+    }
+    if(out->opt.plane > fmt.planes) {
+        fprintf(stderr, "error: the I400 clip of \"%s\" has no chroma planes\n", out->filename);
+        return -1;
+    }
+    if(out->opt.align && out->opt.format != OUTPUT_RAW) {
+        fprintf(stderr, "error: aligned rows can only be written to raw output \"%s\"\n", out->filename);
+        return -1;
+    }
+    if(out->opt.align && write_layout(out, &fmt) < 0)
+        return -1;
+    if(out->opt.plane && out->opt.format != OUTPUT_RAW) {
+        fprintf(stderr, "error: plane output \"%s\" must be raw\n", out->filename);
+        return -1;
+    }
+    if(out->opt.alpha != OUTPUT_ALPHA_NONE && out->opt.format >= OUTPUT_NV12) {
+        fprintf(stderr, "error: alpha can't be written to semi-planar, packed or ffvhuff output \"%s\"\n", out->filename);
+        return -1;
+    }
+    /* yuv4mpeg only knows 8-bit 4:4:4 with alpha */
+    if(out->opt.alpha == OUTPUT_ALPHA_PLANE && out->opt.format == OUTPUT_Y4M && (info->csp != CSP_I444 || info->depth > 8)) {
+        fprintf(stderr, "error: yuv4mpeg output \"%s\" can carry alpha only with 8-bit 4:4:4, use -raw\n", out->filename);
+        return -1;
+    }
+    if(out->opt.format == OUTPUT_NV12) {
+        if(info->csp == CSP_I400) {
+            fprintf(stderr, "error: semi-planar output \"%s\" needs chroma planes\n", out->filename);
+            return -1;
+        }
+        if(out->opt.format_depth == 16 ? info->depth <= 8 : out->opt.format_depth && out->opt.format_depth != info->depth) {
+            fprintf(stderr, "error: P0%02d output \"%s\" doesn't match %d-bit input\n",
+                    out->opt.format_depth, out->filename, info->depth);
+            return -1;
+        }
+    } else if(out->opt.format == OUTPUT_FFVHUFF) {
+        if(ffvhuff_check(info->width, info->height, info->csp, info->depth) < 0) {
+            fprintf(stderr, "error: ffvhuff output \"%s\" needs 8-bit 4:2:0 or 4:2:2 (use -csp/-odepth),\n"
+                    "a width multiple of 4 and an even height of at least 4\n", out->filename);
+            return -1;
+        }
+        if(out->is_pipe || !strcmp(out->filename, "-")) {
+            fprintf(stderr, "error: ffvhuff output \"%s\" must be a file\n", out->filename);
+            return -1;
+        }
+    } else if(out->opt.format >= OUTPUT_V210) {
+        int depth = out->opt.format == OUTPUT_UYVY ? 8 : 10;
+        if(info->csp != CSP_I422 || info->depth != depth) {
+            fprintf(stderr, "error: %s output \"%s\" needs %d-bit 4:2:2 (use -csp i422)\n",
+                    packed_name(out->opt.format), out->filename, depth);
+            return -1;
+        }
+        if(out->opt.format == OUTPUT_V210)
+            out->row_size = (info->width + 47) / 48 * 128;
+        else
+            out->row_size = (size_t)info->width * (out->opt.format == OUTPUT_UYVY ? 2 : 4);
+        out->frame_size = out->row_size * info->height;
+    }
+    if((out->opt.format >= OUTPUT_NV12 && out->opt.format != OUTPUT_FFVHUFF) || out->opt.align) {
+        out->pool = bufpool_create(out->frame_size);
+        if(!out->pool) {
+            fprintf(stderr, "error: malloc failed\n");
+            return -1;
+        }
+    }
+    /* sized once the packed formats have their frame size */
+    if(out->pid && out->opt.pipe_buffer)
+        set_pipe_buffer(out);
+    char header[256] = "";
+    if(out->opt.format == OUTPUT_Y4M) {
+        char csp_type[200];
+        y4m_csp_string(csp_type, info, out->opt.alpha);
+        snprintf(header, sizeof(header), "YUV4MPEG2 W%d H%d F%u:%u I%s A%u:%u %s\n",
+                 info->width, info->height, info->fps_num, info->fps_den,
+                 info->interlaced ? info->tff ? "t" : "b" : "p",
+                 info->par_width, info->par_height, csp_type);
+    }
+    if(!out->is_pipe && strcmp(out->filename, "-") && out->opt.format != OUTPUT_FFVHUFF &&
+       (out->opt.resume || out->opt.checkpoint)) {
+        out->checkpoint_name = malloc(strlen(out->filename) + 6);
+        if(!out->checkpoint_name) {
+            fprintf(stderr, "error: malloc failed\n");
+            return -1;
+        }
+        sprintf(out->checkpoint_name, "%s.ckpt", out->filename);
+        out->last_checkpoint = clock_ns();
+    }
+    int write_header = 1;
+    if(out->opt.resume) {
+        if(!out->checkpoint_name) {
+            fprintf(stderr, "error: \"%s\" can't be resumed, only files of fixed size frames can\n", out->filename);
+            return -1;
+        }
+        write_header = resume_file(out, header, strlen(header));
+        if(write_header < 0)
+            return -1;
+    }
+    if(write_header && out->opt.format == OUTPUT_Y4M) {
+        fputs(header, out->fh);
+        fflush(out->fh);
+    }
+    if(out->opt.format == OUTPUT_FFVHUFF) {
+        out->ffvhuff = ffvhuff_create(info->width, info->height, info->csp, threads);
+        if(!out->ffvhuff) {
+            fprintf(stderr, "error: malloc failed\n");
+            return -1;
+        }
+        avi_info_t avi = {0};
+        avi.width = info->width;
+        avi.height = info->height;
+        avi.fps_num = info->fps_num;
+        avi.fps_den = info->fps_den;
+        avi.fourcc = "FFVH";
+        avi.bit_count = ffvhuff_bit_count(out->ffvhuff);
+        avi.extradata = ffvhuff_extradata(out->ffvhuff, &avi.extradata_size);
+        out->avi = avi_create(out->fh, &avi);
+        if(!out->avi) {
+            fprintf(stderr, "error: failed to write the AVI header of \"%s\"\n", out->filename);
+            return -1;
+        }
+    }
+    if(out->opt.queue || out->opt.spill) {
+        out->writer = writer_create(out->opt.queue ? out->opt.queue : 4, out->opt.spill, write_block, out);
+        if(!out->writer) {
+            fprintf(stderr, "error: failed to create the writer thread of \"%s\"\n", out->filename);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static uint8_t *copy_plane(output_t *out, uint8_t *dst, const picture_t *pic, int p)
+{
+    size_t row = (size_t)picture_plane_width(pic, p) * pic->component_size;
+    int h = picture_plane_height(pic, p);
+    if(pic->stride[p] == out->stride[p] && out->stride[p] == row) {
+        memcpy(dst, pic->plane[p], h * row);
+        return dst + h * row;
+    }
+    for(int y = 0; y < h; y++, dst += out->stride[p]) {
+        memcpy(dst, pic->plane[p] + y * pic->stride[p], row);
+        memset(dst + row, 0, out->stride[p] - row);
+    }
+    return dst;
+}
+
+/* rows laid out in the frame as they are in the file go in a single write.
+   Rows padded by -align are laid out with zeros in a pool buffer, then written in one piece,
+   so that the bytes don't depend on the frame's own padding */
+static size_t write_plane(output_t *out, const picture_t *pic, int p)
+{
+    size_t wrote = 0;
+    size_t row = (size_t)picture_plane_width(pic, p) * pic->component_size;
+    int h = picture_plane_height(pic, p);
+    const uint8_t *data = pic->plane[p];
+    if(out->stride[p] != row) {
+        uint8_t *buf = bufpool_get(out->pool);
+        if(!buf)
+            return 0;
+        copy_plane(out, buf, pic, p);
+        wrote = fwrite(buf, 1, h * out->stride[p], out->fh);
+        bufpool_put(out->pool, buf);
+        return wrote;
+    }
+    if(pic->stride[p] == row)
+        return fwrite(data, 1, h * row, out->fh);
+    for(int y = 0; y < h; y++) {
+        wrote += fwrite(data, 1, row, out->fh);
+        data += pic->stride[p];
+    }
+    return wrote;
+}
+
+/* straight from the frame's planes, including alpha as plane 3 */
+static int write_planar(output_t *out, const picture_t *pic)
+{
+    size_t wrote = 0;
+    for(int p = 0; p < 4; p++)
+        if(writes_plane(out, pic->planes, p))
+            wrote += write_plane(out, pic, p);
+    return wrote == out->frame_size ? 0 : -1;
+}
+
+typedef struct
+{
+    output_t *out;
+    const picture_t *pic;
+    uint8_t *buf;
+} pack_t;
+
+/* Y rows followed by interleaved UV rows */
+static void pack_semiplanar(const output_t *out, const picture_t *pic, uint8_t *buf, int y0, int y1)
+{
+    int cs = pic->component_size;
+    int shift = cs == 2 ? 16 - pic->depth : 0;
+    for(int y = y0; y < y1; y++) {
+        uint8_t *dst = buf + (size_t)y * pic->width * cs;
+        const uint8_t *src = pic->plane[0] + y * pic->stride[0];
+        if(shift)
+            out->pf.copy_shl_16(dst, src, pic->width, shift);
+        else
+            memcpy(dst, src, pic->width * cs);
+    }
+    int cw = picture_plane_width(pic, 1);
+    buf += (size_t)pic->width * pic->height * cs;
+    for(int y = y0 >> pic->v_shift; y < y1 >> pic->v_shift; y++)
+        out->pf.interleave_uv[cs-1](buf + (size_t)y * 2 * cw * cs, pic->plane[1] + y * pic->stride[1],
+                                    pic->plane[2] + y * pic->stride[2], cw, shift);
+}
+
+static void pack_422(const output_t *out, const picture_t *pic, uint8_t *buf, int y0, int y1)
+{
+    for(int y = y0; y < y1; y++) {
+        uint8_t *dst = buf + y * out->row_size;
+        const uint8_t *l = pic->plane[0] + y * pic->stride[0];
+        const uint8_t *u = pic->plane[1] + y * pic->stride[1];
+        const uint8_t *v = pic->plane[2] + y * pic->stride[2];
+        if(out->opt.format == OUTPUT_V210) {
+            size_t used = (pic->width + 5) / 6 * 16;
+            out->pf.pack_v210(dst, l, u, v, pic->width);
+            memset(dst + used, 0, out->row_size - used);
+        } else if(out->opt.format == OUTPUT_UYVY)
+            out->pf.pack_uyvy(dst, l, u, v, pic->width);
+        else
+            out->pf.pack_y210(dst, l, u, v, pic->width, 16 - pic->depth);
+    }
+}
+
+static void pack_rows(void *arg, int job)
+{
+    pack_t *p = arg;
+    int jobs = p->out->jobs;
+    /* even rows, so that 4:2:0 chroma rows aren't split */
+    int y0 = p->pic->height * job / jobs & ~1;
+    int y1 = job == jobs - 1 ? p->pic->height : p->pic->height * (job + 1) / jobs & ~1;
+    if(p->out->opt.format == OUTPUT_NV12)
+        pack_semiplanar(p->out, p->pic, p->buf, y0, y1);
+    else
+        pack_422(p->out, p->pic, p->buf, y0, y1);
+}
+
+static void pack_frame(output_t *out, const picture_t *pic, uint8_t *buf)
+{
+    pack_t p = {out, pic, buf};
+    threadpool_run(out->threads, pack_rows, &p, out->jobs);
+}
+
+/* packs the frame into one buffer by row blocks on the threads, so it goes out in a single write */
+static int write_packed(output_t *out, const picture_t *pic)
+{
+    uint8_t *buf = bufpool_get(out->pool);
+    if(!buf)
+        return -1;
+    pack_frame(out, pic, buf);
+    size_t wrote = fwrite(buf, 1, out->frame_size, out->fh);
+    bufpool_put(out->pool, buf);
+    return wrote == out->frame_size ? 0 : -1;
+}
+
+/* the frame as it goes out, in one block handed to the output's writer thread */
+static int queue_picture(output_t *out, const picture_t *pic)
+{
+    size_t header = out->opt.format == OUTPUT_Y4M ? 6 : 0;
+    size_t size = out->frame_size;
+    const uint8_t *coded = NULL;
+    if(out->opt.format == OUTPUT_FFVHUFF)
+        size = ffvhuff_encode(out->ffvhuff, pic, &coded);
+    uint8_t *buf = malloc(header + size);
+    if(!buf)
+        return -1;
+    memcpy(buf, "FRAME\n", header);
+    if(coded)
+        memcpy(buf, coded, size);
+    else if(out->opt.format >= OUTPUT_NV12)
+        pack_frame(out, pic, buf);
+    else {
+        uint8_t *dst = buf + header;
+        for(int p = 0; p < 4; p++)
+            if(writes_plane(out, pic->planes, p))
+                dst = copy_plane(out, dst, pic, p);
+    }
+    __atomic_fetch_add(&out->bytes, header + size, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&out->queued, 1, __ATOMIC_RELAXED);
+    return writer_push(out->writer, buf, header + size);
+}
+
+int output_wants_frame(const output_t *out, int frm)
+{
+    const output_opt_t *opt = &out->opt;
+    return frm >= out->resume_frame && frm >= opt->first && (opt->last < 0 || frm <= opt->last) && (frm - opt->first) % opt->step == 0;
+}
+
+static int write_direct(output_t *out, const picture_t *pic)
+{
+    if(out->opt.format != OUTPUT_FFVHUFF)
+        __atomic_fetch_add(&out->bytes, (out->opt.format == OUTPUT_Y4M ? 6 : 0) + out->frame_size, __ATOMIC_RELAXED);
+    if(out->opt.format == OUTPUT_Y4M && fwrite("FRAME\n", 1, 6, out->fh) != 6)
+        return -1;
+    if(out->opt.format == OUTPUT_FFVHUFF) {
+        const uint8_t *data;
+        size_t size = ffvhuff_encode(out->ffvhuff, pic, &data);
+        __atomic_fetch_add(&out->bytes, size, __ATOMIC_RELAXED);
+        return avi_write_frame(out->avi, data, size);
+    }
+    if(out->opt.format >= OUTPUT_NV12)
+        return write_packed(out, pic);
+    return write_planar(out, pic);
+}
+
+static int write_picture(output_t *out, const picture_t *pic)
+{
+    if(out->opt.format == OUTPUT_NULL)
+        return 0;
+    if(out->writer)
+        return queue_picture(out, pic);
+    if(write_direct(out, pic) < 0)
+        return -1;
+    out->pictures++;
+    return 0;
+}
+
+int output_write_frame(output_t *out, const picture_t *pic)
+{
+    if(out->opt.fields == OUTPUT_FIELDS_NONE) {
+        if(write_picture(out, pic) < 0)
+            return -1;
+    } else {
+        /* fields are views of every other row of the frame */
+        int bottom = out->opt.fields == OUTPUT_FIELDS_BOTTOM || (out->opt.fields == OUTPUT_FIELDS_BOTH && !out->info.tff);
+        for(int f = 0; f < (out->opt.fields == OUTPUT_FIELDS_BOTH ? 2 : 1); f++) {
+            picture_t field;
+            picture_field(&field, pic, bottom ^ f);
+            if(write_picture(out, &field) < 0)
+                return -1;
+        }
+    }
+    /* queued frames get there on the writer thread */
+    if(!out->writer && !out->first_byte)
+        out->first_byte = clock_ns();
+    if(!out->writer && checkpoint_due(out))
+        return write_checkpoint(out);
+    return 0;
+}
+
+/* shares the extents when the filesystem can (FICLONE), else copies in the kernel
+   (copy_file_range), else through a buffer */
+int output_copy(output_t *out, const char *src)
+{
+    FILE *in = fopen(src, "rb");
+    if(!in) {
+        fprintf(stderr, "error: failed to open \"%s\" to copy it to \"%s\"\n", src, out->filename);
+        return -1;
+    }
+#ifndef _WIN32
+    struct stat a, b;
+    if(!fstat(fileno(in), &a) && !fstat(fileno(out->fh), &b) && a.st_dev == b.st_dev && a.st_ino == b.st_ino) {
+        /* the same file under another name, already written */
+        fclose(in);
+        return 0;
+    }
+#endif
+    int ret = -1;
+    /* a file opened for -resume may have something in it */
+    truncate_file(out->fh, 0);
+#ifdef FICLONE
+    if(!ioctl(fileno(out->fh), FICLONE, fileno(in)))
+        ret = 0;
+#endif
+#ifdef __linux__
+    if(ret < 0) {
+        ssize_t n;
+        int64_t copied = 0;
+        while((n = copy_file_range(fileno(in), NULL, fileno(out->fh), NULL, 1 << 30, 0)) > 0)
+            copied += n;
+        if(!n)
+            ret = 0;
+        /* nothing copied yet falls back, e.g. across filesystems on older kernels */
+        else if(copied || (errno != EXDEV && errno != EINVAL && errno != ENOSYS && errno != EOPNOTSUPP))
+            goto end;
+    }
+#endif
+    if(ret < 0) {
+        uint8_t *buf = malloc(AVS_BUFSIZE);
+        if(!buf)
+            goto end;
+        size_t n;
+        ret = 0;
+        while((n = fread(buf, 1, AVS_BUFSIZE, in)) > 0)
+            if(fwrite(buf, 1, n, out->fh) != n) {
+                ret = -1;
+                break;
+            }
+        if(ferror(in))
+            ret = -1;
+        free(buf);
+    }
+end:
+    if(ret < 0)
+        fprintf(stderr, "error: failed to copy \"%s\" to \"%s\"\n", src, out->filename);
+    fclose(in);
+    return ret;
+}
+
+int output_flush(output_t *out)
+{
+    /* the writer thread flushes whenever it has caught up */
+    if(out->writer || !out->fh)
+        return 0;
+    return fflush(out->fh);
+}
+
+int output_close(output_t *out)
+{
+    int ret = 0;
+    if(out->writer) {
+        int spilled;
+        uint64_t peak;
+        if(writer_close(out->writer, &spilled, &peak) < 0) {
+            fprintf(stderr, "error: failed to write to \"%s\"\n", out->filename);
+            ret = -1;
+        }
+        if(spilled)
+            fprintf(stderr, "%d frames of \"%s\" went through the spill file, %.1f MB at most\n",
+                    spilled, out->filename, peak / 1048576.);
+        out->writer = NULL;
+    }
+    if(out->avi && avi_close(out->avi) < 0) {
+        fprintf(stderr, "error: failed to complete the AVI indexes of \"%s\"\n", out->filename);
+        ret = -1;
+    }
+    out->avi = NULL;
+    ffvhuff_delete(out->ffvhuff);
+    out->ffvhuff = NULL;
+    /* what the file holds in the end, for a later -resume */
+    if(out->checkpoint_name && out->opt.checkpoint && out->fh && write_checkpoint(out) < 0)
+        ret = -1;
+    free(out->checkpoint_name);
+    out->checkpoint_name = NULL;
+    if(out->fh) {
+        int status = 0;
+        if(out->pid) {
+#ifndef _WIN32
+            /* closing the pipe ends the encoder's input, then it's waited for */
+            if(fclose(out->fh))
+                ret = -1;
+            while(waitpid(out->pid, &status, 0) < 0 && errno == EINTR);
+            if(WIFSIGNALED(status)) {
+                fprintf(stderr, "error: encoder \"%s\" was killed by signal %d\n", out->filename, WTERMSIG(status));
+                ret = -1;
+            } else if(WEXITSTATUS(status)) {
+                fprintf(stderr, "error: encoder \"%s\" exited with status %d\n", out->filename, WEXITSTATUS(status));
+                ret = -1;
+            }
+#endif
+            out->pid = 0;
+        } else if(out->is_pipe) {
+            if(pclose(out->fh))
+                ret = -1;
+        } else if(fclose(out->fh))
+            ret = -1;
+        out->fh = NULL;
+    }
+    bufpool_delete(out->pool);
+    out->pool = NULL;
+    return ret;
+}
@@ -0,0 +1,143 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#ifndef AVS2YUV_OUTPUT_H
+#define AVS2YUV_OUTPUT_H
+
+#include <stdio.h>
+#include "common.h"
+#include "pixel.h"
+#include "threads.h"
+#include "ffvhuff.h"
+#include "avi.h"
+#include "writer.h"
+
+#define OUTPUT_Y4M  0
+#define OUTPUT_RAW  1 // planar
+#define OUTPUT_NV12 2 // semi-planar, MSB-aligned above 8 bits (P010/P012/P016)
+#define OUTPUT_V210 3 // packed 10-bit 4:2:2, rows padded to 48 pixels
+#define OUTPUT_UYVY 4 // packed 8-bit 4:2:2
+#define OUTPUT_Y210 5 // packed 10-bit 4:2:2, YUYV order MSB-aligned
+#define OUTPUT_FFVHUFF 6 // lossless FFVHuff in AVI
+#define OUTPUT_NULL 7    // converted, then discarded without opening the file
+
+#define OUTPUT_MAX_ALIGN 4096 // of -align
+
+#define OUTPUT_ALPHA_NONE  0
+#define OUTPUT_ALPHA_PLANE 1 // alpha after the V plane
+#define OUTPUT_ALPHA_ONLY  2 // alpha plane alone, as luma of a monochrome stream
+
+#define OUTPUT_FIELDS_NONE   0
+#define OUTPUT_FIELDS_BOTH   1 // both fields as consecutive pictures, in the clip's field order
+#define OUTPUT_FIELDS_TOP    2
+#define OUTPUT_FIELDS_BOTTOM 3
+
+/* what the user asked of one output */
+typedef struct
+{
+    int format;
+    int format_depth;  // required input depth (p010, p012), 0 = any
+    int alpha;
+    int csp;           // CSP_AUTO = the main -csp
+    int depth;         // 0 = the clip's
+    int height;        // 0 = the clip's, otherwise scaled keeping the aspect ratio
+    int crop_x, crop_y, crop_width, crop_height; // crop_width/height 0 = up to the edge
+    int tile_x, tile_y, tiles_x, tiles_y;        // cell of a grid over the crop, tiles_x 0 = none
+    int fields;
+    int plane;         // 1 + the only plane written (Y/U/V), 0 = all; raw output only
+    int align;         // raw rows padded to a multiple of this many bytes, 0 = none
+    int pipe_buffer;   // frames the pipe to an encoder holds, 0 = the system's default
+    int queue;         // frames waiting for the output's writer thread, 0 = written in the frame loop
+    const char *spill; // directory the queue overflows to instead of waiting, NULL = none
+    int first, last;   // frame range, last < 0 = up to the end
+    int step;
+    int resume;        // keep the whole frames an earlier run left in the file and append
+    int checkpoint;    // seconds between syncs of the file recorded in filename.ckpt, 0 = none
+} output_opt_t;
+
+/* what a stream carries, as described in its header */
+typedef struct
+{
+    int width, height;
+    int csp;
+    int depth;
+    unsigned fps_num, fps_den;
+    unsigned par_width, par_height;
+    int interlaced, tff;
+    int chroma_loc;
+} video_info_t;
+
+typedef struct
+{
+    const char *filename;
+    output_opt_t opt;
+    FILE *fh;
+    int is_pipe;
+    int pid;           // of the encoder started by output_spawn
+    video_info_t info;
+    size_t frame_size; // payload bytes per frame
+    size_t row_size;   // bytes per row of packed formats
+    size_t stride[4];  // bytes per row of each plane of planar formats, padded by -align
+    bufpool_t *pool;   // whole frame packing buffers
+    threadpool_t *threads;
+    int jobs;          // row blocks packed in parallel
+    pixel_funcs_t pf;
+    ffvhuff_t *ffvhuff;
+    avi_t *avi;
+    writer_t *writer;
+    uint64_t bytes;    // of the frames written, headers aside (atomic)
+    int queued;        // frames waiting on the writer thread (atomic)
+    int64_t first_byte; // clock_ns() when the first frame reached the file, 0 before
+    char *checkpoint_name;   // filename.ckpt, NULL when the output isn't a file that can be resumed
+    int64_t last_checkpoint; // clock_ns()
+    int64_t pictures;        // in the file
+    int resume_frames;       // frames already in the file
+    int resume_frame;        // frames before this one are left out
+} output_t;
+
+/* parses y4m/raw/nv12/p010/p012/p016/v210/uyvy/y210/ffvhuff/null */
+int output_format_from_name(const char *name, int *format, int *depth);
+/* parses none/both/top/bottom */
+int output_fields_from_name(const char *name);
+/* parses first-last, either of which may be left out */
+int output_range_from_string(const char *str, int *first, int *last);
+/* parses width:height:x:y, a width or height of 0 meaning up to the edge */
+int output_crop_from_string(const char *str, int *width, int *height, int *x, int *y);
+void output_opt_default(output_opt_t *opt);
+/* whether two outputs given the same clip carry the same bytes */
+int output_same_stream(const output_opt_t *a, const output_opt_t *b);
+/* whether two filenames name the same regular file, or will */
+int output_same_file(const char *a, const char *b);
+
+/* whether out writes to a regular file, which can be read back and copied */
+int output_is_file(const output_t *out);
+/* filename "-" means stdout. With opt->resume an existing file is opened for update */
+int output_open(output_t *out, const char *filename, const output_opt_t *opt);
+/* writes into the stdin of a shell command */
+int output_popen(output_t *out, const char *cmd, const char *name, const output_opt_t *opt);
+/* writes into the stdin of an encoder started with posix_spawn, directly when the command line
+   needs no shell. Its exit status is checked by output_close */
+int output_spawn(output_t *out, const char *cmd, const output_opt_t *opt);
+/* checks that the format can carry info and writes the stream header.
+   With fields, info describes the field pictures and tff their order, while
+   output_write_frame still takes whole frames.
+   Frames written with alpha must have it in plane[3].
+   packing of frames is split into row blocks run on threads */
+int output_init(output_t *out, const video_info_t *info, threadpool_t *threads);
+/* leaves out the frames an output resumed with opt->resume already has, those being the first
+   of the frames first..end-1 it takes. Returns the frame it takes up at */
+int output_resume(output_t *out, int first, int end);
+/* whether frame frm is in the output's range and step */
+int output_wants_frame(const output_t *out, int frm);
+int output_write_frame(output_t *out, const picture_t *pic);
+int output_flush(output_t *out);
+/* fills an output left empty with a copy of file src, once that is complete */
+int output_copy(output_t *out, const char *src);
+/* fails if the data couldn't all be written or an encoder failed */
+int output_close(output_t *out);
+
+#endif
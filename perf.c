@@ -0,0 +1,292 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "common.h"
+#include "perf.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+static const struct
+{
+    uint32_t type;
+    uint64_t config;
+    const char *name;
+} events[PERF_EVENTS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "LLC misses"},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, "context switches"},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, "page faults"},
+};
+
+typedef struct perf_thread_t
+{
+    struct perf_thread_t *next;
+    int fd[PERF_EVENTS];    // -1 for those not counted
+    int order[PERF_EVENTS]; // the events in the order the group reads them
+    int count;
+    int depth, stage, frame; // of the current span
+    uint64_t total[BENCH_STAGES][PERF_EVENTS];
+    uint64_t bucket[BENCH_STAGES][PERF_BUCKETS][PERF_EVENTS];
+} perf_thread_t;
+
+static struct
+{
+    int on;
+    int exclude_kernel;       // perf_event_paranoid 2 only lets us count user space
+    int have[PERF_EVENTS];    // events the first thread could count, the others try these
+    int first, frames, bucket_frames, buckets;
+    pthread_mutex_t lock;     // for the list of threads
+    perf_thread_t *threads;
+    int thread_count;
+} perf;
+
+static __thread perf_thread_t *thread_perf;
+
+static int open_event(int e, int group)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[e].type;
+    attr.config = events[e].config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = perf.exclude_kernel;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group, PERF_FLAG_FD_CLOEXEC);
+}
+
+/* a group of the calling thread's counters, led by the first event that opens */
+static void open_counters(perf_thread_t *t)
+{
+    int leader = -1;
+    for(int e = 0; e < PERF_EVENTS; e++) {
+        t->fd[e] = -1;
+        if(!perf.have[e])
+            continue;
+        t->fd[e] = open_event(e, leader);
+        if(t->fd[e] < 0)
+            continue;
+        if(leader < 0)
+            leader = t->fd[e];
+        t->order[t->count++] = e;
+    }
+}
+
+static perf_thread_t *get_thread(void)
+{
+    if(thread_perf)
+        return thread_perf;
+    perf_thread_t *t = calloc(1, sizeof(perf_thread_t));
+    if(!t)
+        return NULL;
+    open_counters(t);
+    pthread_mutex_lock(&perf.lock);
+    t->next = perf.threads;
+    perf.threads = t;
+    perf.thread_count++;
+    pthread_mutex_unlock(&perf.lock);
+    thread_perf = t;
+    return t;
+}
+
+static void read_counters(perf_thread_t *t, uint64_t v[PERF_EVENTS])
+{
+    uint64_t buf[1 + PERF_EVENTS];
+    memset(v, 0, PERF_EVENTS * sizeof(uint64_t));
+    if(!t->count || read(t->fd[t->order[0]], buf, sizeof(buf)) < (ssize_t)sizeof(uint64_t))
+        return;
+    for(int i = 0; i < MIN((int)buf[0], t->count); i++)
+        v[t->order[i]] = buf[1 + i];
+}
+
+int perf_open(int first, int frames)
+{
+    pthread_mutex_init(&perf.lock, NULL);
+    int any = 0, err = 0;
+    for(int e = 0; e < PERF_EVENTS; e++) {
+        int fd = open_event(e, -1);
+        if(fd < 0 && (errno == EACCES || errno == EPERM) && !perf.exclude_kernel) {
+            perf.exclude_kernel = 1;
+            fd = open_event(e, -1);
+        }
+        if(fd < 0) {
+            err = errno;
+            continue;
+        }
+        close(fd);
+        perf.have[e] = 1;
+        any = 1;
+    }
+    if(!any) {
+        fprintf(stderr, "error: perf_event_open failed: %s (see /proc/sys/kernel/perf_event_paranoid)\n", strerror(err));
+        pthread_mutex_destroy(&perf.lock);
+        return -1;
+    }
+    perf.first = first;
+    perf.frames = frames;
+    perf.bucket_frames = frames > 0 ? (frames + PERF_BUCKETS - 1) / PERF_BUCKETS : 1000;
+    perf.buckets = frames > 0 ? (frames + perf.bucket_frames - 1) / perf.bucket_frames : PERF_BUCKETS;
+    perf.on = 1;
+    return 0;
+}
+
+void perf_begin(perf_span_t *s, int stage, int frame)
+{
+    s->outer = -1;
+    if(!perf.on || stage < 0)
+        return;
+    perf_thread_t *t = get_thread();
+    if(!t)
+        return;
+    s->outer = !t->depth++;
+    if(!s->outer)
+        return;
+    t->stage = stage;
+    t->frame = frame;
+    read_counters(t, s->v);
+}
+
+void perf_end(perf_span_t *s)
+{
+    if(s->outer < 0)
+        return;
+    perf_thread_t *t = thread_perf;
+    t->depth--;
+    if(!s->outer)
+        return;
+    uint64_t v[PERF_EVENTS];
+    read_counters(t, v);
+    int b = -1;
+    if(t->frame >= 0)
+        b = MIN(MAX((t->frame - perf.first) / perf.bucket_frames, 0), perf.buckets - 1);
+    for(int e = 0; e < PERF_EVENTS; e++) {
+        t->total[t->stage][e] += v[e] - s->v[e];
+        if(b >= 0)
+            t->bucket[t->stage][b][e] += v[e] - s->v[e];
+    }
+}
+
+void perf_current(int *stage, int *frame)
+{
+    perf_thread_t *t = thread_perf;
+    *stage = perf.on && t && t->depth ? t->stage : -1;
+    *frame = *stage >= 0 ? t->frame : -1;
+}
+
+static void print_row(FILE *fh, const char *name, const uint64_t v[PERF_EVENTS])
+{
+    char col[PERF_EVENTS + 2][16];
+    for(int e = 0; e < PERF_EVENTS; e++) {
+        if(!perf.have[e])
+            strcpy(col[e], "-");
+        else if(e <= PERF_LLC_MISSES)
+            snprintf(col[e], sizeof(col[e]), "%.2f", v[e] / 1e6);
+        else
+            snprintf(col[e], sizeof(col[e]), "%"PRIu64, v[e]);
+    }
+    int ipc = perf.have[PERF_CYCLES] && perf.have[PERF_INSTRUCTIONS] && v[PERF_CYCLES];
+    int mpki = perf.have[PERF_INSTRUCTIONS] && perf.have[PERF_LLC_MISSES] && v[PERF_INSTRUCTIONS];
+    snprintf(col[PERF_EVENTS], sizeof(col[0]), ipc ? "%.2f" : "-", ipc ? (double)v[PERF_INSTRUCTIONS] / v[PERF_CYCLES] : 0.);
+    snprintf(col[PERF_EVENTS+1], sizeof(col[0]), mpki ? "%.2f" : "-",
+             mpki ? v[PERF_LLC_MISSES] * 1000. / v[PERF_INSTRUCTIONS] : 0.);
+    fprintf(fh, "  %-20.20s %10s %10s %5s %10s %6s %8s %8s\n", name, col[PERF_CYCLES], col[PERF_INSTRUCTIONS],
+            col[PERF_EVENTS], col[PERF_LLC_MISSES], col[PERF_EVENTS+1], col[PERF_CTX_SWITCHES], col[PERF_PAGE_FAULTS]);
+}
+
+static void print_report(FILE *fh)
+{
+    static const char * const stage_names[BENCH_STAGES] = {"get_frame", "convert", "write"};
+    uint64_t total[BENCH_STAGES][PERF_EVENTS] = {{0}};
+    uint64_t bucket[BENCH_STAGES][PERF_BUCKETS][PERF_EVENTS] = {{{0}}};
+    for(perf_thread_t *t = perf.threads; t; t = t->next)
+        for(int s = 0; s < BENCH_STAGES; s++)
+            for(int e = 0; e < PERF_EVENTS; e++) {
+                total[s][e] += t->total[s][e];
+                for(int b = 0; b < perf.buckets; b++)
+                    bucket[s][b][e] += t->bucket[s][b][e];
+            }
+
+    fprintf(fh, "perf: counters of %d threads, %s", perf.thread_count,
+            perf.exclude_kernel ? "user space only" : "user space and kernel");
+    for(int e = 0; e < PERF_EVENTS; e++)
+        if(!perf.have[e])
+            fprintf(fh, ", no %s", events[e].name);
+    fprintf(fh, "\n  %-20s %10s %10s %5s %10s %6s %8s %8s\n", "stage", "Mcycles", "Minstr", "IPC",
+            "M LLC miss", "MPKI", "ctx sw", "faults");
+    for(int s = 0; s < BENCH_STAGES; s++)
+        print_row(fh, stage_names[s], total[s]);
+    /* queued outfiles are written on writer threads which don't know the frame,
+       so their writes are only in the totals */
+    for(int b = 0; b < perf.buckets; b++) {
+        int first = perf.first + b * perf.bucket_frames;
+        int last = b < perf.buckets - 1 || perf.frames <= 0 ? first + perf.bucket_frames - 1
+                 : perf.first + perf.frames - 1;
+        for(int s = 0; s < BENCH_STAGES; s++) {
+            char name[48];
+            if(b == perf.buckets - 1 && perf.frames <= 0)
+                snprintf(name, sizeof(name), "%d- %s", first, stage_names[s]);
+            else
+                snprintf(name, sizeof(name), "%d-%d %s", first, last, stage_names[s]);
+            print_row(fh, name, bucket[s][b]);
+        }
+    }
+}
+
+void perf_close(FILE *fh)
+{
+    if(!perf.on)
+        return;
+    perf.on = 0;
+    if(fh)
+        print_report(fh);
+    while(perf.threads) {
+        perf_thread_t *t = perf.threads;
+        perf.threads = t->next;
+        for(int e = 0; e < PERF_EVENTS; e++)
+            if(t->fd[e] >= 0)
+                close(t->fd[e]);
+        free(t);
+    }
+    thread_perf = NULL;
+    pthread_mutex_destroy(&perf.lock);
+}
+
+#else
+
+int perf_open(int first, int frames)
+{
+    fprintf(stderr, "error: -perf needs Linux perf_event_open\n");
+    return -1;
+}
+
+void perf_close(FILE *fh)
+{
+}
+
+void perf_begin(perf_span_t *s, int stage, int frame)
+{
+}
+
+void perf_end(perf_span_t *s)
+{
+}
+
+void perf_current(int *stage, int *frame)
+{
+    *stage = *frame = -1;
+}
+
+#endif
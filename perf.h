@@ -0,0 +1,47 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#ifndef AVS2YUV_PERF_H
+#define AVS2YUV_PERF_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "bench.h"
+
+/* hardware and software counters (perf_event_open, Linux only) of the stages of the frame
+   loop, BENCH_GET_FRAME/CONVERT/WRITE. Each thread counts itself; a span on a thread
+   covers the jobs it hands to the pool, which count themselves on the workers under the
+   same stage and frame, so a stage adds up over every thread that worked on it */
+
+#define PERF_CYCLES       0
+#define PERF_INSTRUCTIONS 1
+#define PERF_LLC_MISSES   2
+#define PERF_CTX_SWITCHES 3
+#define PERF_PAGE_FAULTS  4
+#define PERF_EVENTS       5
+
+#define PERF_BUCKETS      8 // frame ranges reported separately
+
+typedef struct
+{
+    uint64_t v[PERF_EVENTS];
+    int outer; // 1 for the thread's outermost span, the one that counts, 0 inside it, -1 off
+} perf_span_t;
+
+/* starts counting, on the frames first..first+frames-1 (frames <= 0 when not known) */
+int perf_open(int first, int frames);
+/* prints the counts by stage and by frame range to fh (unless NULL) and stops counting;
+   the threads which counted must have exited or be idle */
+void perf_close(FILE *fh);
+/* counts the calling thread's events from here to perf_end under stage and frame
+   (frame < 0 for none); a span inside another one on the same thread is a no-op */
+void perf_begin(perf_span_t *s, int stage, int frame);
+void perf_end(perf_span_t *s);
+/* the stage and frame of the calling thread's span, stage < 0 outside of one */
+void perf_current(int *stage, int *frame);
+
+#endif
@@ -0,0 +1,1284 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#include <string.h>
+#include "common.h"
+#include "pixel.h"
+#include "cpu.h"
+
+/* the SIMD kernels are built for their instruction set whatever the compiler targets
+   by default, and only bound by pixel_init_cpu when the CPU has it */
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__i386__) || defined(__x86_64__))
+#include <immintrin.h>
+#define HAVE_X86 1
+#define TARGET(isa) __attribute__((target(isa)))
+/* GCC doesn't align the stack for spilled ymm/zmm registers on 64-bit Windows (bug 54412) */
+#if !defined(_WIN64) || defined(__clang__)
+#define HAVE_AVX 1
+#endif
+#endif
+
+#define FILTER_ROUND (1 << (FILTER_SHIFT-1))
+#define SCALE_ROUND (1 << (SCALE_SHIFT-1))
+
+static inline int clip3(int v, int lo, int hi)
+{
+    return v < lo ? lo : v > hi ? hi : v;
+}
+
+/****************************************************************************
+ * C
+ ****************************************************************************/
+
+static void vfilter_8_c(uint8_t *dst, const uint8_t **src, const int16_t *coef, int taps, int width, int max)
+{
+    for(int x = 0; x < width; x++) {
+        int sum = FILTER_ROUND;
+        for(int t = 0; t < taps; t++)
+            sum += coef[t] * src[t][x];
+        dst[x] = clip3(sum >> FILTER_SHIFT, 0, max);
+    }
+}
+
+static void vfilter_16_c(uint8_t *dst8, const uint8_t **src8, const int16_t *coef, int taps, int width, int max)
+{
+    uint16_t *dst = (uint16_t*)dst8;
+    for(int x = 0; x < width; x++) {
+        int sum = FILTER_ROUND;
+        for(int t = 0; t < taps; t++)
+            sum += coef[t] * ((const uint16_t*)src8[t])[x];
+        dst[x] = clip3(sum >> FILTER_SHIFT, 0, max);
+    }
+}
+
+static void hfilter_8_c(uint8_t *dst, const uint8_t *src, const int16_t *coef, int taps, int width, int max)
+{
+    for(int x = 0; x < width; x++) {
+        int sum = FILTER_ROUND;
+        for(int t = 0; t < taps; t++)
+            sum += coef[t] * src[2*x+t];
+        dst[x] = clip3(sum >> FILTER_SHIFT, 0, max);
+    }
+}
+
+static void hfilter_16_c(uint8_t *dst8, const uint8_t *src8, const int16_t *coef, int taps, int width, int max)
+{
+    uint16_t *dst = (uint16_t*)dst8;
+    const uint16_t *src = (const uint16_t*)src8;
+    for(int x = 0; x < width; x++) {
+        int sum = FILTER_ROUND;
+        for(int t = 0; t < taps; t++)
+            sum += coef[t] * src[2*x+t];
+        dst[x] = clip3(sum >> FILTER_SHIFT, 0, max);
+    }
+}
+
+static void vscale_8_c(uint8_t *dst, const uint8_t **src, const int16_t *coef, int taps, int width, int max)
+{
+    for(int x = 0; x < width; x++) {
+        int sum = SCALE_ROUND;
+        for(int t = 0; t < taps; t++)
+            sum += coef[t] * src[t][x];
+        dst[x] = clip3(sum >> SCALE_SHIFT, 0, max);
+    }
+}
+
+static void vscale_16_c(uint8_t *dst8, const uint8_t **src8, const int16_t *coef, int taps, int width, int max)
+{
+    uint16_t *dst = (uint16_t*)dst8;
+    for(int x = 0; x < width; x++) {
+        int sum = SCALE_ROUND;
+        for(int t = 0; t < taps; t++)
+            sum += coef[t] * ((const uint16_t*)src8[t])[x];
+        dst[x] = clip3(sum >> SCALE_SHIFT, 0, max);
+    }
+}
+
+static void hscale_8_c(uint8_t *dst, const uint8_t *src, const int16_t *coef, const int *offset, int taps, int width, int max)
+{
+    for(int x = 0; x < width; x++, coef += taps) {
+        int sum = SCALE_ROUND;
+        for(int t = 0; t < taps; t++)
+            sum += coef[t] * src[offset[x]+t];
+        dst[x] = clip3(sum >> SCALE_SHIFT, 0, max);
+    }
+}
+
+static void hscale_16_c(uint8_t *dst8, const uint8_t *src8, const int16_t *coef, const int *offset, int taps, int width, int max)
+{
+    uint16_t *dst = (uint16_t*)dst8;
+    const uint16_t *src = (const uint16_t*)src8;
+    for(int x = 0; x < width; x++, coef += taps) {
+        int sum = SCALE_ROUND;
+        for(int t = 0; t < taps; t++)
+            sum += coef[t] * src[offset[x]+t];
+        dst[x] = clip3(sum >> SCALE_SHIFT, 0, max);
+    }
+}
+
+static void interleave_uv_8_c(uint8_t *dst, const uint8_t *u, const uint8_t *v, int width, int shift)
+{
+    for(int x = 0; x < width; x++) {
+        dst[2*x]   = u[x];
+        dst[2*x+1] = v[x];
+    }
+}
+
+static void interleave_uv_16_c(uint8_t *dst8, const uint8_t *u8, const uint8_t *v8, int width, int shift)
+{
+    uint16_t *dst = (uint16_t*)dst8;
+    const uint16_t *u = (const uint16_t*)u8, *v = (const uint16_t*)v8;
+    for(int x = 0; x < width; x++) {
+        dst[2*x]   = u[x] << shift;
+        dst[2*x+1] = v[x] << shift;
+    }
+}
+
+static void copy_shl_16_c(uint8_t *dst8, const uint8_t *src8, int width, int shift)
+{
+    uint16_t *dst = (uint16_t*)dst8;
+    const uint16_t *src = (const uint16_t*)src8;
+    for(int x = 0; x < width; x++)
+        dst[x] = src[x] << shift;
+}
+
+static void depth_down_8_c(uint8_t *dst, const uint8_t *src8, int width, int shift, int max)
+{
+    const uint16_t *src = (const uint16_t*)src8;
+    int round = 1 << (shift - 1);
+    for(int x = 0; x < width; x++)
+        dst[x] = MIN((src[x] + round) >> shift, max);
+}
+
+static void depth_down_16_c(uint8_t *dst8, const uint8_t *src8, int width, int shift, int max)
+{
+    uint16_t *dst = (uint16_t*)dst8;
+    const uint16_t *src = (const uint16_t*)src8;
+    int round = 1 << (shift - 1);
+    for(int x = 0; x < width; x++)
+        dst[x] = MIN((src[x] + round) >> shift, max);
+}
+
+static void depth_up_8_c(uint8_t *dst8, const uint8_t *src, int width, int shift)
+{
+    uint16_t *dst = (uint16_t*)dst8;
+    for(int x = 0; x < width; x++)
+        dst[x] = src[x] << shift;
+}
+
+static void pack_uyvy_c(uint8_t *dst, const uint8_t *y, const uint8_t *u, const uint8_t *v, int width)
+{
+    for(int x = 0; x < width; x += 2) {
+        dst[2*x]   = u[x>>1];
+        dst[2*x+1] = y[x];
+        dst[2*x+2] = v[x>>1];
+        dst[2*x+3] = y[x+1];
+    }
+}
+
+static void pack_y210_c(uint8_t *dst8, const uint8_t *y8, const uint8_t *u8, const uint8_t *v8, int width, int shift)
+{
+    uint16_t *dst = (uint16_t*)dst8;
+    const uint16_t *y = (const uint16_t*)y8, *u = (const uint16_t*)u8, *v = (const uint16_t*)v8;
+    for(int x = 0; x < width; x += 2) {
+        dst[2*x]   = y[x] << shift;
+        dst[2*x+1] = u[x>>1] << shift;
+        dst[2*x+2] = y[x+1] << shift;
+        dst[2*x+3] = v[x>>1] << shift;
+    }
+}
+
+/* v210 stores the UYVY sample order as three 10-bit samples per 32-bit word,
+   6 pixels in 16 bytes; samples past width are zero */
+static void pack_v210_c(uint8_t *dst8, const uint8_t *y8, const uint8_t *u8, const uint8_t *v8, int width)
+{
+    uint32_t *dst = (uint32_t*)dst8;
+    const uint16_t *y = (const uint16_t*)y8, *u = (const uint16_t*)u8, *v = (const uint16_t*)v8;
+    for(int x = 0; x < width; x += 6) {
+        uint32_t s[12] = {0};
+        for(int i = 0; i < 6 && x + i < width; i += 2) {
+            s[2*i]   = u[(x+i)>>1];
+            s[2*i+1] = y[x+i];
+            s[2*i+2] = v[(x+i)>>1];
+            s[2*i+3] = y[x+i+1];
+        }
+        for(int i = 0; i < 4; i++)
+            *dst++ = s[3*i] | s[3*i+1] << 10 | s[3*i+2] << 20;
+    }
+}
+
+static inline int mid_pred(int a, int b, int c)
+{
+    return MAX(MIN(a, b), MIN(MAX(a, b), c));
+}
+
+static void median_residual_c(uint8_t *dst, const uint8_t *top, const uint8_t *cur, int width)
+{
+    for(int x = 0; x < width; x++)
+        dst[x] = cur[x] - mid_pred(cur[x-1], top[x], (cur[x-1] + top[x] - top[x-1]) & 0xFF);
+}
+
+static uint64_t ssd_8_c(const uint8_t *a, const uint8_t *b, int width)
+{
+    uint64_t sum = 0;
+    for(int x = 0; x < width; x++)
+        sum += (a[x] - b[x]) * (a[x] - b[x]);
+    return sum;
+}
+
+static uint64_t ssd_16_c(const uint8_t *a8, const uint8_t *b8, int width)
+{
+    const uint16_t *a = (const uint16_t*)a8;
+    const uint16_t *b = (const uint16_t*)b8;
+    uint64_t sum = 0;
+    for(int x = 0; x < width; x++)
+        sum += (int64_t)(a[x] - b[x]) * (a[x] - b[x]);
+    return sum;
+}
+
+static void ssim_4x4_8_c(int64_t (*sums)[4], const uint8_t *a, intptr_t a_stride, const uint8_t *b, intptr_t b_stride, int blocks)
+{
+    for(int i = 0; i < blocks; i++, a += 4, b += 4) {
+        int s1 = 0, s2 = 0, ss = 0, s12 = 0;
+        for(int y = 0; y < 4; y++)
+            for(int x = 0; x < 4; x++) {
+                int pa = a[y*a_stride + x];
+                int pb = b[y*b_stride + x];
+                s1 += pa;
+                s2 += pb;
+                ss += pa*pa + pb*pb;
+                s12 += pa*pb;
+            }
+        sums[i][0] = s1;
+        sums[i][1] = s2;
+        sums[i][2] = ss;
+        sums[i][3] = s12;
+    }
+}
+
+static void ssim_4x4_16_c(int64_t (*sums)[4], const uint8_t *a8, intptr_t a_stride, const uint8_t *b8, intptr_t b_stride, int blocks)
+{
+    for(int i = 0; i < blocks; i++, a8 += 8, b8 += 8) {
+        int64_t s1 = 0, s2 = 0, ss = 0, s12 = 0;
+        for(int y = 0; y < 4; y++) {
+            const uint16_t *a = (const uint16_t*)(a8 + y*a_stride);
+            const uint16_t *b = (const uint16_t*)(b8 + y*b_stride);
+            for(int x = 0; x < 4; x++) {
+                int64_t pa = a[x], pb = b[x];
+                s1 += pa;
+                s2 += pb;
+                ss += pa*pa + pb*pb;
+                s12 += pa*pb;
+            }
+        }
+        sums[i][0] = s1;
+        sums[i][1] = s2;
+        sums[i][2] = ss;
+        sums[i][3] = s12;
+    }
+}
+
+/* CRC32C (Castagnoli, reflected 0x82F63B78), sliced by 8 */
+static uint32_t crc32c_table[8][256];
+
+static void crc32c_init(void)
+{
+    for(int i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for(int k = 0; k < 8; k++)
+            c = c & 1 ? (c >> 1) ^ 0x82F63B78 : c >> 1;
+        crc32c_table[0][i] = c;
+    }
+    for(int i = 0; i < 256; i++)
+        for(int t = 1; t < 8; t++)
+            crc32c_table[t][i] = (crc32c_table[t-1][i] >> 8) ^ crc32c_table[0][crc32c_table[t-1][i] & 0xFF];
+}
+
+static uint32_t crc32c_c(uint32_t crc, const uint8_t *src, size_t size)
+{
+    crc = ~crc;
+    for(; size && ((uintptr_t)src & 7); size--)
+        crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *src++) & 0xFF];
+    for(; size >= 8; size -= 8, src += 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, src, 4);
+        memcpy(&hi, src + 4, 4);
+        lo ^= crc; // little endian
+        crc = crc32c_table[7][lo & 0xFF] ^ crc32c_table[6][(lo >> 8) & 0xFF] ^
+              crc32c_table[5][(lo >> 16) & 0xFF] ^ crc32c_table[4][lo >> 24] ^
+              crc32c_table[3][hi & 0xFF] ^ crc32c_table[2][(hi >> 8) & 0xFF] ^
+              crc32c_table[1][(hi >> 16) & 0xFF] ^ crc32c_table[0][hi >> 24];
+    }
+    for(; size; size--)
+        crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *src++) & 0xFF];
+    return ~crc;
+}
+
+/****************************************************************************
+ * SSE2
+ ****************************************************************************/
+
+#ifdef HAVE_X86
+/* 16-bit samples don't fit pmaddwd's signed inputs, so they are biased by -32768.
+   As the coefficients sum up to 1 << shift the bias comes out of the
+   filter unchanged and is removed again while clipping */
+static inline TARGET("sse2") __m128i pack_biased_16(__m128i lo, __m128i hi, __m128i round, __m128i max_biased, int shift)
+{
+    lo = _mm_srai_epi32(_mm_add_epi32(lo, round), shift);
+    hi = _mm_srai_epi32(_mm_add_epi32(hi, round), shift);
+    __m128i r = _mm_min_epi16(_mm_packs_epi32(lo, hi), max_biased);
+    return _mm_xor_si128(r, _mm_set1_epi16(-0x8000));
+}
+
+static inline TARGET("sse2") __m128i coef_pair(const int16_t *coef, int t)
+{
+    return _mm_set1_epi32((coef[t] & 0xffff) | ((uint32_t)coef[t+1] << 16));
+}
+
+static TARGET("sse2") void vfilter_8_sse2(uint8_t *dst, const uint8_t **src, const int16_t *coef, int taps, int width, int max)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi16(FILTER_ROUND);
+    int x = 0;
+    for(; x <= width - 16; x += 16) {
+        __m128i lo = round, hi = round;
+        for(int t = 0; t < taps; t++) {
+            __m128i c = _mm_set1_epi16(coef[t]);
+            __m128i s = _mm_loadu_si128((const __m128i*)(src[t] + x));
+            lo = _mm_add_epi16(lo, _mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), c));
+            hi = _mm_add_epi16(hi, _mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), c));
+        }
+        lo = _mm_srai_epi16(lo, FILTER_SHIFT);
+        hi = _mm_srai_epi16(hi, FILTER_SHIFT);
+        _mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(lo, hi));
+    }
+    if(x < width) {
+        const uint8_t *tail[FILTER_MAX_TAPS];
+        for(int t = 0; t < taps; t++)
+            tail[t] = src[t] + x;
+        vfilter_8_c(dst + x, tail, coef, taps, width - x, max);
+    }
+}
+
+static TARGET("sse2") void vfilter_16_sse2(uint8_t *dst, const uint8_t **src, const int16_t *coef, int taps, int width, int max)
+{
+    const __m128i bias = _mm_set1_epi16(-0x8000);
+    const __m128i round = _mm_set1_epi32(FILTER_ROUND);
+    const __m128i max_biased = _mm_set1_epi16(max - 0x8000);
+    int x = 0;
+    for(; x <= width - 8; x += 8) {
+        __m128i lo = _mm_setzero_si128(), hi = _mm_setzero_si128();
+        for(int t = 0; t < taps; t += 2) {
+            __m128i a = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(src[t] + 2*x)), bias);
+            __m128i b = t+1 < taps ? _mm_xor_si128(_mm_loadu_si128((const __m128i*)(src[t+1] + 2*x)), bias) : _mm_setzero_si128();
+            __m128i c = t+1 < taps ? coef_pair(coef, t) : _mm_set1_epi32(coef[t] & 0xffff);
+            lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), c));
+            hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), c));
+        }
+        _mm_storeu_si128((__m128i*)(dst + 2*x), pack_biased_16(lo, hi, round, max_biased, FILTER_SHIFT));
+    }
+    if(x < width) {
+        const uint8_t *tail[FILTER_MAX_TAPS];
+        for(int t = 0; t < taps; t++)
+            tail[t] = src[t] + 2*x;
+        vfilter_16_c(dst + 2*x, tail, coef, taps, width - x, max);
+    }
+}
+
+/* pmaddwd on the word pairs (s[2x+t], s[2x+t+1]) applies two taps to one
+   output at once, so each load yields 4 outputs worth of two taps */
+static TARGET("sse2") void hfilter_8_sse2(uint8_t *dst, const uint8_t *src, const int16_t *coef, int taps, int width, int max)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(FILTER_ROUND);
+    int x = 0;
+    for(; x <= width - 8; x += 8) {
+        __m128i lo = round, hi = round;
+        for(int t = 0; t < taps; t += 2) {
+            __m128i c = coef_pair(coef, t);
+            __m128i s = _mm_loadu_si128((const __m128i*)(src + 2*x + t));
+            lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi8(s, zero), c));
+            hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi8(s, zero), c));
+        }
+        lo = _mm_srai_epi32(lo, FILTER_SHIFT);
+        hi = _mm_srai_epi32(hi, FILTER_SHIFT);
+        __m128i r = _mm_packs_epi32(lo, hi);
+        _mm_storel_epi64((__m128i*)(dst + x), _mm_packus_epi16(r, r));
+    }
+    if(x < width)
+        hfilter_8_c(dst + x, src + 2*x, coef, taps, width - x, max);
+}
+
+static TARGET("sse2") void hfilter_16_sse2(uint8_t *dst, const uint8_t *src, const int16_t *coef, int taps, int width, int max)
+{
+    const __m128i bias = _mm_set1_epi16(-0x8000);
+    const __m128i round = _mm_set1_epi32(FILTER_ROUND);
+    const __m128i max_biased = _mm_set1_epi16(max - 0x8000);
+    int x = 0;
+    for(; x <= width - 8; x += 8) {
+        __m128i lo = _mm_setzero_si128(), hi = _mm_setzero_si128();
+        for(int t = 0; t < taps; t += 2) {
+            __m128i c = coef_pair(coef, t);
+            __m128i a = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(src + 2*(2*x + t))), bias);
+            __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(src + 2*(2*x + 8 + t))), bias);
+            lo = _mm_add_epi32(lo, _mm_madd_epi16(a, c));
+            hi = _mm_add_epi32(hi, _mm_madd_epi16(b, c));
+        }
+        _mm_storeu_si128((__m128i*)(dst + 2*x), pack_biased_16(lo, hi, round, max_biased, FILTER_SHIFT));
+    }
+    if(x < width)
+        hfilter_16_c(dst + 2*x, src + 2*2*x, coef, taps, width - x, max);
+}
+
+static TARGET("sse2") void vscale_8_sse2(uint8_t *dst, const uint8_t **src, const int16_t *coef, int taps, int width, int max)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(SCALE_ROUND);
+    int x = 0;
+    for(; x <= width - 8; x += 8) {
+        __m128i lo = round, hi = round;
+        for(int t = 0; t < taps; t += 2) {
+            __m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(src[t] + x)), zero);
+            __m128i b = t+1 < taps ? _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(src[t+1] + x)), zero) : zero;
+            __m128i c = t+1 < taps ? coef_pair(coef, t) : _mm_set1_epi32(coef[t] & 0xffff);
+            lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), c));
+            hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), c));
+        }
+        __m128i r = _mm_packs_epi32(_mm_srai_epi32(lo, SCALE_SHIFT), _mm_srai_epi32(hi, SCALE_SHIFT));
+        _mm_storel_epi64((__m128i*)(dst + x), _mm_packus_epi16(r, r));
+    }
+    if(x < width) {
+        const uint8_t *tail[SCALE_MAX_TAPS];
+        for(int t = 0; t < taps; t++)
+            tail[t] = src[t] + x;
+        vscale_8_c(dst + x, tail, coef, taps, width - x, max);
+    }
+}
+
+static TARGET("sse2") void vscale_16_sse2(uint8_t *dst, const uint8_t **src, const int16_t *coef, int taps, int width, int max)
+{
+    const __m128i bias = _mm_set1_epi16(-0x8000);
+    const __m128i round = _mm_set1_epi32(SCALE_ROUND);
+    const __m128i max_biased = _mm_set1_epi16(max - 0x8000);
+    int x = 0;
+    for(; x <= width - 8; x += 8) {
+        __m128i lo = _mm_setzero_si128(), hi = _mm_setzero_si128();
+        for(int t = 0; t < taps; t += 2) {
+            __m128i a = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(src[t] + 2*x)), bias);
+            __m128i b = t+1 < taps ? _mm_xor_si128(_mm_loadu_si128((const __m128i*)(src[t+1] + 2*x)), bias) : _mm_setzero_si128();
+            __m128i c = t+1 < taps ? coef_pair(coef, t) : _mm_set1_epi32(coef[t] & 0xffff);
+            lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), c));
+            hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), c));
+        }
+        _mm_storeu_si128((__m128i*)(dst + 2*x), pack_biased_16(lo, hi, round, max_biased, SCALE_SHIFT));
+    }
+    if(x < width) {
+        const uint8_t *tail[SCALE_MAX_TAPS];
+        for(int t = 0; t < taps; t++)
+            tail[t] = src[t] + 2*x;
+        vscale_16_c(dst + 2*x, tail, coef, taps, width - x, max);
+    }
+}
+
+/* four outputs at a time, each a dot product of 4-tap blocks; the two partial
+   sums pmaddwd leaves per output are added up after a transpose */
+static inline TARGET("sse2") __m128i hsum_4x2(__m128i a0, __m128i a1, __m128i a2, __m128i a3)
+{
+    __m128i t0 = _mm_unpacklo_epi32(a0, a1);
+    __m128i t1 = _mm_unpacklo_epi32(a2, a3);
+    return _mm_add_epi32(_mm_unpacklo_epi64(t0, t1), _mm_unpackhi_epi64(t0, t1));
+}
+
+static TARGET("sse2") void hscale_8_sse2(uint8_t *dst, const uint8_t *src, const int16_t *coef, const int *offset, int taps, int width, int max)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(SCALE_ROUND);
+    int x = 0;
+    for(; x <= width - 4; x += 4) {
+        __m128i acc[4];
+        for(int i = 0; i < 4; i++) {
+            const uint8_t *s = src + offset[x+i];
+            const int16_t *c = coef + (x+i) * taps;
+            acc[i] = zero;
+            for(int t = 0; t < taps; t += 4) {
+                uint32_t v;
+                memcpy(&v, s + t, 4);
+                __m128i a = _mm_unpacklo_epi8(_mm_cvtsi32_si128(v), zero);
+                acc[i] = _mm_add_epi32(acc[i], _mm_madd_epi16(a, _mm_loadl_epi64((const __m128i*)(c + t))));
+            }
+        }
+        __m128i r = _mm_srai_epi32(_mm_add_epi32(hsum_4x2(acc[0], acc[1], acc[2], acc[3]), round), SCALE_SHIFT);
+        r = _mm_packs_epi32(r, r);
+        uint32_t out = _mm_cvtsi128_si32(_mm_packus_epi16(r, r));
+        memcpy(dst + x, &out, 4);
+    }
+    if(x < width)
+        hscale_8_c(dst + x, src, coef + x * taps, offset + x, taps, width - x, max);
+}
+
+static TARGET("sse2") void hscale_16_sse2(uint8_t *dst, const uint8_t *src, const int16_t *coef, const int *offset, int taps, int width, int max)
+{
+    const __m128i bias = _mm_set1_epi16(-0x8000);
+    const __m128i round = _mm_set1_epi32(SCALE_ROUND);
+    const __m128i max_biased = _mm_set1_epi16(max - 0x8000);
+    int x = 0;
+    for(; x <= width - 4; x += 4) {
+        __m128i acc[4];
+        for(int i = 0; i < 4; i++) {
+            const uint8_t *s = src + 2 * offset[x+i];
+            const int16_t *c = coef + (x+i) * taps;
+            acc[i] = _mm_setzero_si128();
+            for(int t = 0; t < taps; t += 4) {
+                __m128i a = _mm_xor_si128(_mm_loadl_epi64((const __m128i*)(s + 2*t)), bias);
+                acc[i] = _mm_add_epi32(acc[i], _mm_madd_epi16(a, _mm_loadl_epi64((const __m128i*)(c + t))));
+            }
+        }
+        __m128i r = hsum_4x2(acc[0], acc[1], acc[2], acc[3]);
+        _mm_storel_epi64((__m128i*)(dst + 2*x), pack_biased_16(r, r, round, max_biased, SCALE_SHIFT));
+    }
+    if(x < width)
+        hscale_16_c(dst + 2*x, src, coef + x * taps, offset + x, taps, width - x, max);
+}
+
+static TARGET("sse2") void interleave_uv_8_sse2(uint8_t *dst, const uint8_t *u, const uint8_t *v, int width, int shift)
+{
+    int x = 0;
+    for(; x <= width - 16; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(u + x));
+        __m128i b = _mm_loadu_si128((const __m128i*)(v + x));
+        _mm_storeu_si128((__m128i*)(dst + 2*x), _mm_unpacklo_epi8(a, b));
+        _mm_storeu_si128((__m128i*)(dst + 2*x + 16), _mm_unpackhi_epi8(a, b));
+    }
+    interleave_uv_8_c(dst + 2*x, u + x, v + x, width - x, shift);
+}
+
+static TARGET("sse2") void interleave_uv_16_sse2(uint8_t *dst, const uint8_t *u, const uint8_t *v, int width, int shift)
+{
+    const __m128i sh = _mm_cvtsi32_si128(shift);
+    int x = 0;
+    for(; x <= width - 8; x += 8) {
+        __m128i a = _mm_sll_epi16(_mm_loadu_si128((const __m128i*)(u + 2*x)), sh);
+        __m128i b = _mm_sll_epi16(_mm_loadu_si128((const __m128i*)(v + 2*x)), sh);
+        _mm_storeu_si128((__m128i*)(dst + 4*x), _mm_unpacklo_epi16(a, b));
+        _mm_storeu_si128((__m128i*)(dst + 4*x + 16), _mm_unpackhi_epi16(a, b));
+    }
+    interleave_uv_16_c(dst + 4*x, u + 2*x, v + 2*x, width - x, shift);
+}
+
+static TARGET("sse2") void copy_shl_16_sse2(uint8_t *dst, const uint8_t *src, int width, int shift)
+{
+    const __m128i sh = _mm_cvtsi32_si128(shift);
+    int x = 0;
+    for(; x <= width - 16; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + 2*x));
+        __m128i b = _mm_loadu_si128((const __m128i*)(src + 2*x + 16));
+        _mm_storeu_si128((__m128i*)(dst + 2*x), _mm_sll_epi16(a, sh));
+        _mm_storeu_si128((__m128i*)(dst + 2*x + 16), _mm_sll_epi16(b, sh));
+    }
+    copy_shl_16_c(dst + 2*x, src + 2*x, width - x, shift);
+}
+
+/* saturating add of the rounding can only hit samples which are clipped to max anyway */
+static TARGET("sse2") void depth_down_8_sse2(uint8_t *dst, const uint8_t *src, int width, int shift, int max)
+{
+    const __m128i sh = _mm_cvtsi32_si128(shift);
+    const __m128i round = _mm_set1_epi16(1 << (shift - 1));
+    int x = 0;
+    for(; x <= width - 16; x += 16) {
+        __m128i a = _mm_srl_epi16(_mm_adds_epu16(_mm_loadu_si128((const __m128i*)(src + 2*x)), round), sh);
+        __m128i b = _mm_srl_epi16(_mm_adds_epu16(_mm_loadu_si128((const __m128i*)(src + 2*x + 16)), round), sh);
+        _mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(a, b));
+    }
+    depth_down_8_c(dst + x, src + 2*x, width - x, shift, max);
+}
+
+static TARGET("sse2") void depth_down_16_sse2(uint8_t *dst, const uint8_t *src, int width, int shift, int max)
+{
+    const __m128i sh = _mm_cvtsi32_si128(shift);
+    const __m128i round = _mm_set1_epi16(1 << (shift - 1));
+    const __m128i vmax = _mm_set1_epi16(max);
+    int x = 0;
+    for(; x <= width - 8; x += 8) {
+        __m128i a = _mm_srl_epi16(_mm_adds_epu16(_mm_loadu_si128((const __m128i*)(src + 2*x)), round), sh);
+        _mm_storeu_si128((__m128i*)(dst + 2*x), _mm_min_epi16(a, vmax));
+    }
+    depth_down_16_c(dst + 2*x, src + 2*x, width - x, shift, max);
+}
+
+static TARGET("sse2") void depth_up_8_sse2(uint8_t *dst, const uint8_t *src, int width, int shift)
+{
+    const __m128i sh = _mm_cvtsi32_si128(shift);
+    const __m128i zero = _mm_setzero_si128();
+    int x = 0;
+    for(; x <= width - 16; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + x));
+        _mm_storeu_si128((__m128i*)(dst + 2*x), _mm_sll_epi16(_mm_unpacklo_epi8(a, zero), sh));
+        _mm_storeu_si128((__m128i*)(dst + 2*x + 16), _mm_sll_epi16(_mm_unpackhi_epi8(a, zero), sh));
+    }
+    depth_up_8_c(dst + 2*x, src + x, width - x, shift);
+}
+
+static TARGET("sse2") void pack_uyvy_sse2(uint8_t *dst, const uint8_t *y, const uint8_t *u, const uint8_t *v, int width)
+{
+    int x = 0;
+    for(; x <= width - 16; x += 16) {
+        __m128i l = _mm_loadu_si128((const __m128i*)(y + x));
+        __m128i c = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(u + x/2)),
+                                      _mm_loadl_epi64((const __m128i*)(v + x/2)));
+        _mm_storeu_si128((__m128i*)(dst + 2*x), _mm_unpacklo_epi8(c, l));
+        _mm_storeu_si128((__m128i*)(dst + 2*x + 16), _mm_unpackhi_epi8(c, l));
+    }
+    pack_uyvy_c(dst + 2*x, y + x, u + x/2, v + x/2, width - x);
+}
+
+static TARGET("sse2") void pack_y210_sse2(uint8_t *dst, const uint8_t *y, const uint8_t *u, const uint8_t *v, int width, int shift)
+{
+    const __m128i sh = _mm_cvtsi32_si128(shift);
+    int x = 0;
+    for(; x <= width - 8; x += 8) {
+        __m128i l = _mm_sll_epi16(_mm_loadu_si128((const __m128i*)(y + 2*x)), sh);
+        __m128i c = _mm_sll_epi16(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(u + x)),
+                                                     _mm_loadl_epi64((const __m128i*)(v + x))), sh);
+        _mm_storeu_si128((__m128i*)(dst + 4*x), _mm_unpacklo_epi16(l, c));
+        _mm_storeu_si128((__m128i*)(dst + 4*x + 16), _mm_unpackhi_epi16(l, c));
+    }
+    pack_y210_c(dst + 4*x, y + 2*x, u + x, v + x, width - x, shift);
+}
+
+/* {a[i0], a[i1], b[i2], b[i3]} */
+#define SHUF32(a, b, i0, i1, i2, i3) \
+    _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(i3, i2, i1, i0)))
+
+/* 12 pixels per iteration. The UYVY sequence is split into every third pair of
+   samples, then each output word is pair + single << 20 or single + pair << 10 */
+static TARGET("sse2") void pack_v210_sse2(uint8_t *dst, const uint8_t *y, const uint8_t *u, const uint8_t *v, int width)
+{
+    const __m128i coef = _mm_set1_epi32(1 | 1024 << 16);
+    int x = 0;
+    for(; x <= width - 16; x += 12) {
+        __m128i l0 = _mm_loadu_si128((const __m128i*)(y + 2*x));
+        __m128i l1 = _mm_loadu_si128((const __m128i*)(y + 2*x + 16));
+        __m128i cu = _mm_loadu_si128((const __m128i*)(u + x));
+        __m128i cv = _mm_loadu_si128((const __m128i*)(v + x));
+        __m128i c0 = _mm_unpacklo_epi16(cu, cv);
+        __m128i c1 = _mm_unpackhi_epi16(cu, cv);
+        __m128i a = _mm_unpacklo_epi16(c0, l0); // u0y0 v0y1 u1y2 v1y3
+        __m128i b = _mm_unpackhi_epi16(c0, l0); // u2y4 v2y5 u3y6 v3y7
+        __m128i c = _mm_unpacklo_epi16(c1, l1); // u4y8 v4y9 u5y10 v5y11
+        __m128i t0 = SHUF32(b, c, 2, 0, 1, 0);
+        __m128i p0 = SHUF32(a, t0, 0, 3, 0, 2); // u0y0 v1y3 u3y6 v4y9
+        __m128i t1 = SHUF32(a, b, 1, 0, 0, 0);
+        __m128i t2 = SHUF32(b, c, 3, 0, 2, 0);
+        __m128i s  = SHUF32(t1, t2, 0, 2, 0, 2); // v0y1 u2y4 v3y7 u5y10
+        __m128i t3 = SHUF32(a, b, 2, 0, 1, 0);
+        __m128i p1 = SHUF32(t3, c, 0, 2, 0, 3); // u1y2 v2y5 u4y8 v5y11
+        __m128i even = _mm_add_epi32(_mm_madd_epi16(p0, coef), _mm_slli_epi32(s, 20));
+        __m128i odd  = _mm_add_epi32(_mm_srli_epi32(s, 16), _mm_slli_epi32(_mm_madd_epi16(p1, coef), 10));
+        _mm_storeu_si128((__m128i*)(dst + x/6*16), _mm_unpacklo_epi32(even, odd));
+        _mm_storeu_si128((__m128i*)(dst + x/6*16 + 16), _mm_unpackhi_epi32(even, odd));
+    }
+    pack_v210_c(dst + x/6*16, y + 2*x, u + x, v + x, width - x);
+}
+
+static TARGET("sse2") void median_residual_sse2(uint8_t *dst, const uint8_t *top, const uint8_t *cur, int width)
+{
+    int x = 0;
+    for(; x <= width - 16; x += 16) {
+        __m128i l  = _mm_loadu_si128((const __m128i*)(cur + x - 1));
+        __m128i t  = _mm_loadu_si128((const __m128i*)(top + x));
+        __m128i lt = _mm_loadu_si128((const __m128i*)(top + x - 1));
+        __m128i grad = _mm_sub_epi8(_mm_add_epi8(l, t), lt);
+        __m128i pred = _mm_max_epu8(_mm_min_epu8(l, t), _mm_min_epu8(_mm_max_epu8(l, t), grad));
+        _mm_storeu_si128((__m128i*)(dst + x), _mm_sub_epi8(_mm_loadu_si128((const __m128i*)(cur + x)), pred));
+    }
+    median_residual_c(dst + x, top + x, cur + x, width - x);
+}
+
+static TARGET("sse2") uint64_t ssd_8_sse2(const uint8_t *a, const uint8_t *b, int width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum = zero;
+    int x = 0;
+    for(; x <= width - 16; x += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + x));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + x));
+        __m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero));
+        __m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero));
+        __m128i d = _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi));
+        /* widened every time, a row of 32-bit lanes could overflow past 64k pixels */
+        sum = _mm_add_epi64(sum, _mm_add_epi64(_mm_unpacklo_epi32(d, zero), _mm_unpackhi_epi32(d, zero)));
+    }
+    uint64_t v[2];
+    _mm_storeu_si128((__m128i*)v, sum);
+    return v[0] + v[1] + ssd_8_c(a + x, b + x, width - x);
+}
+
+/* two blocks at a time: pmaddwd leaves the 4 sums of a row of block 0 in lanes 0-1, of block 1 in lanes 2-3 */
+static TARGET("sse2") void ssim_4x4_8_sse2(int64_t (*sums)[4], const uint8_t *a, intptr_t a_stride, const uint8_t *b, intptr_t b_stride, int blocks)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(1);
+    int i = 0;
+    for(; i <= blocks - 2; i += 2, a += 8, b += 8) {
+        __m128i s1 = zero, s2 = zero, ss = zero, s12 = zero;
+        for(int y = 0; y < 4; y++) {
+            __m128i va = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(a + y*a_stride)), zero);
+            __m128i vb = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(b + y*b_stride)), zero);
+            s1 = _mm_add_epi32(s1, _mm_madd_epi16(va, one));
+            s2 = _mm_add_epi32(s2, _mm_madd_epi16(vb, one));
+            ss = _mm_add_epi32(ss, _mm_add_epi32(_mm_madd_epi16(va, va), _mm_madd_epi16(vb, vb)));
+            s12 = _mm_add_epi32(s12, _mm_madd_epi16(va, vb));
+        }
+        int32_t v[4][4];
+        _mm_storeu_si128((__m128i*)v[0], s1);
+        _mm_storeu_si128((__m128i*)v[1], s2);
+        _mm_storeu_si128((__m128i*)v[2], ss);
+        _mm_storeu_si128((__m128i*)v[3], s12);
+        for(int k = 0; k < 4; k++) {
+            sums[i][k] = v[k][0] + v[k][1];
+            sums[i+1][k] = v[k][2] + v[k][3];
+        }
+    }
+    ssim_4x4_8_c(sums + i, a, a_stride, b, b_stride, blocks - i);
+}
+
+/****************************************************************************
+ * SSSE3, SSE4.2
+ ****************************************************************************/
+
+/* the squares of 16-bit differences overflow 32 bits, so the differences are made
+   absolute and squared into 64-bit lanes by pmuludq, the even and odd ones apart */
+static TARGET("ssse3") uint64_t ssd_16_ssse3(const uint8_t *a, const uint8_t *b, int width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum = zero;
+    int x = 0;
+    for(; x <= width - 8; x += 8) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + 2*x));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + 2*x));
+        __m128i lo = _mm_abs_epi32(_mm_sub_epi32(_mm_unpacklo_epi16(va, zero), _mm_unpacklo_epi16(vb, zero)));
+        __m128i hi = _mm_abs_epi32(_mm_sub_epi32(_mm_unpackhi_epi16(va, zero), _mm_unpackhi_epi16(vb, zero)));
+        sum = _mm_add_epi64(sum, _mm_add_epi64(_mm_mul_epu32(lo, lo), _mm_mul_epu32(hi, hi)));
+        lo = _mm_srli_epi64(lo, 32);
+        hi = _mm_srli_epi64(hi, 32);
+        sum = _mm_add_epi64(sum, _mm_add_epi64(_mm_mul_epu32(lo, lo), _mm_mul_epu32(hi, hi)));
+    }
+    uint64_t v[2];
+    _mm_storeu_si128((__m128i*)v, sum);
+    return v[0] + v[1] + ssd_16_c(a + 2*x, b + 2*x, width - x);
+}
+
+static TARGET("sse4.2") uint32_t crc32c_sse42(uint32_t crc, const uint8_t *src, size_t size)
+{
+    crc = ~crc;
+    for(; size && ((uintptr_t)src & 7); size--)
+        crc = _mm_crc32_u8(crc, *src++);
+#if defined(__x86_64__)
+    uint64_t crc64 = crc;
+    for(; size >= 8; size -= 8, src += 8) {
+        uint64_t v;
+        memcpy(&v, src, 8);
+        crc64 = _mm_crc32_u64(crc64, v);
+    }
+    crc = crc64;
+#endif
+    for(; size >= 4; size -= 4, src += 4) {
+        uint32_t v;
+        memcpy(&v, src, 4);
+        crc = _mm_crc32_u32(crc, v);
+    }
+    for(; size; size--)
+        crc = _mm_crc32_u8(crc, *src++);
+    return ~crc;
+}
+
+/****************************************************************************
+ * AVX2
+ ****************************************************************************/
+
+#ifdef HAVE_AVX
+#define AVX2 TARGET("avx2")
+
+/* the rest of a row after the wide loop goes to the kernel of the level below */
+
+static inline AVX2 __m256i coef_pair_avx2(const int16_t *coef, int t)
+{
+    return _mm256_set1_epi32((coef[t] & 0xffff) | ((uint32_t)coef[t+1] << 16));
+}
+
+/* as pack_biased_16; packssdw undoes the interleave of the in-lane unpacks feeding pmaddwd */
+static inline AVX2 __m256i pack_biased_16_avx2(__m256i lo, __m256i hi, __m256i round, __m256i max_biased, int shift)
+{
+    lo = _mm256_srai_epi32(_mm256_add_epi32(lo, round), shift);
+    hi = _mm256_srai_epi32(_mm256_add_epi32(hi, round), shift);
+    __m256i r = _mm256_min_epi16(_mm256_packs_epi32(lo, hi), max_biased);
+    return _mm256_xor_si256(r, _mm256_set1_epi16(-0x8000));
+}
+
+static AVX2 void vfilter_8_avx2(uint8_t *dst, const uint8_t **src, const int16_t *coef, int taps, int width, int max)
+{
+    const __m256i round = _mm256_set1_epi16(FILTER_ROUND);
+    int x = 0;
+    for(; x <= width - 32; x += 32) {
+        __m256i lo = round, hi = round;
+        for(int t = 0; t < taps; t++) {
+            __m256i c = _mm256_set1_epi16(coef[t]);
+            __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src[t] + x)));
+            __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src[t] + x + 16)));
+            lo = _mm256_add_epi16(lo, _mm256_mullo_epi16(a, c));
+            hi = _mm256_add_epi16(hi, _mm256_mullo_epi16(b, c));
+        }
+        lo = _mm256_srai_epi16(lo, FILTER_SHIFT);
+        hi = _mm256_srai_epi16(hi, FILTER_SHIFT);
+        /* packuswb packs within 128-bit lanes, leaving the quarters in the order 0 2 1 3 */
+        _mm256_storeu_si256((__m256i*)(dst + x), _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xd8));
+    }
+    if(x < width) {
+        const uint8_t *tail[FILTER_MAX_TAPS];
+        for(int t = 0; t < taps; t++)
+            tail[t] = src[t] + x;
+        vfilter_8_sse2(dst + x, tail, coef, taps, width - x, max);
+    }
+}
+
+static AVX2 void vfilter_16_avx2(uint8_t *dst, const uint8_t **src, const int16_t *coef, int taps, int width, int max)
+{
+    const __m256i bias = _mm256_set1_epi16(-0x8000);
+    const __m256i round = _mm256_set1_epi32(FILTER_ROUND);
+    const __m256i max_biased = _mm256_set1_epi16(max - 0x8000);
+    int x = 0;
+    for(; x <= width - 16; x += 16) {
+        __m256i lo = _mm256_setzero_si256(), hi = _mm256_setzero_si256();
+        for(int t = 0; t < taps; t += 2) {
+            __m256i a = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(src[t] + 2*x)), bias);
+            __m256i b = t+1 < taps ? _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(src[t+1] + 2*x)), bias) : _mm256_setzero_si256();
+            __m256i c = t+1 < taps ? coef_pair_avx2(coef, t) : _mm256_set1_epi32(coef[t] & 0xffff);
+            lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), c));
+            hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), c));
+        }
+        _mm256_storeu_si256((__m256i*)(dst + 2*x), pack_biased_16_avx2(lo, hi, round, max_biased, FILTER_SHIFT));
+    }
+    if(x < width) {
+        const uint8_t *tail[FILTER_MAX_TAPS];
+        for(int t = 0; t < taps; t++)
+            tail[t] = src[t] + 2*x;
+        vfilter_16_sse2(dst + 2*x, tail, coef, taps, width - x, max);
+    }
+}
+
+static AVX2 void vscale_8_avx2(uint8_t *dst, const uint8_t **src, const int16_t *coef, int taps, int width, int max)
+{
+    const __m256i round = _mm256_set1_epi32(SCALE_ROUND);
+    int x = 0;
+    for(; x <= width - 16; x += 16) {
+        __m256i lo = round, hi = round;
+        for(int t = 0; t < taps; t += 2) {
+            __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src[t] + x)));
+            __m256i b = t+1 < taps ? _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src[t+1] + x))) : _mm256_setzero_si256();
+            __m256i c = t+1 < taps ? coef_pair_avx2(coef, t) : _mm256_set1_epi32(coef[t] & 0xffff);
+            lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), c));
+            hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), c));
+        }
+        __m256i r = _mm256_packs_epi32(_mm256_srai_epi32(lo, SCALE_SHIFT), _mm256_srai_epi32(hi, SCALE_SHIFT));
+        r = _mm256_permute4x64_epi64(_mm256_packus_epi16(r, r), 0x08);
+        _mm_storeu_si128((__m128i*)(dst + x), _mm256_castsi256_si128(r));
+    }
+    if(x < width) {
+        const uint8_t *tail[SCALE_MAX_TAPS];
+        for(int t = 0; t < taps; t++)
+            tail[t] = src[t] + x;
+        vscale_8_sse2(dst + x, tail, coef, taps, width - x, max);
+    }
+}
+
+static AVX2 void vscale_16_avx2(uint8_t *dst, const uint8_t **src, const int16_t *coef, int taps, int width, int max)
+{
+    const __m256i bias = _mm256_set1_epi16(-0x8000);
+    const __m256i round = _mm256_set1_epi32(SCALE_ROUND);
+    const __m256i max_biased = _mm256_set1_epi16(max - 0x8000);
+    int x = 0;
+    for(; x <= width - 16; x += 16) {
+        __m256i lo = _mm256_setzero_si256(), hi = _mm256_setzero_si256();
+        for(int t = 0; t < taps; t += 2) {
+            __m256i a = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(src[t] + 2*x)), bias);
+            __m256i b = t+1 < taps ? _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(src[t+1] + 2*x)), bias) : _mm256_setzero_si256();
+            __m256i c = t+1 < taps ? coef_pair_avx2(coef, t) : _mm256_set1_epi32(coef[t] & 0xffff);
+            lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), c));
+            hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), c));
+        }
+        _mm256_storeu_si256((__m256i*)(dst + 2*x), pack_biased_16_avx2(lo, hi, round, max_biased, SCALE_SHIFT));
+    }
+    if(x < width) {
+        const uint8_t *tail[SCALE_MAX_TAPS];
+        for(int t = 0; t < taps; t++)
+            tail[t] = src[t] + 2*x;
+        vscale_16_sse2(dst + 2*x, tail, coef, taps, width - x, max);
+    }
+}
+
+/* the unpacks interleave within 128-bit lanes, which are put back in order by vperm2i128 */
+static AVX2 void interleave_uv_8_avx2(uint8_t *dst, const uint8_t *u, const uint8_t *v, int width, int shift)
+{
+    int x = 0;
+    for(; x <= width - 32; x += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(u + x));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(v + x));
+        __m256i lo = _mm256_unpacklo_epi8(a, b);
+        __m256i hi = _mm256_unpackhi_epi8(a, b);
+        _mm256_storeu_si256((__m256i*)(dst + 2*x), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i*)(dst + 2*x + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    interleave_uv_8_sse2(dst + 2*x, u + x, v + x, width - x, shift);
+}
+
+static AVX2 void interleave_uv_16_avx2(uint8_t *dst, const uint8_t *u, const uint8_t *v, int width, int shift)
+{
+    const __m128i sh = _mm_cvtsi32_si128(shift);
+    int x = 0;
+    for(; x <= width - 16; x += 16) {
+        __m256i a = _mm256_sll_epi16(_mm256_loadu_si256((const __m256i*)(u + 2*x)), sh);
+        __m256i b = _mm256_sll_epi16(_mm256_loadu_si256((const __m256i*)(v + 2*x)), sh);
+        __m256i lo = _mm256_unpacklo_epi16(a, b);
+        __m256i hi = _mm256_unpackhi_epi16(a, b);
+        _mm256_storeu_si256((__m256i*)(dst + 4*x), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i*)(dst + 4*x + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    interleave_uv_16_sse2(dst + 4*x, u + 2*x, v + 2*x, width - x, shift);
+}
+
+static AVX2 void copy_shl_16_avx2(uint8_t *dst, const uint8_t *src, int width, int shift)
+{
+    const __m128i sh = _mm_cvtsi32_si128(shift);
+    int x = 0;
+    for(; x <= width - 32; x += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(src + 2*x));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(src + 2*x + 32));
+        _mm256_storeu_si256((__m256i*)(dst + 2*x), _mm256_sll_epi16(a, sh));
+        _mm256_storeu_si256((__m256i*)(dst + 2*x + 32), _mm256_sll_epi16(b, sh));
+    }
+    copy_shl_16_sse2(dst + 2*x, src + 2*x, width - x, shift);
+}
+
+static AVX2 void depth_down_8_avx2(uint8_t *dst, const uint8_t *src, int width, int shift, int max)
+{
+    const __m128i sh = _mm_cvtsi32_si128(shift);
+    const __m256i round = _mm256_set1_epi16(1 << (shift - 1));
+    int x = 0;
+    for(; x <= width - 32; x += 32) {
+        __m256i a = _mm256_srl_epi16(_mm256_adds_epu16(_mm256_loadu_si256((const __m256i*)(src + 2*x)), round), sh);
+        __m256i b = _mm256_srl_epi16(_mm256_adds_epu16(_mm256_loadu_si256((const __m256i*)(src + 2*x + 32)), round), sh);
+        _mm256_storeu_si256((__m256i*)(dst + x), _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8));
+    }
+    depth_down_8_sse2(dst + x, src + 2*x, width - x, shift, max);
+}
+
+static AVX2 void depth_down_16_avx2(uint8_t *dst, const uint8_t *src, int width, int shift, int max)
+{
+    const __m128i sh = _mm_cvtsi32_si128(shift);
+    const __m256i round = _mm256_set1_epi16(1 << (shift - 1));
+    const __m256i vmax = _mm256_set1_epi16(max);
+    int x = 0;
+    for(; x <= width - 16; x += 16) {
+        __m256i a = _mm256_srl_epi16(_mm256_adds_epu16(_mm256_loadu_si256((const __m256i*)(src + 2*x)), round), sh);
+        _mm256_storeu_si256((__m256i*)(dst + 2*x), _mm256_min_epi16(a, vmax));
+    }
+    depth_down_16_sse2(dst + 2*x, src + 2*x, width - x, shift, max);
+}
+
+static AVX2 void depth_up_8_avx2(uint8_t *dst, const uint8_t *src, int width, int shift)
+{
+    const __m128i sh = _mm_cvtsi32_si128(shift);
+    int x = 0;
+    for(; x <= width - 32; x += 32) {
+        __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src + x)));
+        __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src + x + 16)));
+        _mm256_storeu_si256((__m256i*)(dst + 2*x), _mm256_sll_epi16(a, sh));
+        _mm256_storeu_si256((__m256i*)(dst + 2*x + 32), _mm256_sll_epi16(b, sh));
+    }
+    depth_up_8_sse2(dst + 2*x, src + x, width - x, shift);
+}
+
+static AVX2 void median_residual_avx2(uint8_t *dst, const uint8_t *top, const uint8_t *cur, int width)
+{
+    int x = 0;
+    for(; x <= width - 32; x += 32) {
+        __m256i l  = _mm256_loadu_si256((const __m256i*)(cur + x - 1));
+        __m256i t  = _mm256_loadu_si256((const __m256i*)(top + x));
+        __m256i lt = _mm256_loadu_si256((const __m256i*)(top + x - 1));
+        __m256i grad = _mm256_sub_epi8(_mm256_add_epi8(l, t), lt);
+        __m256i pred = _mm256_max_epu8(_mm256_min_epu8(l, t), _mm256_min_epu8(_mm256_max_epu8(l, t), grad));
+        _mm256_storeu_si256((__m256i*)(dst + x), _mm256_sub_epi8(_mm256_loadu_si256((const __m256i*)(cur + x)), pred));
+    }
+    median_residual_sse2(dst + x, top + x, cur + x, width - x);
+}
+
+/* the 32-bit lanes add up 256 iterations of at most 2 * 255^2 before they are widened */
+static AVX2 uint64_t ssd_8_avx2(const uint8_t *a, const uint8_t *b, int width)
+{
+    __m256i sum = _mm256_setzero_si256();
+    int x = 0;
+    while(x <= width - 16) {
+        __m256i acc = _mm256_setzero_si256();
+        for(int end = MIN(width - 16, x + 16 * 255); x <= end; x += 16) {
+            __m256i d = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(a + x))),
+                                         _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(b + x))));
+            acc = _mm256_add_epi32(acc, _mm256_madd_epi16(d, d));
+        }
+        sum = _mm256_add_epi64(sum, _mm256_add_epi64(_mm256_cvtepu32_epi64(_mm256_castsi256_si128(acc)),
+                                                     _mm256_cvtepu32_epi64(_mm256_extracti128_si256(acc, 1))));
+    }
+    uint64_t v[4];
+    _mm256_storeu_si256((__m256i*)v, sum);
+    return v[0] + v[1] + v[2] + v[3] + ssd_8_sse2(a + x, b + x, width - x);
+}
+
+static AVX2 uint64_t ssd_16_avx2(const uint8_t *a, const uint8_t *b, int width)
+{
+    __m256i sum = _mm256_setzero_si256();
+    int x = 0;
+    for(; x <= width - 16; x += 16) {
+        __m256i va = _mm256_loadu_si256((const __m256i*)(a + 2*x));
+        __m256i vb = _mm256_loadu_si256((const __m256i*)(b + 2*x));
+        __m256i lo = _mm256_abs_epi32(_mm256_sub_epi32(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(va)),
+                                                       _mm256_cvtepu16_epi32(_mm256_castsi256_si128(vb))));
+        __m256i hi = _mm256_abs_epi32(_mm256_sub_epi32(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(va, 1)),
+                                                       _mm256_cvtepu16_epi32(_mm256_extracti128_si256(vb, 1))));
+        sum = _mm256_add_epi64(sum, _mm256_add_epi64(_mm256_mul_epu32(lo, lo), _mm256_mul_epu32(hi, hi)));
+        lo = _mm256_srli_epi64(lo, 32);
+        hi = _mm256_srli_epi64(hi, 32);
+        sum = _mm256_add_epi64(sum, _mm256_add_epi64(_mm256_mul_epu32(lo, lo), _mm256_mul_epu32(hi, hi)));
+    }
+    uint64_t v[4];
+    _mm256_storeu_si256((__m256i*)v, sum);
+    return v[0] + v[1] + v[2] + v[3] + ssd_16_ssse3(a + 2*x, b + 2*x, width - x);
+}
+
+/****************************************************************************
+ * AVX-512 (F, BW and VL)
+ ****************************************************************************/
+
+#define AVX512 TARGET("avx512f,avx512bw,avx512vl")
+
+/* the qwords of the in-lane unpacks of a 64 byte block, put back in order by vpermt2q */
+static inline AVX512 __m512i unpack_order_avx512(__m512i lo, __m512i hi, int half)
+{
+    const __m512i idx = half ? _mm512_set_epi64(15, 14, 7, 6, 13, 12, 5, 4)
+                             : _mm512_set_epi64(11, 10, 3, 2, 9, 8, 1, 0);
+    return _mm512_permutex2var_epi64(lo, idx, hi);
+}
+
+static AVX512 void interleave_uv_8_avx512(uint8_t *dst, const uint8_t *u, const uint8_t *v, int width, int shift)
+{
+    int x = 0;
+    for(; x <= width - 64; x += 64) {
+        __m512i a = _mm512_loadu_si512(u + x);
+        __m512i b = _mm512_loadu_si512(v + x);
+        __m512i lo = _mm512_unpacklo_epi8(a, b);
+        __m512i hi = _mm512_unpackhi_epi8(a, b);
+        _mm512_storeu_si512(dst + 2*x, unpack_order_avx512(lo, hi, 0));
+        _mm512_storeu_si512(dst + 2*x + 64, unpack_order_avx512(lo, hi, 1));
+    }
+    interleave_uv_8_avx2(dst + 2*x, u + x, v + x, width - x, shift);
+}
+
+static AVX512 void interleave_uv_16_avx512(uint8_t *dst, const uint8_t *u, const uint8_t *v, int width, int shift)
+{
+    const __m128i sh = _mm_cvtsi32_si128(shift);
+    int x = 0;
+    for(; x <= width - 32; x += 32) {
+        __m512i a = _mm512_sll_epi16(_mm512_loadu_si512(u + 2*x), sh);
+        __m512i b = _mm512_sll_epi16(_mm512_loadu_si512(v + 2*x), sh);
+        __m512i lo = _mm512_unpacklo_epi16(a, b);
+        __m512i hi = _mm512_unpackhi_epi16(a, b);
+        _mm512_storeu_si512(dst + 4*x, unpack_order_avx512(lo, hi, 0));
+        _mm512_storeu_si512(dst + 4*x + 64, unpack_order_avx512(lo, hi, 1));
+    }
+    interleave_uv_16_avx2(dst + 4*x, u + 2*x, v + 2*x, width - x, shift);
+}
+
+static AVX512 void copy_shl_16_avx512(uint8_t *dst, const uint8_t *src, int width, int shift)
+{
+    const __m128i sh = _mm_cvtsi32_si128(shift);
+    int x = 0;
+    for(; x <= width - 64; x += 64) {
+        __m512i a = _mm512_loadu_si512(src + 2*x);
+        __m512i b = _mm512_loadu_si512(src + 2*x + 64);
+        _mm512_storeu_si512(dst + 2*x, _mm512_sll_epi16(a, sh));
+        _mm512_storeu_si512(dst + 2*x + 64, _mm512_sll_epi16(b, sh));
+    }
+    copy_shl_16_avx2(dst + 2*x, src + 2*x, width - x, shift);
+}
+
+static AVX512 void depth_down_16_avx512(uint8_t *dst, const uint8_t *src, int width, int shift, int max)
+{
+    const __m128i sh = _mm_cvtsi32_si128(shift);
+    const __m512i round = _mm512_set1_epi16(1 << (shift - 1));
+    const __m512i vmax = _mm512_set1_epi16(max);
+    int x = 0;
+    for(; x <= width - 32; x += 32) {
+        __m512i a = _mm512_srl_epi16(_mm512_adds_epu16(_mm512_loadu_si512(src + 2*x), round), sh);
+        _mm512_storeu_si512(dst + 2*x, _mm512_min_epi16(a, vmax));
+    }
+    depth_down_16_avx2(dst + 2*x, src + 2*x, width - x, shift, max);
+}
+
+static AVX512 void depth_up_8_avx512(uint8_t *dst, const uint8_t *src, int width, int shift)
+{
+    const __m128i sh = _mm_cvtsi32_si128(shift);
+    int x = 0;
+    for(; x <= width - 64; x += 64) {
+        __m512i a = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(src + x)));
+        __m512i b = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(src + x + 32)));
+        _mm512_storeu_si512(dst + 2*x, _mm512_sll_epi16(a, sh));
+        _mm512_storeu_si512(dst + 2*x + 64, _mm512_sll_epi16(b, sh));
+    }
+    depth_up_8_avx2(dst + 2*x, src + x, width - x, shift);
+}
+
+static AVX512 void median_residual_avx512(uint8_t *dst, const uint8_t *top, const uint8_t *cur, int width)
+{
+    int x = 0;
+    for(; x <= width - 64; x += 64) {
+        __m512i l  = _mm512_loadu_si512(cur + x - 1);
+        __m512i t  = _mm512_loadu_si512(top + x);
+        __m512i lt = _mm512_loadu_si512(top + x - 1);
+        __m512i grad = _mm512_sub_epi8(_mm512_add_epi8(l, t), lt);
+        __m512i pred = _mm512_max_epu8(_mm512_min_epu8(l, t), _mm512_min_epu8(_mm512_max_epu8(l, t), grad));
+        _mm512_storeu_si512(dst + x, _mm512_sub_epi8(_mm512_loadu_si512(cur + x), pred));
+    }
+    median_residual_avx2(dst + x, top + x, cur + x, width - x);
+}
+
+static AVX512 uint64_t ssd_8_avx512(const uint8_t *a, const uint8_t *b, int width)
+{
+    __m512i sum = _mm512_setzero_si512();
+    int x = 0;
+    while(x <= width - 32) {
+        __m512i acc = _mm512_setzero_si512();
+        for(int end = MIN(width - 32, x + 32 * 255); x <= end; x += 32) {
+            __m512i d = _mm512_sub_epi16(_mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(a + x))),
+                                         _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(b + x))));
+            acc = _mm512_add_epi32(acc, _mm512_madd_epi16(d, d));
+        }
+        sum = _mm512_add_epi64(sum, _mm512_add_epi64(_mm512_cvtepu32_epi64(_mm512_castsi512_si256(acc)),
+                                                     _mm512_cvtepu32_epi64(_mm512_extracti64x4_epi64(acc, 1))));
+    }
+    return _mm512_reduce_add_epi64(sum) + ssd_8_avx2(a + x, b + x, width - x);
+}
+
+static AVX512 uint64_t ssd_16_avx512(const uint8_t *a, const uint8_t *b, int width)
+{
+    __m512i sum = _mm512_setzero_si512();
+    int x = 0;
+    for(; x <= width - 32; x += 32) {
+        __m512i va = _mm512_loadu_si512(a + 2*x);
+        __m512i vb = _mm512_loadu_si512(b + 2*x);
+        __m512i lo = _mm512_abs_epi32(_mm512_sub_epi32(_mm512_cvtepu16_epi32(_mm512_castsi512_si256(va)),
+                                                       _mm512_cvtepu16_epi32(_mm512_castsi512_si256(vb))));
+        __m512i hi = _mm512_abs_epi32(_mm512_sub_epi32(_mm512_cvtepu16_epi32(_mm512_extracti64x4_epi64(va, 1)),
+                                                       _mm512_cvtepu16_epi32(_mm512_extracti64x4_epi64(vb, 1))));
+        sum = _mm512_add_epi64(sum, _mm512_add_epi64(_mm512_mul_epu32(lo, lo), _mm512_mul_epu32(hi, hi)));
+        lo = _mm512_srli_epi64(lo, 32);
+        hi = _mm512_srli_epi64(hi, 32);
+        sum = _mm512_add_epi64(sum, _mm512_add_epi64(_mm512_mul_epu32(lo, lo), _mm512_mul_epu32(hi, hi)));
+    }
+    return _mm512_reduce_add_epi64(sum) + ssd_16_avx2(a + 2*x, b + 2*x, width - x);
+}
+#endif
+#endif
+
+void pixel_init_cpu(pixel_funcs_t *pf, int cpu)
+{
+    static int crc32c_ready;
+    if(!crc32c_ready) {
+        crc32c_init();
+        crc32c_ready = 1;
+    }
+    pf->vfilter[0] = vfilter_8_c;
+    pf->vfilter[1] = vfilter_16_c;
+    pf->hfilter[0] = hfilter_8_c;
+    pf->hfilter[1] = hfilter_16_c;
+    pf->vscale[0] = vscale_8_c;
+    pf->vscale[1] = vscale_16_c;
+    pf->hscale[0] = hscale_8_c;
+    pf->hscale[1] = hscale_16_c;
+    pf->interleave_uv[0] = interleave_uv_8_c;
+    pf->interleave_uv[1] = interleave_uv_16_c;
+    pf->copy_shl_16 = copy_shl_16_c;
+    pf->depth_down[0] = depth_down_8_c;
+    pf->depth_down[1] = depth_down_16_c;
+    pf->depth_up_8 = depth_up_8_c;
+    pf->pack_uyvy = pack_uyvy_c;
+    pf->pack_y210 = pack_y210_c;
+    pf->pack_v210 = pack_v210_c;
+    pf->median_residual = median_residual_c;
+    pf->crc32c = crc32c_c;
+    pf->ssd[0] = ssd_8_c;
+    pf->ssd[1] = ssd_16_c;
+    pf->ssim_4x4[0] = ssim_4x4_8_c;
+    pf->ssim_4x4[1] = ssim_4x4_16_c;
+#ifdef HAVE_X86
+    if(cpu & CPU_SSE2) {
+        pf->vfilter[0] = vfilter_8_sse2;
+        pf->vfilter[1] = vfilter_16_sse2;
+        pf->hfilter[0] = hfilter_8_sse2;
+        pf->hfilter[1] = hfilter_16_sse2;
+        pf->vscale[0] = vscale_8_sse2;
+        pf->vscale[1] = vscale_16_sse2;
+        pf->hscale[0] = hscale_8_sse2;
+        pf->hscale[1] = hscale_16_sse2;
+        pf->interleave_uv[0] = interleave_uv_8_sse2;
+        pf->interleave_uv[1] = interleave_uv_16_sse2;
+        pf->copy_shl_16 = copy_shl_16_sse2;
+        pf->depth_down[0] = depth_down_8_sse2;
+        pf->depth_down[1] = depth_down_16_sse2;
+        pf->depth_up_8 = depth_up_8_sse2;
+        pf->pack_uyvy = pack_uyvy_sse2;
+        pf->pack_y210 = pack_y210_sse2;
+        pf->pack_v210 = pack_v210_sse2;
+        pf->median_residual = median_residual_sse2;
+        pf->ssd[0] = ssd_8_sse2;
+        pf->ssim_4x4[0] = ssim_4x4_8_sse2;
+    }
+    if(cpu & CPU_SSSE3)
+        pf->ssd[1] = ssd_16_ssse3;
+    if(cpu & CPU_SSE42)
+        pf->crc32c = crc32c_sse42;
+#ifdef HAVE_AVX
+    if(cpu & CPU_AVX2) {
+        pf->vfilter[0] = vfilter_8_avx2;
+        pf->vfilter[1] = vfilter_16_avx2;
+        pf->vscale[0] = vscale_8_avx2;
+        pf->vscale[1] = vscale_16_avx2;
+        pf->interleave_uv[0] = interleave_uv_8_avx2;
+        pf->interleave_uv[1] = interleave_uv_16_avx2;
+        pf->copy_shl_16 = copy_shl_16_avx2;
+        pf->depth_down[0] = depth_down_8_avx2;
+        pf->depth_down[1] = depth_down_16_avx2;
+        pf->depth_up_8 = depth_up_8_avx2;
+        pf->median_residual = median_residual_avx2;
+        pf->ssd[0] = ssd_8_avx2;
+        pf->ssd[1] = ssd_16_avx2;
+    }
+    if(cpu & CPU_AVX512) {
+        pf->interleave_uv[0] = interleave_uv_8_avx512;
+        pf->interleave_uv[1] = interleave_uv_16_avx512;
+        pf->copy_shl_16 = copy_shl_16_avx512;
+        pf->depth_down[1] = depth_down_16_avx512;
+        pf->depth_up_8 = depth_up_8_avx512;
+        pf->median_residual = median_residual_avx512;
+        pf->ssd[0] = ssd_8_avx512;
+        pf->ssd[1] = ssd_16_avx512;
+    }
+#endif
+#endif
+}
+
+void pixel_init(pixel_funcs_t *pf)
+{
+    pixel_init_cpu(pf, cpu_get());
+}
@@ -0,0 +1,78 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#ifndef AVS2YUV_PIXEL_H
+#define AVS2YUV_PIXEL_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* filter coefficients are 6-bit fixed point and sum up to 64 */
+#define FILTER_SHIFT 6
+#define FILTER_MAX_TAPS 12
+
+/* the scalers' coefficients are 14-bit fixed point and sum up to 1 << 14 */
+#define SCALE_SHIFT 14
+#define SCALE_MAX_TAPS 64
+
+/* kernels are indexed by component size - 1: [0] for 8-bit, [1] for 16-bit samples.
+   max is the largest valid sample value, results are clipped to [0, max] */
+typedef struct
+{
+    /* dst[x] = sum(coef[t] * src[t][x]) */
+    void (*vfilter[2])(uint8_t *dst, const uint8_t **src, const int16_t *coef, int taps, int width, int max);
+    /* dst[x] = sum(coef[t] * src[2*x + t]), taps is even.
+       src must be readable up to 16 bytes past the last tap */
+    void (*hfilter[2])(uint8_t *dst, const uint8_t *src, const int16_t *coef, int taps, int width, int max);
+
+    /* dst[x] = sum(coef[t] * src[t][x]) for scaling */
+    void (*vscale[2])(uint8_t *dst, const uint8_t **src, const int16_t *coef, int taps, int width, int max);
+    /* dst[x] = sum(coef[x*taps + t] * src[offset[x] + t]), taps is a multiple of 4
+       and src must be readable up to offset[x] + taps */
+    void (*hscale[2])(uint8_t *dst, const uint8_t *src, const int16_t *coef, const int *offset, int taps, int width, int max);
+
+    /* semi-planar packing: dst = u0 v0 u1 v1 ..., 16-bit samples are shifted left by shift */
+    void (*interleave_uv[2])(uint8_t *dst, const uint8_t *u, const uint8_t *v, int width, int shift);
+    /* 16-bit row copy with left shift for MSB-aligned output */
+    void (*copy_shl_16)(uint8_t *dst, const uint8_t *src, int width, int shift);
+
+    /* bit depth reduction of 16-bit samples: rounded, shifted right by shift and clipped to max,
+       stored as 8-bit ([0]) or 16-bit ([1]) */
+    void (*depth_down[2])(uint8_t *dst, const uint8_t *src, int width, int shift, int max);
+    /* 8-bit samples widened to 16-bit and shifted left by shift */
+    void (*depth_up_8)(uint8_t *dst, const uint8_t *src, int width, int shift);
+
+    /* 4:2:2 packing of an even number of pixels: 8-bit UYVY, 16-bit Y210 (YUYV shifted left by shift)
+       and 10-bit v210, which writes whole 6 pixel groups of 16 bytes */
+    void (*pack_uyvy)(uint8_t *dst, const uint8_t *y, const uint8_t *u, const uint8_t *v, int width);
+    void (*pack_y210)(uint8_t *dst, const uint8_t *y, const uint8_t *u, const uint8_t *v, int width, int shift);
+    void (*pack_v210)(uint8_t *dst, const uint8_t *y, const uint8_t *u, const uint8_t *v, int width);
+
+    /* HuffYUV median prediction residuals of 8-bit samples:
+       dst[x] = cur[x] - median(cur[x-1], top[x], cur[x-1] + top[x] - top[x-1]), reading cur[-1] and top[-1] */
+    void (*median_residual)(uint8_t *dst, const uint8_t *top, const uint8_t *cur, int width);
+
+    /* CRC32C of size bytes continuing crc, which is 0 to start, as zlib's crc32() */
+    uint32_t (*crc32c)(uint32_t crc, const uint8_t *src, size_t size);
+
+    /* sum of squared differences of width samples */
+    uint64_t (*ssd[2])(const uint8_t *a, const uint8_t *b, int width);
+    /* SSIM sums of blocks consecutive 4x4 blocks: sums[i] = {sum(a), sum(b), sum(a*a + b*b), sum(a*b)} */
+    void (*ssim_4x4[2])(int64_t (*sums)[4], const uint8_t *a, intptr_t a_stride, const uint8_t *b, intptr_t b_stride, int blocks);
+} pixel_funcs_t;
+
+/* binds the fastest kernels for the instruction sets in cpu (CPU_* of cpu.h), 0 for C only.
+   Called before any thread uses the functions, as it sets up their tables */
+void pixel_init_cpu(pixel_funcs_t *pf, int cpu);
+/* pixel_init_cpu for cpu_get() */
+void pixel_init(pixel_funcs_t *pf);
+/* checks the kernels of each level in cpu against the C ones on random rows of many widths,
+   printing a line per level to fh; fails on any mismatch */
+int pixel_selftest(FILE *fh, int cpu);
+
+#endif
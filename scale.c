@@ -0,0 +1,258 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef _MSC_VER
+#define strcasecmp _stricmp
+#else
+#include <strings.h>
+#endif
+#include "scale.h"
+#include "chroma.h"
+#include "pixel.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+typedef struct
+{
+    int taps;
+    int *offset;    // first input sample of each output sample
+    int16_t *coef;  // taps per output sample
+} scale_filter_t;
+
+typedef struct
+{
+    int src_width, src_height;
+    int dst_width, dst_height;
+    int hscale, vscale; // whether the dimension changes
+    scale_filter_t h, v;
+} plane_scaler_t;
+
+struct scaler_t
+{
+    pixel_funcs_t pf;
+    threadpool_t *pool;
+    int component_size;
+    int max;
+    plane_scaler_t plane[2]; // [0] luma and alpha, [1] chroma
+    int jobs;
+    uint8_t **tmp;           // one row per job, zero padded up to the widest filter
+    picture_t *dst;
+    const picture_t *src;
+};
+
+static const char * const filter_names[] = {"bilinear", "bicubic", "spline36", "lanczos", NULL};
+
+int scale_filter_from_name(const char *name)
+{
+    for(int i = 0; filter_names[i]; i++)
+        if(!strcasecmp(name, filter_names[i]))
+            return i;
+    return -1;
+}
+
+const char *scale_filter_name(int filter)
+{
+    return filter_names[filter];
+}
+
+static double kernel(int filter, double x)
+{
+    x = fabs(x);
+    switch(filter) {
+        case SCALE_FILTER_BILINEAR:
+            return x < 1 ? 1 - x : 0;
+        case SCALE_FILTER_BICUBIC: {
+            const double b = 1./3, c = 1./3;
+            if(x < 1)
+                return ((12 - 9*b - 6*c) * x*x*x + (-18 + 12*b + 6*c) * x*x + (6 - 2*b)) / 6;
+            if(x < 2)
+                return ((-b - 6*c) * x*x*x + (6*b + 30*c) * x*x + (-12*b - 48*c) * x + (8*b + 24*c)) / 6;
+            return 0;
+        }
+        case SCALE_FILTER_SPLINE36:
+            if(x < 1)
+                return ((13./11 * x - 453./209) * x - 3./209) * x + 1;
+            if(x < 2) {
+                x -= 1;
+                return ((-6./11 * x + 270./209) * x - 156./209) * x;
+            }
+            if(x < 3) {
+                x -= 2;
+                return ((1./11 * x - 45./209) * x + 26./209) * x;
+            }
+            return 0;
+        case SCALE_FILTER_LANCZOS:
+            if(x < 1e-9)
+                return 1;
+            if(x < 3)
+                return 3 * sin(M_PI * x) * sin(M_PI * x / 3) / (M_PI * M_PI * x * x);
+            return 0;
+    }
+    return 0;
+}
+
+static double kernel_support(int filter)
+{
+    return filter == SCALE_FILTER_BILINEAR ? 1 : filter == SCALE_FILTER_BICUBIC ? 2 : 3;
+}
+
+/* builds the filters of dst_n output samples, sample j being centered on
+   input position (j + c) * src_n / dst_n - c. When downscaling the kernel is
+   stretched by the ratio, weights falling outside the picture are folded
+   onto its edge samples, and taps are padded with zeros to a multiple of align */
+static int make_filter(scale_filter_t *f, int filter, int src_n, int dst_n, double c, int align)
+{
+    double r = (double)src_n / dst_n;
+    double fscale = MAX(r, 1.0);
+    double radius = kernel_support(filter) * fscale;
+    int ktaps = (int)ceil(2 * radius);
+    if(ktaps > SCALE_MAX_TAPS) {
+        ktaps = SCALE_MAX_TAPS;
+        radius = ktaps / 2.0;
+        fscale = radius / kernel_support(filter);
+    }
+    int taps = ALIGN(MIN(ktaps, src_n), align);
+    f->taps = taps;
+    f->offset = malloc(dst_n * sizeof(int));
+    f->coef = malloc(dst_n * taps * sizeof(int16_t));
+    if(!f->offset || !f->coef)
+        return -1;
+    for(int j = 0; j < dst_n; j++) {
+        double center = (j + c) * r - c;
+        int first = (int)floor(center - radius) + 1;
+        int offset = MAX(MIN(first, src_n - taps), 0);
+        double w[SCALE_MAX_TAPS] = {0};
+        double sum = 0;
+        for(int k = first; k < first + ktaps; k++) {
+            double v = kernel(filter, (k - center) / fscale);
+            w[MIN(MAX(k, 0), src_n - 1) - offset] += v;
+            sum += v;
+        }
+        /* quantize, then put the rounding error on the largest tap */
+        int16_t *q = f->coef + j * taps;
+        int total = 0, peak = 0;
+        for(int t = 0; t < taps; t++) {
+            q[t] = (int16_t)floor(w[t] / sum * (1 << SCALE_SHIFT) + 0.5);
+            total += q[t];
+            if(w[t] > w[peak])
+                peak = t;
+        }
+        q[peak] += (1 << SCALE_SHIFT) - total;
+        f->offset[j] = offset;
+    }
+    return 0;
+}
+
+static void scale_stripe(void *arg, int job)
+{
+    scaler_t *h = arg;
+    int cs = h->component_size;
+    uint8_t *tmp = h->tmp[job];
+    for(int p = 0; p < 4; p++) {
+        if(p >= h->src->planes && !(p == 3 && h->src->alpha))
+            continue;
+        const plane_scaler_t *s = &h->plane[p == 1 || p == 2];
+        int y0 = s->dst_height * job / h->jobs;
+        int y1 = s->dst_height * (job + 1) / h->jobs;
+        const uint8_t *src = h->src->plane[p];
+        intptr_t src_stride = h->src->stride[p];
+        uint8_t *dst = h->dst->plane[p] + y0 * h->dst->stride[p];
+        for(int y = y0; y < y1; y++, dst += h->dst->stride[p]) {
+            const uint8_t *row = src + y * src_stride;
+            uint8_t *vdst = s->hscale ? tmp : dst;
+            if(s->vscale) {
+                const uint8_t *rows[SCALE_MAX_TAPS];
+                for(int t = 0; t < s->v.taps; t++)
+                    rows[t] = src + (s->v.offset[y] + t) * src_stride;
+                h->pf.vscale[cs-1](vdst, rows, s->v.coef + y * s->v.taps, s->v.taps, s->src_width, h->max);
+                row = vdst;
+            } else if(!s->hscale || s->h.taps > s->src_width) {
+                /* hscale reads up to the widest filter */
+                memcpy(vdst, row, s->src_width * cs);
+                row = vdst;
+            }
+            if(s->hscale)
+                h->pf.hscale[cs-1](dst, row, s->h.coef, s->h.offset, s->h.taps, s->dst_width, h->max);
+        }
+    }
+}
+
+scaler_t *scaler_create(const picture_t *src_fmt, int dst_width, int dst_height, int filter, int chroma_loc,
+                        threadpool_t *pool)
+{
+    scaler_t *h = calloc(1, sizeof(scaler_t));
+    if(!h)
+        return NULL;
+    pixel_init(&h->pf);
+    h->pool = pool;
+    h->component_size = src_fmt->component_size;
+    h->max = (1 << src_fmt->depth) - 1;
+    picture_t dst_fmt = *src_fmt;
+    dst_fmt.width = dst_width;
+    dst_fmt.height = dst_height;
+    int tmp_size = 0;
+    for(int i = 0; i < 2; i++) {
+        plane_scaler_t *s = &h->plane[i];
+        s->src_width = picture_plane_width(src_fmt, i);
+        s->src_height = picture_plane_height(src_fmt, i);
+        s->dst_width = picture_plane_width(&dst_fmt, i);
+        s->dst_height = picture_plane_height(&dst_fmt, i);
+        s->hscale = s->src_width != s->dst_width;
+        s->vscale = s->src_height != s->dst_height;
+        /* mpeg2 chroma is co-sited with the even luma samples */
+        double hc = i && src_fmt->h_shift && chroma_loc != CHROMA_LOC_CENTER ? 0.25 : 0.5;
+        if(s->hscale && make_filter(&s->h, filter, s->src_width, s->dst_width, hc, 4) < 0)
+            goto fail;
+        if(s->vscale && make_filter(&s->v, filter, s->src_height, s->dst_height, 0.5, 1) < 0)
+            goto fail;
+        tmp_size = MAX(tmp_size, MAX(s->src_width, s->h.taps));
+    }
+
+    h->jobs = MIN(threadpool_threads(pool) * 4, MAX(dst_height / 8, 1));
+    h->tmp = calloc(h->jobs, sizeof(uint8_t*));
+    if(!h->tmp)
+        goto fail;
+    for(int i = 0; i < h->jobs; i++) {
+        h->tmp[i] = aligned_malloc(tmp_size * h->component_size);
+        if(!h->tmp[i])
+            goto fail;
+        memset(h->tmp[i], 0, tmp_size * h->component_size);
+    }
+    return h;
+fail:
+    scaler_delete(h);
+    return NULL;
+}
+
+void scaler_delete(scaler_t *h)
+{
+    if(!h)
+        return;
+    for(int i = 0; i < 2; i++) {
+        free(h->plane[i].h.offset);
+        free(h->plane[i].h.coef);
+        free(h->plane[i].v.offset);
+        free(h->plane[i].v.coef);
+    }
+    if(h->tmp)
+        for(int i = 0; i < h->jobs; i++)
+            aligned_free(h->tmp[i]);
+    free(h->tmp);
+    free(h);
+}
+
+void scale_picture(scaler_t *h, picture_t *dst, const picture_t *src)
+{
+    h->dst = dst;
+    h->src = src;
+    threadpool_run(h->pool, scale_stripe, h, h->jobs);
+}
@@ -0,0 +1,33 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#ifndef AVS2YUV_SCALE_H
+#define AVS2YUV_SCALE_H
+
+#include "common.h"
+#include "threads.h"
+
+#define SCALE_FILTER_BILINEAR 0
+#define SCALE_FILTER_BICUBIC  1 // Mitchell-Netravali, as AviSynth's BicubicResize
+#define SCALE_FILTER_SPLINE36 2
+#define SCALE_FILTER_LANCZOS  3 // 3 lobes
+
+typedef struct scaler_t scaler_t;
+
+int scale_filter_from_name(const char *name);
+const char *scale_filter_name(int filter);
+
+/* resizes pictures of format src_fmt (alpha included) to dst_width x dst_height,
+   keeping csp and depth. chroma_loc is the horizontal siting of subsampled chroma */
+scaler_t *scaler_create(const picture_t *src_fmt, int dst_width, int dst_height, int filter, int chroma_loc,
+                        threadpool_t *pool);
+void scaler_delete(scaler_t *h);
+
+/* dst must have all its planes allocated */
+void scale_picture(scaler_t *h, picture_t *dst, const picture_t *src);
+
+#endif
@@ -0,0 +1,420 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "pixel.h"
+#include "cpu.h"
+
+/* the kernels of a level are run on the same random rows as the C ones, at every width
+   up to past the widest SIMD step and some beyond, and their whole output buffers have
+   to match: a kernel writing past its width shows up too */
+
+#define ROW 4096         // bytes of each input row and output buffer
+#define ROWS FILTER_MAX_TAPS
+#define MAX_WIDTH 300
+
+typedef struct
+{
+    FILE *fh;
+    const char *level;
+    int kernels;
+    int failed;
+    uint32_t seed;
+    /* 16 bytes of slack in front for the kernels reading src[-1] */
+    uint8_t in[ROWS][ROW + 16];
+    uint8_t out_c[ROW + 64], out[ROW + 64];
+    int16_t coef[MAX_WIDTH * 16];
+    int offset[MAX_WIDTH];
+} test_t;
+
+static uint32_t rnd(test_t *t)
+{
+    /* xorshift32 */
+    t->seed ^= t->seed << 13;
+    t->seed ^= t->seed >> 17;
+    t->seed ^= t->seed << 5;
+    return t->seed;
+}
+
+/* random samples below 1 << depth, 8-bit ones for depth 8 */
+static void fill(test_t *t, int depth)
+{
+    for(int r = 0; r < ROWS; r++) {
+        if(depth == 8)
+            for(int i = 0; i < ROW + 16; i++)
+                t->in[r][i] = rnd(t);
+        else
+            for(int i = 0; i < (ROW + 16) / 2; i++) {
+                uint16_t v = rnd(t) & ((1 << depth) - 1);
+                memcpy(&t->in[r][2*i], &v, 2);
+            }
+    }
+}
+
+/* taps coefficients adding up to sum, negative ones included, as far from flat as the
+   8-bit kernels' 16-bit accumulators allow: the absolute values add up to at most 2 * sum */
+static void make_coefs(test_t *t, int16_t *coef, int taps, int sum)
+{
+    int range = 2 * sum / taps;
+    for(;;) {
+        int total = 0, abs_total = 0;
+        for(int i = 0; i < taps - 1; i++) {
+            coef[i] = (int)(rnd(t) % (2 * range + 1)) - range;
+            total += coef[i];
+        }
+        int last = sum - total;
+        for(int i = 0; i < taps - 1; i++)
+            abs_total += coef[i] < 0 ? -coef[i] : coef[i];
+        abs_total += last < 0 ? -last : last;
+        if(last < 0x8000 && abs_total <= 2 * sum) {
+            coef[taps-1] = last;
+            return;
+        }
+    }
+}
+
+static void clear_out(test_t *t)
+{
+    memset(t->out_c, 0xaa, sizeof(t->out_c));
+    memset(t->out, 0xaa, sizeof(t->out));
+}
+
+/* compares the outputs, reporting the first mismatch of a kernel */
+static int differ(test_t *t, const char *kernel, const char *param, int width)
+{
+    if(!memcmp(t->out_c, t->out, sizeof(t->out)))
+        return 0;
+    int i = 0;
+    while(t->out_c[i] == t->out[i])
+        i++;
+    fprintf(t->fh, "selftest: %s %s differs from C at width %d%s, byte %d is %02x instead of %02x\n",
+            t->level, kernel, width, param, i, t->out[i], t->out_c[i]);
+    t->failed = 1;
+    return 1;
+}
+
+#define WIDTHS(w) for(int w = 1; w <= MAX_WIDTH; w += w < 136 ? 1 : 41)
+
+static void src_rows(test_t *t, const uint8_t **src, int taps)
+{
+    for(int i = 0; i < taps; i++)
+        src[i] = t->in[(i * 5 + 3) % ROWS] + 16;
+}
+
+static void test_vertical(test_t *t, const pixel_funcs_t *ref, const pixel_funcs_t *pf, int scale)
+{
+    static const int taps_list[] = {1, 2, 3, 4, 6, 8, 12};
+    for(int k = 0; k < 2; k++) {
+        void (*c)(uint8_t*, const uint8_t**, const int16_t*, int, int, int) = scale ? ref->vscale[k] : ref->vfilter[k];
+        void (*f)(uint8_t*, const uint8_t**, const int16_t*, int, int, int) = scale ? pf->vscale[k] : pf->vfilter[k];
+        if(f == c)
+            continue;
+        t->kernels++;
+        const char *name = scale ? k ? "vscale_16" : "vscale_8" : k ? "vfilter_16" : "vfilter_8";
+        for(int i = 0; i < (int)(sizeof(taps_list) / sizeof(taps_list[0])); i++) {
+            int taps = taps_list[i];
+            int depth = k ? 10 + i % 7 : 8;
+            int max = (1 << depth) - 1;
+            const uint8_t *src[ROWS];
+            char param[32];
+            fill(t, depth);
+            src_rows(t, src, taps);
+            if(scale)
+                make_coefs(t, t->coef, taps, 1 << SCALE_SHIFT);
+            else
+                make_coefs(t, t->coef, taps, 1 << FILTER_SHIFT);
+            snprintf(param, sizeof(param), ", %d taps, depth %d", taps, depth);
+            WIDTHS(w) {
+                clear_out(t);
+                c(t->out_c, src, t->coef, taps, w, max);
+                f(t->out, src, t->coef, taps, w, max);
+                if(differ(t, name, param, w))
+                    return;
+            }
+        }
+    }
+}
+
+static void test_hfilter(test_t *t, const pixel_funcs_t *ref, const pixel_funcs_t *pf)
+{
+    for(int k = 0; k < 2; k++) {
+        if(pf->hfilter[k] == ref->hfilter[k])
+            continue;
+        t->kernels++;
+        for(int taps = 2; taps <= FILTER_MAX_TAPS; taps += 2) {
+            int depth = k ? 9 + taps % 8 : 8;
+            char param[32];
+            fill(t, depth);
+            make_coefs(t, t->coef, taps, 1 << FILTER_SHIFT);
+            snprintf(param, sizeof(param), ", %d taps, depth %d", taps, depth);
+            WIDTHS(w) {
+                clear_out(t);
+                ref->hfilter[k](t->out_c, t->in[0], t->coef, taps, w, (1 << depth) - 1);
+                pf->hfilter[k](t->out, t->in[0], t->coef, taps, w, (1 << depth) - 1);
+                if(differ(t, k ? "hfilter_16" : "hfilter_8", param, w))
+                    return;
+            }
+        }
+    }
+}
+
+static void test_hscale(test_t *t, const pixel_funcs_t *ref, const pixel_funcs_t *pf)
+{
+    for(int k = 0; k < 2; k++) {
+        if(pf->hscale[k] == ref->hscale[k])
+            continue;
+        t->kernels++;
+        for(int taps = 4; taps <= 16; taps += 4) {
+            int depth = k ? 12 + taps / 4 : 8;
+            char param[32];
+            fill(t, depth);
+            for(int x = 0; x < MAX_WIDTH; x++) {
+                make_coefs(t, t->coef + x * taps, taps, 1 << SCALE_SHIFT);
+                t->offset[x] = rnd(t) % (ROW / 2 - taps);
+            }
+            snprintf(param, sizeof(param), ", %d taps, depth %d", taps, depth);
+            WIDTHS(w) {
+                clear_out(t);
+                ref->hscale[k](t->out_c, t->in[0], t->coef, t->offset, taps, w, (1 << depth) - 1);
+                pf->hscale[k](t->out, t->in[0], t->coef, t->offset, taps, w, (1 << depth) - 1);
+                if(differ(t, k ? "hscale_16" : "hscale_8", param, w))
+                    return;
+            }
+        }
+    }
+}
+
+static void test_convert(test_t *t, const pixel_funcs_t *ref, const pixel_funcs_t *pf)
+{
+    const uint8_t *a = t->in[0] + 16, *b = t->in[1] + 16;
+    char param[32];
+    for(int k = 0; k < 2; k++) {
+        if(pf->interleave_uv[k] == ref->interleave_uv[k])
+            continue;
+        t->kernels++;
+        for(int depth = k ? 9 : 8; depth <= (k ? 16 : 8); depth++) {
+            fill(t, depth);
+            snprintf(param, sizeof(param), ", depth %d", depth);
+            WIDTHS(w) {
+                clear_out(t);
+                ref->interleave_uv[k](t->out_c, a, b, w, 16 - depth);
+                pf->interleave_uv[k](t->out, a, b, w, 16 - depth);
+                if(differ(t, k ? "interleave_uv_16" : "interleave_uv_8", param, w))
+                    goto next;
+            }
+        }
+next:;
+    }
+    if(pf->copy_shl_16 != ref->copy_shl_16) {
+        t->kernels++;
+        for(int depth = 9; depth <= 16; depth++) {
+            fill(t, depth);
+            snprintf(param, sizeof(param), ", depth %d", depth);
+            WIDTHS(w) {
+                clear_out(t);
+                ref->copy_shl_16(t->out_c, a, w, 16 - depth);
+                pf->copy_shl_16(t->out, a, w, 16 - depth);
+                if(differ(t, "copy_shl_16", param, w))
+                    goto down;
+            }
+        }
+    }
+down:
+    for(int k = 0; k < 2; k++) {
+        if(pf->depth_down[k] == ref->depth_down[k])
+            continue;
+        t->kernels++;
+        /* from every depth to 8 bits, or to each smaller one above 8 */
+        for(int from = 9; from <= 16; from++)
+            for(int to = k ? 9 : 8; to <= (k ? from - 1 : 8); to++) {
+                fill(t, from);
+                snprintf(param, sizeof(param), ", depth %d to %d", from, to);
+                WIDTHS(w) {
+                    clear_out(t);
+                    ref->depth_down[k](t->out_c, a, w, from - to, (1 << to) - 1);
+                    pf->depth_down[k](t->out, a, w, from - to, (1 << to) - 1);
+                    if(differ(t, k ? "depth_down_16" : "depth_down_8", param, w))
+                        goto next_down;
+                }
+            }
+next_down:;
+    }
+    if(pf->depth_up_8 != ref->depth_up_8) {
+        t->kernels++;
+        fill(t, 8);
+        for(int shift = 1; shift <= 8; shift++) {
+            snprintf(param, sizeof(param), ", shift %d", shift);
+            WIDTHS(w) {
+                clear_out(t);
+                ref->depth_up_8(t->out_c, a, w, shift);
+                pf->depth_up_8(t->out, a, w, shift);
+                if(differ(t, "depth_up_8", param, w))
+                    return;
+            }
+        }
+    }
+}
+
+static void test_pack(test_t *t, const pixel_funcs_t *ref, const pixel_funcs_t *pf)
+{
+    const uint8_t *y = t->in[0] + 16, *u = t->in[1] + 16, *v = t->in[2] + 16;
+    if(pf->pack_uyvy != ref->pack_uyvy) {
+        t->kernels++;
+        fill(t, 8);
+        WIDTHS(w) {
+            if(w & 1)
+                continue;
+            clear_out(t);
+            ref->pack_uyvy(t->out_c, y, u, v, w);
+            pf->pack_uyvy(t->out, y, u, v, w);
+            if(differ(t, "pack_uyvy", "", w))
+                break;
+        }
+    }
+    if(pf->pack_y210 != ref->pack_y210) {
+        t->kernels++;
+        fill(t, 10);
+        WIDTHS(w) {
+            if(w & 1)
+                continue;
+            clear_out(t);
+            ref->pack_y210(t->out_c, y, u, v, w, 6);
+            pf->pack_y210(t->out, y, u, v, w, 6);
+            if(differ(t, "pack_y210", "", w))
+                break;
+        }
+    }
+    if(pf->pack_v210 != ref->pack_v210) {
+        t->kernels++;
+        fill(t, 10);
+        WIDTHS(w) {
+            if(w & 1)
+                continue;
+            clear_out(t);
+            ref->pack_v210(t->out_c, y, u, v, w);
+            pf->pack_v210(t->out, y, u, v, w);
+            if(differ(t, "pack_v210", "", w))
+                break;
+        }
+    }
+}
+
+static void test_ffvhuff_hash(test_t *t, const pixel_funcs_t *ref, const pixel_funcs_t *pf)
+{
+    if(pf->median_residual != ref->median_residual) {
+        t->kernels++;
+        fill(t, 8);
+        WIDTHS(w) {
+            clear_out(t);
+            ref->median_residual(t->out_c, t->in[0] + 16, t->in[1] + 16, w);
+            pf->median_residual(t->out, t->in[0] + 16, t->in[1] + 16, w);
+            if(differ(t, "median_residual", "", w))
+                break;
+        }
+    }
+    if(pf->crc32c != ref->crc32c) {
+        t->kernels++;
+        fill(t, 8);
+        /* every alignment and size up to past a few words, then longer runs */
+        for(int size = 0; size < 1024; size += size < 48 ? 1 : 97)
+            for(int align = 0; align < 8; align++) {
+                uint32_t start = align ? rnd(t) : 0;
+                uint32_t crc_c = ref->crc32c(start, t->in[0] + align, size);
+                uint32_t crc = pf->crc32c(start, t->in[0] + align, size);
+                if(crc != crc_c) {
+                    fprintf(t->fh, "selftest: %s crc32c differs from C for %d bytes at offset %d, %08x instead of %08x\n",
+                            t->level, size, align, crc, crc_c);
+                    t->failed = 1;
+                    return;
+                }
+            }
+    }
+}
+
+static void test_compare(test_t *t, const pixel_funcs_t *ref, const pixel_funcs_t *pf)
+{
+    for(int k = 0; k < 2; k++) {
+        if(pf->ssd[k] == ref->ssd[k])
+            continue;
+        t->kernels++;
+        /* full range samples for the largest differences, and rows over all the
+           inputs for the kernels widening their sums every so many samples */
+        fill(t, k ? 16 : 8);
+        int half = sizeof(t->in) / 2 >> k;
+        for(int w = 1; w <= half; w += w < MAX_WIDTH ? 1 : 997) {
+            const uint8_t *b = w <= MAX_WIDTH ? t->in[1] : t->in[0] + sizeof(t->in) / 2;
+            uint64_t ssd_c = ref->ssd[k](t->in[0], b, w);
+            uint64_t ssd = pf->ssd[k](t->in[0], b, w);
+            if(ssd != ssd_c) {
+                fprintf(t->fh, "selftest: %s ssd_%d differs from C at width %d, %llu instead of %llu\n",
+                        t->level, k ? 16 : 8, w, (unsigned long long)ssd, (unsigned long long)ssd_c);
+                t->failed = 1;
+                break;
+            }
+        }
+    }
+    for(int k = 0; k < 2; k++) {
+        if(pf->ssim_4x4[k] == ref->ssim_4x4[k])
+            continue;
+        t->kernels++;
+        fill(t, k ? 16 : 8);
+        int64_t sums_c[MAX_WIDTH / 4][4], sums[MAX_WIDTH / 4][4];
+        intptr_t stride = ROW / 4;
+        for(int blocks = 1; blocks <= MAX_WIDTH / 4; blocks += blocks < 20 ? 1 : 13) {
+            ref->ssim_4x4[k](sums_c, t->in[0], stride, t->in[1], stride + 2, blocks);
+            pf->ssim_4x4[k](sums, t->in[0], stride, t->in[1], stride + 2, blocks);
+            if(memcmp(sums_c, sums, blocks * sizeof(sums[0]))) {
+                fprintf(t->fh, "selftest: %s ssim_4x4_%d differs from C for %d blocks\n", t->level, k ? 16 : 8, blocks);
+                t->failed = 1;
+                break;
+            }
+        }
+    }
+}
+
+int pixel_selftest(FILE *fh, int cpu)
+{
+    test_t *t = calloc(1, sizeof(test_t));
+    if(!t) {
+        fprintf(stderr, "error: malloc failed\n");
+        return -1;
+    }
+    pixel_funcs_t ref, pf;
+    pixel_init_cpu(&ref, 0);
+    t->fh = fh;
+    int flags = 0;
+    for(int flag = 1; flag < 1 << CPU_LEVELS; flag <<= 1) {
+        if(!(cpu & flag))
+            continue;
+        /* the level's kernels, with the lower ones' in place of those it lacks */
+        flags |= flag;
+        pixel_init_cpu(&pf, flags);
+        t->level = cpu_name(flag);
+        t->kernels = 0;
+        t->seed = 0x9e3779b9;
+        int failed = t->failed;
+        t->failed = 0;
+        test_vertical(t, &ref, &pf, 0);
+        test_hfilter(t, &ref, &pf);
+        test_vertical(t, &ref, &pf, 1);
+        test_hscale(t, &ref, &pf);
+        test_convert(t, &ref, &pf);
+        test_pack(t, &ref, &pf);
+        test_ffvhuff_hash(t, &ref, &pf);
+        test_compare(t, &ref, &pf);
+        fprintf(fh, "selftest: %-6s %2d kernels %s\n", t->level, t->kernels, t->failed ? "FAILED" : "match C");
+        t->failed |= failed;
+    }
+    if(!flags)
+        fprintf(fh, "selftest: no SIMD level to test, C only\n");
+    int ret = t->failed ? -1 : 0;
+    free(t);
+    return ret;
+}
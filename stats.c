@@ -0,0 +1,211 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "common.h"
+#include "stats.h"
+#include "trace.h"
+
+#ifdef _WIN32
+#define PSAPI_VERSION 2 // GetProcessMemoryInfo from kernel32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <unistd.h>
+#endif
+
+struct stats_t
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int closing;
+    char *filename, *tmpname;
+    int interval;       // ms
+    int frames;
+    output_t *out;
+    int outputs;
+    int done;           // frames, stored by the frame loop
+    int64_t start;
+    int64_t last_time;  // of the previous write, for the instant fps
+    int last_done;
+    int write_failed;
+};
+
+/* resident set size in bytes, -1 when not known */
+static int64_t current_rss(void)
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if(GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return pmc.WorkingSetSize;
+    return -1;
+#elif defined(__linux__)
+    long pages = -1;
+    FILE *fh = fopen("/proc/self/statm", "r");
+    if(fh) {
+        if(fscanf(fh, "%*s %ld", &pages) != 1)
+            pages = -1;
+        fclose(fh);
+    }
+    return pages < 0 ? -1 : (int64_t)pages * sysconf(_SC_PAGESIZE);
+#else
+    return -1;
+#endif
+}
+
+static int write_stats(stats_t *h, const char *state)
+{
+    int64_t now = clock_ns();
+    int done = __atomic_load_n(&h->done, __ATOMIC_RELAXED);
+    double elapsed = (now - h->start) / 1e9;
+    double fps = now > h->last_time ? (done - h->last_done) * 1e9 / (now - h->last_time) : 0.;
+    double fps_avg = elapsed > 0 ? done / elapsed : 0.;
+    h->last_time = now;
+    h->last_done = done;
+
+    FILE *fh = fopen(h->tmpname, "w");
+    if(!fh)
+        return -1;
+    fprintf(fh, "{\"state\":\"%s\",\"frames\":%d,", state, done);
+    if(h->frames > 0)
+        fprintf(fh, "\"frames_total\":%d,", h->frames);
+    else
+        fprintf(fh, "\"frames_total\":null,");
+    fprintf(fh, "\"elapsed\":%.3f,\"fps\":%.3f,\"fps_avg\":%.3f,", elapsed, fps, fps_avg);
+    if(h->frames > 0 && fps_avg > 0)
+        fprintf(fh, "\"eta\":%.3f,", MAX(h->frames - done, 0) / fps_avg);
+    else
+        fprintf(fh, "\"eta\":null,");
+    int64_t rss = current_rss();
+    if(rss >= 0)
+        fprintf(fh, "\"rss\":%"PRId64",\"outputs\":[", rss);
+    else
+        fprintf(fh, "\"rss\":null,\"outputs\":[");
+    for(int i = 0; i < h->outputs; i++) {
+        fprintf(fh, "%s\n{\"file\":", i ? "," : "");
+        json_put_string(fh, h->out[i].filename);
+        fprintf(fh, ",\"bytes\":%"PRIu64",\"queued\":%d}", __atomic_load_n(&h->out[i].bytes, __ATOMIC_RELAXED),
+                __atomic_load_n(&h->out[i].queued, __ATOMIC_RELAXED));
+    }
+    fprintf(fh, "]}\n");
+    if(ferror(fh) | fclose(fh))
+        return -1;
+#ifdef _WIN32
+    return MoveFileExA(h->tmpname, h->filename, MOVEFILE_REPLACE_EXISTING) ? 0 : -1;
+#else
+    return rename(h->tmpname, h->filename);
+#endif
+}
+
+static void write_failed(stats_t *h)
+{
+    if(!h->write_failed)
+        fprintf(stderr, "error: failed to write the stats to \"%s\"\n", h->filename);
+    h->write_failed = 1;
+}
+
+static void *stats_thread(void *arg)
+{
+    stats_t *h = arg;
+    trace_thread_name("stats");
+    pthread_mutex_lock(&h->lock);
+    while(!h->closing) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += h->interval / 1000;
+        deadline.tv_nsec += (h->interval % 1000) * 1000000L;
+        if(deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        while(!h->closing && pthread_cond_timedwait(&h->cond, &h->lock, &deadline) != ETIMEDOUT);
+        if(h->closing)
+            break;
+        pthread_mutex_unlock(&h->lock);
+        int64_t start = trace_start();
+        if(write_stats(h, "running") < 0)
+            write_failed(h);
+        trace_span("stats", NULL, -1, start);
+        pthread_mutex_lock(&h->lock);
+    }
+    pthread_mutex_unlock(&h->lock);
+    return NULL;
+}
+
+static void free_stats(stats_t *h)
+{
+    free(h->filename);
+    free(h->tmpname);
+    free(h);
+}
+
+stats_t *stats_create(const char *filename, int interval, int frames, output_t *out, int outputs)
+{
+    stats_t *h = calloc(1, sizeof(stats_t));
+    if(h) {
+        h->filename = strdup(filename);
+        h->tmpname = malloc(strlen(filename) + 5);
+    }
+    if(!h || !h->filename || !h->tmpname) {
+        fprintf(stderr, "error: malloc failed\n");
+        if(h)
+            free_stats(h);
+        return NULL;
+    }
+    sprintf(h->tmpname, "%s.tmp", filename);
+    h->interval = MAX(interval, 1);
+    h->frames = frames;
+    h->out = out;
+    h->outputs = outputs;
+    h->start = h->last_time = clock_ns();
+    /* the file is there from the start, and one that can't be written fails up front */
+    if(write_stats(h, "running") < 0) {
+        fprintf(stderr, "error: failed to write the stats to \"%s\"\n", filename);
+        free_stats(h);
+        return NULL;
+    }
+    pthread_mutex_init(&h->lock, NULL);
+    pthread_cond_init(&h->cond, NULL);
+    if(pthread_create(&h->thread, NULL, stats_thread, h)) {
+        fprintf(stderr, "error: failed to create the stats thread\n");
+        pthread_cond_destroy(&h->cond);
+        pthread_mutex_destroy(&h->lock);
+        free_stats(h);
+        return NULL;
+    }
+    return h;
+}
+
+void stats_frames(stats_t *h, int done)
+{
+    __atomic_store_n(&h->done, done, __ATOMIC_RELAXED);
+}
+
+int stats_close(stats_t *h, int failed)
+{
+    if(!h)
+        return 0;
+    pthread_mutex_lock(&h->lock);
+    h->closing = 1;
+    pthread_cond_signal(&h->cond);
+    pthread_mutex_unlock(&h->lock);
+    pthread_join(h->thread, NULL);
+    if(write_stats(h, failed ? "failed" : "done") < 0)
+        write_failed(h);
+    int ret = h->write_failed ? -1 : 0;
+    pthread_cond_destroy(&h->cond);
+    pthread_mutex_destroy(&h->lock);
+    free_stats(h);
+    return ret;
+}
@@ -0,0 +1,27 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#ifndef AVS2YUV_STATS_H
+#define AVS2YUV_STATS_H
+
+#include "output.h"
+
+/* progress of the run as a JSON object in a file, rewritten by a thread of its own every
+   interval ms for schedulers to poll: frames done, instant and average fps, ETA, RSS and
+   each outfile's bytes and writer queue. It is written to <file>.tmp and renamed over
+   file, so readers never see half of one. The frame loop only does an atomic store */
+typedef struct stats_t stats_t;
+
+/* frames is the number of frames the run will render, 0 when not known. out must stay
+   valid until stats_close */
+stats_t *stats_create(const char *filename, int interval, int frames, output_t *out, int outputs);
+/* done frames have been rendered and handed to the outfiles */
+void stats_frames(stats_t *h, int done);
+/* stops the thread and writes the final state, "done" or "failed" */
+int stats_close(stats_t *h, int failed);
+
+#endif
@@ -0,0 +1,159 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#include <stdlib.h>
+#include "threads.h"
+#include "trace.h"
+#include "perf.h"
+
+typedef struct batch_t
+{
+    threadpool_func_t func;
+    void *arg;
+    int jobs;
+    int next;      // next job to hand out
+    int done;      // finished jobs
+    int stage, frame; // -perf span of the caller, counted by the workers too
+    pthread_cond_t finished;
+    struct batch_t *link;
+} batch_t;
+
+struct threadpool_t
+{
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    batch_t *head;
+    int exit;
+    int threads;
+    pthread_t *thread;
+};
+
+/* takes one job of the first batch which still has some; called locked */
+static batch_t *next_job(threadpool_t *pool, int *job)
+{
+    batch_t *b = pool->head;
+    while(b && b->next >= b->jobs)
+        b = b->link;
+    if(b)
+        *job = b->next++;
+    return b;
+}
+
+static void finish_job(threadpool_t *pool, batch_t *b)
+{
+    if(++b->done == b->jobs) {
+        batch_t **pp = &pool->head;
+        while(*pp != b)
+            pp = &(*pp)->link;
+        *pp = b->link;
+        pthread_cond_signal(&b->finished);
+    }
+}
+
+static void *worker(void *arg)
+{
+    threadpool_t *pool = arg;
+    trace_thread_name("worker");
+    pthread_mutex_lock(&pool->lock);
+    while(!pool->exit) {
+        int job;
+        batch_t *b = next_job(pool, &job);
+        if(!b) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&pool->lock);
+        perf_span_t span;
+        perf_begin(&span, b->stage, b->frame);
+        b->func(b->arg, job);
+        perf_end(&span);
+        pthread_mutex_lock(&pool->lock);
+        finish_job(pool, b);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+threadpool_t *threadpool_create(int threads)
+{
+    threadpool_t *pool = calloc(1, sizeof(threadpool_t));
+    if(!pool)
+        return NULL;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pool->threads = threads > 1 ? threads : 1;
+    if(pool->threads > 1) {
+        pool->thread = calloc(pool->threads - 1, sizeof(pthread_t));
+        if(!pool->thread) {
+            threadpool_delete(pool);
+            return NULL;
+        }
+        for(int i = 0; i < pool->threads - 1; i++)
+            if(pthread_create(&pool->thread[i], NULL, worker, pool)) {
+                pool->threads = i + 1;
+                break;
+            }
+    }
+    return pool;
+}
+
+void threadpool_delete(threadpool_t *pool)
+{
+    if(!pool)
+        return;
+    pthread_mutex_lock(&pool->lock);
+    pool->exit = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    if(pool->thread)
+        for(int i = 0; i < pool->threads - 1; i++)
+            pthread_join(pool->thread[i], NULL);
+    free(pool->thread);
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+int threadpool_threads(const threadpool_t *pool)
+{
+    return pool->threads;
+}
+
+void threadpool_run(threadpool_t *pool, threadpool_func_t func, void *arg, int jobs)
+{
+    if(jobs <= 0)
+        return;
+    if(pool->threads == 1 || jobs == 1) {
+        for(int i = 0; i < jobs; i++)
+            func(arg, i);
+        return;
+    }
+    batch_t b = {0};
+    b.func = func;
+    b.arg = arg;
+    b.jobs = jobs;
+    perf_current(&b.stage, &b.frame);
+    pthread_cond_init(&b.finished, NULL);
+    pthread_mutex_lock(&pool->lock);
+    batch_t **pp = &pool->head;
+    while(*pp)
+        pp = &(*pp)->link;
+    *pp = &b;
+    pthread_cond_broadcast(&pool->wake);
+    /* the caller works on its own batch instead of just waiting */
+    while(b.next < b.jobs) {
+        int job = b.next++;
+        pthread_mutex_unlock(&pool->lock);
+        func(arg, job);
+        pthread_mutex_lock(&pool->lock);
+        finish_job(pool, &b);
+    }
+    while(b.done < b.jobs)
+        pthread_cond_wait(&b.finished, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+    pthread_cond_destroy(&b.finished);
+}
@@ -0,0 +1,26 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#ifndef AVS2YUV_THREADS_H
+#define AVS2YUV_THREADS_H
+
+#include <pthread.h>
+
+typedef struct threadpool_t threadpool_t;
+typedef void (*threadpool_func_t)(void *arg, int job);
+
+/* threads is the total parallelism including the calling thread,
+   so a pool of 1 runs everything on the caller */
+threadpool_t *threadpool_create(int threads);
+void threadpool_delete(threadpool_t *pool);
+int threadpool_threads(const threadpool_t *pool);
+
+/* calls func(arg, job) for job = 0..jobs-1 and returns when all of them
+   have finished; may be called from several threads at once */
+void threadpool_run(threadpool_t *pool, threadpool_func_t func, void *arg, int jobs);
+
+#endif
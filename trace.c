@@ -0,0 +1,160 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "common.h"
+#include "trace.h"
+
+#define TRACE_CHUNK 4096 // spans added to a thread's buffer at a time
+
+typedef struct
+{
+    const char *name, *detail;
+    int frame;
+    int64_t start, end;
+} span_t;
+
+typedef struct trace_buf_t
+{
+    struct trace_buf_t *next;
+    int tid;
+    const char *name;
+    span_t *span;
+    int count, size;
+} trace_buf_t;
+
+static struct
+{
+    FILE *fh;
+    int64_t t0;
+    pthread_mutex_t lock; // for the list of buffers
+    trace_buf_t *bufs;
+    int threads;
+} trace;
+
+static __thread trace_buf_t *thread_buf;
+
+static int tracing;
+
+/* the calling thread's buffer, made on its first span */
+static trace_buf_t *get_buf(void)
+{
+    if(thread_buf)
+        return thread_buf;
+    trace_buf_t *b = calloc(1, sizeof(trace_buf_t));
+    if(!b)
+        return NULL;
+    pthread_mutex_lock(&trace.lock);
+    b->tid = ++trace.threads;
+    b->next = trace.bufs;
+    trace.bufs = b;
+    pthread_mutex_unlock(&trace.lock);
+    thread_buf = b;
+    return b;
+}
+
+int trace_open(const char *filename)
+{
+    trace.fh = fopen(filename, "w");
+    if(!trace.fh) {
+        fprintf(stderr, "error: failed to create/open \"%s\"\n", filename);
+        return -1;
+    }
+    pthread_mutex_init(&trace.lock, NULL);
+    trace.t0 = clock_ns();
+    tracing = 1;
+    trace_thread_name("main");
+    return 0;
+}
+
+int64_t trace_start(void)
+{
+    return tracing ? clock_ns() : 0;
+}
+
+void trace_span(const char *name, const char *detail, int frame, int64_t start)
+{
+    if(!tracing)
+        return;
+    int64_t end = clock_ns();
+    trace_buf_t *b = get_buf();
+    if(!b)
+        return;
+    if(b->count == b->size) {
+        span_t *span = realloc(b->span, (b->size + TRACE_CHUNK) * sizeof(span_t));
+        if(!span)
+            return;
+        b->span = span;
+        b->size += TRACE_CHUNK;
+    }
+    span_t *s = &b->span[b->count++];
+    s->name = name;
+    s->detail = detail;
+    s->frame = frame;
+    s->start = start;
+    s->end = end;
+}
+
+void trace_thread_name(const char *name)
+{
+    if(!tracing)
+        return;
+    trace_buf_t *b = get_buf();
+    if(b)
+        b->name = name;
+}
+
+int trace_close(void)
+{
+    if(!tracing)
+        return 0;
+    tracing = 0;
+    FILE *fh = trace.fh;
+    const char *sep = "";
+    fprintf(fh, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for(trace_buf_t *b = trace.bufs; b; b = b->next) {
+        char name[32];
+        if(!b->name)
+            sprintf(name, "thread %d", b->tid);
+        fprintf(fh, "%s{\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":", sep, b->tid);
+        json_put_string(fh, b->name ? b->name : name);
+        fprintf(fh, "}}");
+        sep = ",\n";
+        for(int i = 0; i < b->count; i++) {
+            span_t *s = &b->span[i];
+            fprintf(fh, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"name\":",
+                    b->tid, (s->start - trace.t0) / 1e3, (s->end - s->start) / 1e3);
+            json_put_string(fh, s->name);
+            if(s->detail || s->frame >= 0) {
+                fprintf(fh, ",\"args\":{");
+                if(s->frame >= 0)
+                    fprintf(fh, "\"frame\":%d%s", s->frame, s->detail ? "," : "");
+                if(s->detail) {
+                    fprintf(fh, "\"detail\":");
+                    json_put_string(fh, s->detail);
+                }
+                fputc('}', fh);
+            }
+            fputc('}', fh);
+        }
+    }
+    fprintf(fh, "\n]}\n");
+    int ret = ferror(fh) | fclose(fh) ? -1 : 0;
+    while(trace.bufs) {
+        trace_buf_t *b = trace.bufs;
+        trace.bufs = b->next;
+        free(b->span);
+        free(b);
+    }
+    pthread_mutex_destroy(&trace.lock);
+    if(ret < 0)
+        fprintf(stderr, "error: failed to write the trace\n");
+    return ret;
+}
@@ -0,0 +1,29 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#ifndef AVS2YUV_TRACE_H
+#define AVS2YUV_TRACE_H
+
+#include <stdint.h>
+
+/* timeline of the run in Chrome trace-event JSON (chrome://tracing, ui.perfetto.dev).
+   Spans are kept in a buffer of the thread they happened on and only written out by
+   trace_close, so tracing costs two clock reads per span; when it's off, one branch */
+
+/* starts tracing, naming the calling thread "main" */
+int trace_open(const char *filename);
+/* writes all threads' spans and stops tracing */
+int trace_close(void);
+/* the start of a span, 0 when not tracing */
+int64_t trace_start(void);
+/* ends a span begun at start on the calling thread. name and detail (which may be NULL)
+   must stay valid until trace_close; frame < 0 for none */
+void trace_span(const char *name, const char *detail, int frame, int64_t start);
+/* names the calling thread in the timeline */
+void trace_thread_name(const char *name);
+
+#endif
@@ -0,0 +1,284 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#define _GNU_SOURCE // fallocate
+#define _FILE_OFFSET_BITS 64
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+#include "writer.h"
+#include "trace.h"
+
+#define PUNCH_SIZE (64*1024*1024) // spill file space is given back by this much
+
+typedef struct
+{
+    uint8_t *data;
+    size_t size;
+} block_t;
+
+struct writer_t
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    writer_func_t func;
+    void *arg;
+    int frames;
+    block_t *mem;                  // ring of frames blocks
+    int mem_head, mem_count;
+    const char *spill_dir;
+    int fd;                        // spill file, a size followed by the data of each block
+    uint64_t disk_read, disk_write, punched;
+    int disk_count, reserved;      // blocks in the file, one being written to it
+    int spilled;
+    uint64_t peak;
+    int closing, failed;
+};
+
+#ifndef _WIN32
+static int write_all(int fd, const void *buf, size_t size, uint64_t off)
+{
+    const uint8_t *p = buf;
+    while(size) {
+        ssize_t n = pwrite(fd, p, size, off);
+        if(n <= 0)
+            return -1;
+        p += n;
+        off += n;
+        size -= n;
+    }
+    return 0;
+}
+
+static int read_all(int fd, void *buf, size_t size, uint64_t off)
+{
+    uint8_t *p = buf;
+    while(size) {
+        ssize_t n = pread(fd, p, size, off);
+        if(n <= 0)
+            return -1;
+        p += n;
+        off += n;
+        size -= n;
+    }
+    return 0;
+}
+
+/* unlinked at once, so nothing is left behind whatever happens */
+static int open_spill_file(const char *dir)
+{
+    char *name = malloc(strlen(dir) + 32);
+    if(!name)
+        return -1;
+    sprintf(name, "%s/avs2yuv-spill-XXXXXX", dir);
+    int fd = mkstemp(name);
+    if(fd >= 0) {
+        unlink(name);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    free(name);
+    return fd;
+}
+
+/* reads the next block of the spill file, the lock being released meanwhile */
+static int read_spilled(writer_t *h, block_t *b)
+{
+    uint64_t off = h->disk_read, size;
+    pthread_mutex_unlock(&h->lock);
+    int ret = read_all(h->fd, &size, 8, off);
+    if(!ret) {
+        b->size = size;
+        b->data = malloc(size ? size : 1);
+        ret = b->data ? read_all(h->fd, b->data, size, off + 8) : -1;
+    }
+    pthread_mutex_lock(&h->lock);
+    if(ret < 0) {
+        fprintf(stderr, "error: failed to read the spill file\n");
+        return -1;
+    }
+    h->disk_read = off + 8 + size;
+    h->disk_count--;
+    if(!h->disk_count && !h->reserved) {
+        /* caught up, the file starts over */
+        h->disk_read = h->disk_write = h->punched = 0;
+        if(ftruncate(h->fd, 0) < 0)
+            return -1;
+    }
+#ifdef FALLOC_FL_PUNCH_HOLE
+    else if(h->disk_read - h->punched >= PUNCH_SIZE) {
+        fallocate(h->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, h->punched, h->disk_read - h->punched);
+        h->punched = h->disk_read;
+    }
+#endif
+    return 0;
+}
+#endif
+
+static void *writer_thread(void *arg)
+{
+    writer_t *h = arg;
+    trace_thread_name("writer");
+    pthread_mutex_lock(&h->lock);
+    for(;;) {
+        if(!h->mem_count && !h->disk_count) {
+            if(h->closing)
+                break;
+            /* a chance to flush before waiting */
+            if(!h->failed) {
+                pthread_mutex_unlock(&h->lock);
+                int ret = h->func(h->arg, NULL, 0);
+                pthread_mutex_lock(&h->lock);
+                h->failed |= ret < 0;
+            }
+            while(!h->mem_count && !h->disk_count && !h->closing)
+                pthread_cond_wait(&h->cond, &h->lock);
+            continue;
+        }
+        /* memory blocks are older than the spilled ones */
+        block_t b;
+        if(h->mem_count) {
+            b = h->mem[h->mem_head];
+            h->mem_head = (h->mem_head + 1) % h->frames;
+            h->mem_count--;
+        }
+        else if(h->failed) {
+            h->disk_count = 0;
+            continue;
+        }
+#ifndef _WIN32
+        else if(read_spilled(h, &b) < 0) {
+            h->failed = 1;
+            h->disk_count = 0;
+            break;
+        }
+#endif
+        pthread_cond_broadcast(&h->cond);
+        if(!h->failed) {
+            pthread_mutex_unlock(&h->lock);
+            int ret = h->func(h->arg, b.data, b.size);
+            pthread_mutex_lock(&h->lock);
+            h->failed |= ret < 0;
+            pthread_cond_broadcast(&h->cond);
+        }
+        free(b.data);
+    }
+    pthread_mutex_unlock(&h->lock);
+    return NULL;
+}
+
+writer_t *writer_create(int frames, const char *spill_dir, writer_func_t func, void *arg)
+{
+#ifdef _WIN32
+    if(spill_dir) {
+        fprintf(stderr, "error: spilling isn't supported on this platform\n");
+        return NULL;
+    }
+#endif
+    writer_t *h = calloc(1, sizeof(writer_t));
+    if(!h)
+        return NULL;
+    h->mem = calloc(frames, sizeof(block_t));
+    if(!h->mem) {
+        free(h);
+        return NULL;
+    }
+    h->frames = frames;
+    h->spill_dir = spill_dir;
+    h->fd = -1;
+    h->func = func;
+    h->arg = arg;
+    pthread_mutex_init(&h->lock, NULL);
+    pthread_cond_init(&h->cond, NULL);
+    if(pthread_create(&h->thread, NULL, writer_thread, h)) {
+        pthread_mutex_destroy(&h->lock);
+        pthread_cond_destroy(&h->cond);
+        free(h->mem);
+        free(h);
+        return NULL;
+    }
+    return h;
+}
+
+int writer_push(writer_t *h, uint8_t *data, size_t size)
+{
+    pthread_mutex_lock(&h->lock);
+    if(!h->spill_dir)
+        while(h->mem_count == h->frames && !h->failed)
+            pthread_cond_wait(&h->cond, &h->lock);
+    if(h->failed) {
+        pthread_mutex_unlock(&h->lock);
+        free(data);
+        return -1;
+    }
+    if(h->mem_count < h->frames && !h->disk_count && !h->reserved) {
+        h->mem[(h->mem_head + h->mem_count) % h->frames] = (block_t){data, size};
+        h->mem_count++;
+        pthread_cond_broadcast(&h->cond);
+        pthread_mutex_unlock(&h->lock);
+        return 0;
+    }
+    int ret = -1;
+#ifndef _WIN32
+    /* the space is taken first so that the file is written without the lock */
+    if(h->fd < 0)
+        h->fd = open_spill_file(h->spill_dir);
+    if(h->fd < 0) {
+        fprintf(stderr, "error: failed to create a spill file in \"%s\"\n", h->spill_dir);
+        h->failed = 1;
+        pthread_mutex_unlock(&h->lock);
+        free(data);
+        return -1;
+    }
+    uint64_t off = h->disk_write, size64 = size;
+    h->disk_write += 8 + size;
+    h->reserved = 1;
+    pthread_mutex_unlock(&h->lock);
+    ret = write_all(h->fd, &size64, 8, off) || write_all(h->fd, data, size, off + 8) ? -1 : 0;
+    free(data);
+    pthread_mutex_lock(&h->lock);
+    h->reserved = 0;
+    if(ret < 0) {
+        fprintf(stderr, "error: failed to write to the spill file in \"%s\"\n", h->spill_dir);
+        h->failed = 1;
+    } else {
+        h->disk_count++;
+        h->spilled++;
+        if(h->disk_write - h->punched > h->peak)
+            h->peak = h->disk_write - h->punched;
+    }
+    pthread_cond_broadcast(&h->cond);
+    pthread_mutex_unlock(&h->lock);
+#endif
+    return ret;
+}
+
+int writer_close(writer_t *h, int *spilled, uint64_t *peak)
+{
+    pthread_mutex_lock(&h->lock);
+    h->closing = 1;
+    pthread_cond_broadcast(&h->cond);
+    pthread_mutex_unlock(&h->lock);
+    pthread_join(h->thread, NULL);
+    int ret = h->failed ? -1 : 0;
+    *spilled = h->spilled;
+    *peak = h->peak;
+#ifndef _WIN32
+    if(h->fd >= 0)
+        close(h->fd);
+#endif
+    pthread_mutex_destroy(&h->lock);
+    pthread_cond_destroy(&h->cond);
+    free(h->mem);
+    free(h);
+    return ret;
+}
@@ -0,0 +1,29 @@
+// Avs2YUV by Loren Merritt
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+
+#ifndef AVS2YUV_WRITER_H
+#define AVS2YUV_WRITER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* a thread handing the blocks pushed to func, in order, so that an output
+   doesn't hold up the render. Up to frames blocks wait in memory; once those
+   are taken, pushing waits for room, or with a spill directory the blocks go
+   to a temp file there until the thread has caught up */
+typedef struct writer_t writer_t;
+/* data is NULL when the queue has run empty, for flushing */
+typedef int (*writer_func_t)(void *arg, const uint8_t *data, size_t size);
+
+writer_t *writer_create(int frames, const char *spill_dir, writer_func_t func, void *arg);
+/* takes over data, which must come from malloc. Fails once func has failed */
+int writer_push(writer_t *h, uint8_t *data, size_t size);
+/* waits for all blocks to be written and frees h, failing if any write failed.
+   spilled is set to the blocks that went through the spill file, peak to the most it held */
+int writer_close(writer_t *h, int *spilled, uint64_t *peak);
+
+#endif